@@ -86,6 +86,19 @@ extern "C" {
     double all_hwcs[MCTOP_POW_TYPE_NUM];
   } mctop_pow_info_t;
 
+  typedef struct mctop_flat	/* struct-of-arrays view of the graph for the hwcid getters */
+  {
+    uint* socket;		/* per hwc: socket seq. id */
+    uint* node;			/* per hwc: local NUMA node */
+    uint* nth_in_socket;	/* per hwc: position in the hwc list of its socket */
+    uint* nth_in_core;		/* per hwc: position in its core */
+    uint* nth_core_in_socket;	/* per hwc: position of its core in the core list of its socket */
+    struct hwc_gs** core;	/* per hwc: its core (the hwc itself if not SMT) */
+    uint n_gs;			/* num. of groups below sockets */
+    uint* lvl_off;		/* per lvl 1..socket_level: offset of the lvl in gs */
+    struct hwc_gs** gs;		/* groups below sockets, lvl by lvl, in list order */
+  } mctop_flat_t;
+
   typedef struct mctop
   {
     uint n_levels;		/* num. of latency lvls */
@@ -107,6 +120,11 @@ extern "C" {
     double* mem_bandwidths_w;	/* Write mem. bandwidth of each socket, maximum */
     double* mem_bandwidths1_w;	/* Write mem. bandwidth of each socket, single threaded */
     mctop_pow_info_t* pow_info;	/* power info */
+    uint* lat_table;		/* comm. latency of each pair of hwcs (n_hwcs x n_hwcs) */
+    struct hwc_gs** gs_index;	/* groups below sockets by id: [(lvl - 1) * n_hwcs + seq. id] */
+    mctop_flat_t flat;		/* flattened view, built once */
+    void* mmap_base;		/* if loaded from a binary MCT file, its mapping */
+    size_t mmap_size;
   } mctop_t;
 
   typedef struct hwc_gs		/* group / socket */
@@ -201,6 +219,18 @@ extern "C" {
 			   uint64_t** mem_lat_table, const uint n_sockets,
 			   cdf_cluster_t* cc, const int is_smt);
   mctop_t* mctop_load(const char* mct_file);
+  /* binary MCT (.mctb) files: the constructed topology, loaded with mmap w/o parsing */
+  int mctop_save_bin(mctop_t* topo, const char* mctb_file);
+  mctop_t* mctop_load_bin(const char* mctb_file);
+  /* process-shared topology: publish it in a named shm segment (e.g., from a daemon), and attach
+     to it from any process. Attached topologies are read-only; release them with mctop_free.
+     mctop_attach_local only attaches to segments that were published on this host, for a
+     topology with as many hw contexts as this machine */
+#define MCTOP_SHM_NAME "/mctop"
+  int mctop_publish(mctop_t* topo, const char* shm_name);
+  mctop_t* mctop_attach(const char* shm_name);
+  mctop_t* mctop_attach_local(const char* shm_name);
+  int mctop_unpublish(const char* shm_name);
   void mctop_free(mctop_t* topo);
   void mctop_mem_bandwidth_add(mctop_t* topo, double** mem_bw_r, double** mem_bw_r1, double** mem_bw_w, double** mem_bw_w1);
   void mctop_mem_latencies_add(mctop_t* topo, uint64_t** mem_lat_table);
@@ -280,6 +310,22 @@ extern "C" {
   uint mctop_has_mem_lat(mctop_t* topo);
   uint mctop_has_mem_bw(mctop_t* topo);
   uint mctop_ids_get_latency(mctop_t* topo, const uint id0, const uint id1);
+  uint mctop_ids_get_level(mctop_t* topo, const uint id0, const uint id1);
+
+  /* backoff ************************************************************************ */
+  typedef struct mctop_backoff
+  {
+    uint quantum;		/* cycles of the first wait */
+    uint max;			/* cap of the exponential growth */
+    uint cur;			/* cycles of the next wait */
+  } mctop_backoff_t;
+
+  /* quanta derived from the latency of lvl and the cache latencies */
+  mctop_backoff_t mctop_backoff_get(mctop_t* topo, const uint level);
+  /* as mctop_backoff_get, for the lvl that connects the waiter with the owner */
+  mctop_backoff_t mctop_backoff_get_ids(mctop_t* topo, const uint hwc_waiter, const uint hwc_owner);
+  void mctop_backoff_reset(mctop_backoff_t* b);
+  void mctop_backoff_wait(mctop_backoff_t* b); /* wait b->cur cycles, then double it up to b->max */
 
   /* sibling getters ***************************************************************** */
   socket_t* mctop_sibling_get_other_socket(sibling_t* sibling, socket_t* socket);
@@ -17,6 +17,37 @@ extern "C" {
 #define mctop_barrier_wait(barrier)     pthread_barrier_wait(barrier)
 #define mctop_barrier_destroy(barrier)  pthread_barrier_destroy(barrier)
 
+#define MCTOP_ALIGNED(al) __attribute__((aligned(al)))
+
+  /* Topology barrier: a combining tree whose levels are the SMT siblings of a core, the cores
+     of a socket, and the sockets. Arrivals and releases use separate cache lines per tree node,
+     and waiters spin on their node only. The last thread to arrive at a node continues to
+     the parent and, once released, releases the node (sense reversal with an episode
+     counter). Waiters spin for a while and then sleep on the episode futex. */
+#define MCTOP_TBARRIER_SPINS 4096 /* spins before a waiter sleeps on the futex of its node, 0 if the
+				   barrier has more threads than online processors */
+
+  typedef struct MCTOP_ALIGNED(64) mctop_tbarrier_node
+  {
+    volatile uint32_t arrived;
+    uint32_t n_arrive;
+    uint32_t spins;
+    struct mctop_tbarrier_node* parent;
+    volatile uint32_t episode MCTOP_ALIGNED(64);
+    volatile uint32_t n_sleeping;
+  } mctop_tbarrier_node_t;
+
+  typedef struct mctop_tbarrier
+  {
+    uint n_threads;
+    uint n_nodes;
+    mctop_tbarrier_node_t** nodes;
+    uint n_sockets;
+    mctop_tbarrier_node_t** socket_nodes; /* the nodes of each socket, one array on the socket */
+    uint* socket_n_nodes;		      /* size of each array */
+    mctop_tbarrier_node_t** leaves; /* per thread id of the allocator, NULL if not part of it */
+  } mctop_tbarrier_t;
+
   /* ******************************************************************************** */
   /* MCTOP Allocator */
   /* ******************************************************************************** */
@@ -70,9 +101,10 @@ extern "C" {
     lgrp_id_t hwcs_all;
 #endif
 
-    mctop_barrier_t** socket_barriers;
+    struct mctop_tbarrier** socket_barriers;
     mctop_barrier_t** socket_barriers_cores;
-    mctop_barrier_t* global_barrier;
+    mctop_barrier_t* global_barrier; /* MCTOP_ALLOC_NONE */
+    struct mctop_tbarrier* global_tbarrier;
   } mctop_alloc_t;
 
   struct mctop_alloc_pool;
@@ -154,6 +186,13 @@ extern "C" {
   int mctop_alloc_pin_nth_socket(mctop_alloc_t* alloc, const uint nth);
   int mctop_alloc_pin_all(mctop_alloc_t* alloc);
 
+  /* topology barrier of the threads of the nth socket, or of all threads if nth < 0 */
+  mctop_tbarrier_t* mctop_tbarrier_create(mctop_alloc_t* alloc, const int nth);
+  void mctop_tbarrier_free(mctop_tbarrier_t* b);
+  void mctop_tbarrier_wait(mctop_tbarrier_t* b, const uint id); /* id : mctop_alloc_thread_id() */
+
+  /* Every participant of mctop_alloc_barrier_wait_all must be pinned with alloc (it then waits on
+     the topology barrier), or none of them (they wait on a pthread barrier): a mix deadlocks. */
   void mctop_alloc_barrier_wait_all(mctop_alloc_t* alloc); /* wait for ALL threads handled by alloc to cross */
   void mctop_alloc_barrier_wait_node(mctop_alloc_t* alloc); /* wait for the threads of the node/socket to cross */
   void mctop_alloc_barrier_wait_node_cores(mctop_alloc_t* alloc); /* wait for the threads of the node/socket to cross */
@@ -272,6 +311,30 @@ extern "C" {
     mctop_barrier_t* barrier;
   } mctop_nt_lvl_t;
 
+  /* collectives: each thread publishes its data in a slot on its node */
+  typedef struct MCTOP_ALIGNED(64) mctop_nt_slot
+  {
+    void* volatile data;
+    volatile uint32_t epoch;	/* # of collectives the thread has entered */
+  } mctop_nt_slot_t;
+
+  /* collectives: per node, allocated on the node. Epoch flags are written by the node leader */
+  typedef struct MCTOP_ALIGNED(64) mctop_nt_coll
+  {
+    void* volatile data;	/* the leader's data */
+    volatile uint32_t combined;	/* the node's threads are combined in data */
+    volatile uint32_t ready;	/* data holds the result of the node's subtree */
+    volatile uint32_t bcast;	/* data holds the broadcast value */
+    volatile uint32_t consumed MCTOP_ALIGNED(64); /* set by the parent once it combined data */
+    volatile size_t n_copied MCTOP_ALIGNED(64);	  /* copies of the broadcast values, ever */
+    size_t n_copied_expected;
+    uint parent;		/* combines the result of this node; itself for the root */
+    uint n_children;
+    uint* children;		/* in the order they are combined */
+    uint n_slots;
+    mctop_nt_slot_t slots[0];	/* one per hw context of the node */
+  } mctop_nt_coll_t;
+
   typedef struct mctop_node_tree
   {
     mctop_alloc_t* alloc;
@@ -281,6 +344,8 @@ extern "C" {
     mctop_barrier_t* barrier;
     mctop_type_t barrier_for;
     void** scratchpad;		/* share with the threads of your node */
+    uint yield;			/* more threads than processors: yield instead of spinning */
+    mctop_nt_coll_t** colls;
   } mctop_node_tree_t;
 
   typedef enum
@@ -326,22 +391,55 @@ extern "C" {
   /* waits on all threads */
   void mctop_node_tree_barrier_wait_all(mctop_node_tree_t* nt);
 
+  /* Collectives. Every thread of the allocator must call them, in the same order. The threads of
+     a node are combined by the node leader, then the node leaders combine along the tree,
+     towards mctop_node_tree_get_final_dest_node(). */
+  typedef void (*mctop_nt_combine_fun)(void* into, const void* from); /* into = into (+) from */
+
+  /* is this thread the leader of the final destination node, i.e., the root of the collectives? */
+  uint mctop_node_tree_is_root(mctop_node_tree_t* nt);
+  /* combines data of all threads into the data of the root; returns 1 on the root */
+  uint mctop_nt_reduce(mctop_node_tree_t* nt, void* data, mctop_nt_combine_fun combine);
+  /* copies the size bytes of data of the root to the data of every thread */
+  void mctop_nt_broadcast(mctop_node_tree_t* nt, void* data, const size_t size);
+  /* reduce followed by broadcast */
+  void mctop_nt_allreduce(mctop_node_tree_t* nt, void* data, const size_t size, mctop_nt_combine_fun combine);
+
 
   /* ******************************************************************************** */
   /* Work Queues */
   /* ******************************************************************************** */
 
+  typedef enum
+    {
+      MCTOP_WQ_LOCKED,		/* linked list protected by a spinlock (or TSX) */
+      MCTOP_WQ_LOCK_FREE,	/* bounded lock-free MPMC ring, overflows to the linked list */
+    } mctop_wq_type_t;
+
+#define MCTOP_WQ_RING_SIZE 8192	/* slots per lock-free queue, power of 2 */
+#define MCTOP_WQ_SLAB_SIZE 512	/* list nodes per slab of the per-queue node pool */
+#define MCTOP_WQ_PARK_SPINS 1024 /* idle polls of the queues before parking on the socket futex */
+
   typedef struct mctop_wq
   {
     mctop_alloc_t* alloc;
+    mctop_wq_type_t type;
     uint n_queues;
     volatile uint32_t n_entered;
     volatile uint32_t n_exited;    
+    uint park;			/* parking mode, see mctop_wq_dequeue_wait */
+    volatile uint32_t park_done;
+    volatile uint64_t park_idle;	/* #idle threads (low 32 bits) and generation */
+    struct mctop_wq_stats** stats;	/* per thread, NULL unless mctop_wq_stats_enable */
     struct mctop_queue* queues[0];	/* or * ? */
   } mctop_wq_t;
 
 
-#define MCTOP_ALIGNED(al) __attribute__((aligned(al)))
+  typedef struct mctop_qslot
+  {
+    volatile size_t seq;
+    const void* data;
+  } mctop_qslot_t;
 
   typedef struct MCTOP_ALIGNED(64) mctop_queue
   {
@@ -349,8 +447,18 @@ extern "C" {
     volatile size_t size;
     struct mctop_qnode* head;
     struct mctop_qnode* tail;
-    volatile uint8_t padding[64 - sizeof(uint64_t) - sizeof(size_t) - 2 * sizeof(struct mctop_qnode*)];
-    uint next_q[0];
+    struct mctop_qnode* free;	/* node pool: protected by the lock, slabs on the queue's node */
+    struct mctop_qnode* slabs;
+    mctop_alloc_t* alloc;
+    uint nth_socket;
+    mctop_wq_type_t type;
+    size_t ring_mask;		/* MCTOP_WQ_LOCK_FREE only */
+    mctop_qslot_t* ring;
+    volatile size_t enq_pos MCTOP_ALIGNED(64);
+    volatile size_t deq_pos MCTOP_ALIGNED(64);
+    volatile uint32_t park_seq MCTOP_ALIGNED(64); /* futex of the threads parked on this socket */
+    volatile uint32_t n_parked;
+    uint next_q[0] MCTOP_ALIGNED(64);
   } mctop_queue_t;
 
   typedef  struct MCTOP_ALIGNED(64) mctop_qnode
@@ -359,28 +467,224 @@ extern "C" {
     const void* data;
   } mctop_qnode_t;
 
-  mctop_wq_t* mctop_wq_create(mctop_alloc_t* alloc);
+#define MCTOP_WQ_STATS_SAMPLE 64	/* power of 2 */
+
+  typedef struct mctop_wq_steal_stats
+  {
+    size_t n;			/* successful steals */
+    size_t n_empty;		/* probes that found the queue empty */
+    uint64_t cycles;		/* spent in the successful steals */
+  } mctop_wq_steal_stats_t;
+
+  typedef struct MCTOP_ALIGNED(64) mctop_wq_stats /* of a thread, or of a socket when aggregated */
+  {
+    uint nth_socket;
+    uint n_dists;		/* steal distances: the n_queues - 1 remote queues in next_q order */
+    size_t n_enqueue;
+    size_t n_dequeue_local;
+    size_t n_dequeue_local_timed; /* local dequeues are timed 1 in MCTOP_WQ_STATS_SAMPLE */
+    uint64_t cycles_local;	/* of the timed local dequeues */
+    size_t n_empty;		/* dequeues that found all the queues empty */
+    mctop_wq_steal_stats_t steal[0];
+  } mctop_wq_stats_t;
+
+  mctop_wq_t* mctop_wq_create(mctop_alloc_t* alloc); /* MCTOP_WQ_LOCKED queues */
+  mctop_wq_t* mctop_wq_create_type(mctop_alloc_t* alloc, const mctop_wq_type_t type);
   void mctop_wq_free(mctop_wq_t* wq);
+  /* Enable (park = 1) the parking mode. Must be set before any thread uses the queue. */
+  void mctop_wq_set_park(mctop_wq_t* wq, const uint park);
 
   void mctop_wq_print(mctop_wq_t* wq);
-  void mctop_wq_stats_print(mctop_wq_t* wq);
+
+  /* Per-thread statistics, padded and on the thread's node, thus cheap enough to keep on.
+     Must be enabled before any thread uses the queue. Only pinned threads are counted. */
+  void mctop_wq_stats_enable(mctop_wq_t* wq);
+  void mctop_wq_stats_print(mctop_wq_t* wq); /* statistics of the calling thread */
+  /* Sum of the statistics of the threads on the nth socket (or of all threads, if
+     nth == n_queues). Returns NULL if statistics are disabled. Release with free(). */
+  mctop_wq_stats_t* mctop_wq_stats_get(mctop_wq_t* wq, const uint nth);
+  void mctop_wq_stats_print_sockets(mctop_wq_t* wq); /* steal locality and contention per socket */
 
   void mctop_wq_enqueue(mctop_wq_t* wq, const void* data); /* Use local node queue. */
   void mctop_wq_enqueue_nth_socket(mctop_wq_t* wq, const uint nth, const void* data); /* Use nth queue. */
   void mctop_wq_enqueue_node(mctop_wq_t* wq, const uint node, const void* data);     /* Use queue corresponding to "node" 
 											NUMA node */
 
+  /* Enqueue n elements with a single synchronization operation. */
+  void mctop_wq_enqueue_batch(mctop_wq_t* wq, const void** data, const uint n);
+  void mctop_wq_enqueue_batch_nth_socket(mctop_wq_t* wq, const uint nth, const void** data, const uint n);
+  void mctop_wq_enqueue_batch_node(mctop_wq_t* wq, const uint node, const void** data, const uint n);
+  /* Dequeue up to max elements from local. If empty, steal up to half of the first non-empty
+     remote queue. Returns the number of elements in data. */
+  uint mctop_wq_dequeue_batch(mctop_wq_t* wq, void** data, const uint max);
+
   void* mctop_wq_dequeue(mctop_wq_t* wq); /* Try to dequeue from local. If empty, try the remote ones. 
 					     If empty, retry local once more. */
   void* mctop_wq_dequeue_local(mctop_wq_t* wq); /* Try to dequeue from local only. */
   void* mctop_wq_dequeue_remote(mctop_wq_t* wq); /* Try to dequeue from remote ones only. */
+  /* Parking mode only: dequeue or wait for work. An idle thread polls the queues for
+     MCTOP_WQ_PARK_SPINS rounds and then sleeps on the futex of its socket. Enqueues wake one
+     parked thread of the target socket, or of the closest socket with parked threads. Returns
+     NULL once all the hw contexts of the allocator are idle and all queues are empty. */
+  void* mctop_wq_dequeue_wait(mctop_wq_t* wq);
 
-  size_t mctop_wq_get_size_atomic(mctop_wq_t* wq); /* Lock all queues and get the total current size. */
+  size_t mctop_wq_get_size_atomic(mctop_wq_t* wq); /* Lock all queues and get the total current size.
+						      Lock-free rings are only snapshot. */
 
   uint mctop_wq_thread_enter(mctop_wq_t* wq);   /* inform the others that you are working on WQ. Returns 1 if last thread. */
   uint mctop_wq_thread_exit(mctop_wq_t* wq);	/* inform the others that you stopped working on WQ. Returns 1 if last thread. */
   uint mctop_wq_is_last_thread(mctop_wq_t* wq);	/* Returns 1 if it's the last active thread. */
 
+  /* ******************************************************************************** */
+  /* Priority Work Queues */
+  /* ******************************************************************************** */
+
+#define MCTOP_PWQ_N_PRIOS 4	/* priority levels, 0 is the most urgent */
+
+  typedef struct mctop_pwq	/* one work queue per priority level */
+  {
+    mctop_alloc_t* alloc;
+    uint n_prios;
+    mctop_wq_t* prios[MCTOP_PWQ_N_PRIOS];
+  } mctop_pwq_t;
+
+  mctop_pwq_t* mctop_pwq_create(mctop_alloc_t* alloc, const mctop_wq_type_t type);
+  void mctop_pwq_free(mctop_pwq_t* pwq);
+  void mctop_pwq_print(mctop_pwq_t* pwq);
+
+  /* prio >= MCTOP_PWQ_N_PRIOS is treated as the lowest priority */
+  void mctop_pwq_enqueue(mctop_pwq_t* pwq, const uint prio, const void* data);
+  void mctop_pwq_enqueue_nth_socket(mctop_pwq_t* pwq, const uint nth, const uint prio, const void* data);
+  void mctop_pwq_enqueue_node(mctop_pwq_t* pwq, const uint node, const uint prio, const void* data);
+  /* Most urgent level first. Within a level, local queue first, then steal in next_q order.
+     If prio is not NULL, it is set to the level of the returned element. */
+  void* mctop_pwq_dequeue(mctop_pwq_t* pwq, uint* prio);
+  void* mctop_pwq_dequeue_local(mctop_pwq_t* pwq, uint* prio); /* local queue only */
+  size_t mctop_pwq_get_size_atomic(mctop_pwq_t* pwq);
+
+  /* ******************************************************************************** */
+  /* Work Stealing */
+  /* ******************************************************************************** */
+
+#define MCTOP_WS_DEQUE_SIZE 1024	/* initial slots per deque, power of 2; deques grow */
+
+  typedef struct mctop_ws_array
+  {
+    size_t size;
+    struct mctop_ws_array* prev;	/* smaller array this one replaced */
+    void* data[0];
+  } mctop_ws_array_t;
+
+  typedef struct MCTOP_ALIGNED(64) mctop_ws_deque /* Chase-Lev deque of one hw context */
+  {
+    volatile int64_t top;		/* thieves */
+    volatile int64_t bottom MCTOP_ALIGNED(64); /* owner */
+    mctop_ws_array_t* array;
+    uint* victims;		/* allocator ids of the other deques, closest first */
+  } mctop_ws_deque_t;
+
+  typedef struct mctop_ws
+  {
+    mctop_alloc_t* alloc;
+    uint n_deques;		/* one per hw context of alloc */
+    mctop_ws_deque_t* deques[0];
+  } mctop_ws_t;
+
+  mctop_ws_t* mctop_ws_create(mctop_alloc_t* alloc);
+  void mctop_ws_free(mctop_ws_t* ws);
+  void mctop_ws_print(mctop_ws_t* ws);
+
+  /* The calling thread must be pinned with mctop_alloc_pin on ws->alloc. */
+  void mctop_ws_push(mctop_ws_t* ws, const void* data); /* Push to own deque. */
+  void* mctop_ws_pop(mctop_ws_t* ws);	/* Pop from own deque (LIFO). */
+  void* mctop_ws_steal(mctop_ws_t* ws); /* Steal from the others (FIFO), closest first. */
+  void* mctop_ws_get(mctop_ws_t* ws);	/* Pop, or steal if own deque is empty. */
+  size_t mctop_ws_get_size(mctop_ws_t* ws); /* Approximate total number of elements. */
+
+  /* ******************************************************************************** */
+  /* Cohort Lock */
+  /* ******************************************************************************** */
+
+  /* NUMA cohort lock: an MCS lock per socket of the allocator and a global ticket lock. The
+     thread at the head of a socket's queue takes the global lock, and on release passes it to
+     its local successor, up to handoff_max times in a row, before releasing it to the other
+     sockets. Waiting for a ticket backs off proportionally to the distance from the ticket
+     being served, in backoff quanta (mctop_backoff_get) of the lvl that the allocator spans. */
+#define MCTOP_LOCK_HANDOFF_MAX 64 /* consecutive local handoffs of the global lock */
+
+  typedef enum
+    {
+      MCTOP_LOCK_WAIT,		/* queued behind a local predecessor */
+      MCTOP_LOCK_GLOBAL_ACQUIRE,	/* head of the local queue, must take the global lock */
+      MCTOP_LOCK_GLOBAL_PASSED,	/* head of the local queue, the global lock was handed over */
+    } mctop_lock_state_t;
+
+  typedef struct MCTOP_ALIGNED(64) mctop_lock_qnode /* of a thread */
+  {
+    struct mctop_lock_qnode* volatile next;
+    volatile uint32_t state;
+    struct mctop_lock_local* local;
+  } mctop_lock_qnode_t;
+
+  typedef struct MCTOP_ALIGNED(64) mctop_lock_local /* of a socket, on the local node */
+  {
+    mctop_lock_qnode_t* volatile tail;
+    uint32_t n_handoffs MCTOP_ALIGNED(64); /* written by the lock holder only */
+    uint32_t n_qnodes;
+    mctop_lock_qnode_t qnodes[0];
+  } mctop_lock_local_t;
+
+  typedef struct mctop_lock
+  {
+    volatile uint32_t next MCTOP_ALIGNED(64); /* global ticket lock */
+    volatile uint32_t now;
+    mctop_alloc_t* alloc MCTOP_ALIGNED(64);
+    uint n_locals;
+    uint handoff_max;
+    uint backoff;		/* cycles per ticket of distance, 0 to disable */
+    uint yield;			/* more threads than online processors: yield instead of spinning */
+    mctop_lock_local_t** locals;
+    mctop_lock_qnode_t** qnodes; /* per thread id of the allocator */
+  } mctop_lock_t;
+
+  mctop_lock_t* mctop_lock_create(mctop_alloc_t* alloc);
+  void mctop_lock_free(mctop_lock_t* lock);
+  void mctop_lock_print(mctop_lock_t* lock);
+
+  /* The calling thread must be pinned with mctop_alloc_pin on lock->alloc. */
+  void mctop_lock_acquire(mctop_lock_t* lock);
+  void mctop_lock_release(mctop_lock_t* lock);
+
+  /* ******************************************************************************** */
+  /* Reader-Writer Lock */
+  /* ******************************************************************************** */
+
+  /* Readers announce themselves on the indicator of their socket only, thus readers of
+     different sockets never share a cache line. Writers serialize on a cohort lock, raise the
+     writer flag, and wait for the indicators of the sockets of the allocator to drain.
+     Readers that find the flag raised retract and wait, i.e., writers are preferred. */
+  typedef struct MCTOP_ALIGNED(64) mctop_rwlock_indicator /* of a socket, on the local node */
+  {
+    volatile uint32_t n_readers;
+  } mctop_rwlock_indicator_t;
+
+  typedef struct mctop_rwlock
+  {
+    volatile uint32_t writer MCTOP_ALIGNED(64);
+    mctop_lock_t* wlock MCTOP_ALIGNED(64); /* among writers */
+    uint n_indicators;
+    mctop_rwlock_indicator_t** indicators; /* per socket of the allocator */
+  } mctop_rwlock_t;
+
+  mctop_rwlock_t* mctop_rwlock_create(mctop_alloc_t* alloc);
+  void mctop_rwlock_free(mctop_rwlock_t* rwl);
+
+  /* The calling thread must be pinned with mctop_alloc_pin on the allocator of the lock. */
+  void mctop_rwlock_read_acquire(mctop_rwlock_t* rwl);
+  void mctop_rwlock_read_release(mctop_rwlock_t* rwl);
+  void mctop_rwlock_write_acquire(mctop_rwlock_t* rwl);
+  void mctop_rwlock_write_release(mctop_rwlock_t* rwl);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,95 @@
+/*
+ *   File: mctop_crawl_sched.h
+ *   Description: scheduling of the hw context pairs that the latency crawl measures
+ *
+ *
+ */
+
+#ifndef __H_MCTOP_CRAWL_SCHED__
+#define __H_MCTOP_CRAWL_SCHED__
+
+#include <mctop.h>
+
+typedef struct crawl_pair
+{
+  int x;
+  int y;
+} crawl_pair_t;
+
+typedef struct crawl_batch	/* pairs that are measured concurrently */
+{
+  uint n_pairs;
+  crawl_pair_t* pairs;
+} crawl_batch_t;
+
+typedef struct crawl_sched
+{
+  uint n_hwcs;
+  uint max_pairs;		/* max pairs per batch (i.e., n_threads / 2) */
+  uint n_pairs;			/* total num. of pairs in the schedule */
+  uint n_batches;
+  crawl_batch_t* batches;
+  volatile uint next;		/* next batch to hand out */
+} crawl_sched_t;
+
+/* Creates a round-robin tournament (circle method) over the n_hwcs hw contexts and packs the
+   pairs of each round into batches of up to max_pairs pairs. Pairs of the same batch never
+   share a (NUMA) node, according to hwc_node[], thus they do not share a cache-line path. */
+crawl_sched_t* crawl_sched_create(const uint n_hwcs, const int* hwc_node, const uint max_pairs);
+/* same, but skips the pairs with done[x * n_hwcs + y] set (e.g., restored from a checkpoint) */
+crawl_sched_t* crawl_sched_create_masked(const uint n_hwcs, const int* hwc_node, const uint max_pairs,
+					 const uint8_t* done);
+/* packs the given pairs into node-disjoint batches of up to max_pairs pairs */
+crawl_sched_t* crawl_sched_create_pairs(const uint n_hwcs, const int* hwc_node, const uint max_pairs,
+					const crawl_pair_t* pairs, const uint n_pairs);
+void crawl_sched_free(crawl_sched_t* cs);
+void crawl_sched_print(crawl_sched_t* cs);
+
+/* returns NULL when there are no more batches. Not thread safe. */
+crawl_batch_t* crawl_sched_next(crawl_sched_t* cs);
+
+/* returns 1 if every (x < y) pair appears exactly once and no batch reuses a node */
+int crawl_sched_validate(crawl_sched_t* cs, const int* hwc_node);
+
+/* measures the latency of the given pairs and stores it in both lat_table[x][y] and
+   lat_table[y][x] of the n_hwcs x n_hwcs (1d) table passed to crawl_infer */
+typedef void (*crawl_measure_t)(const crawl_pair_t* pairs, const uint n_pairs, void* arg);
+
+/* Fills the latency table by measuring representative pairs only: every set of hw contexts is
+   split by the latencies to a pivot, one level of the hierarchy at a time, and the latencies
+   across the resulting groups are inferred. Cross-socket latencies are measured once per pair
+   of sockets. Pairs whose group is ambiguous (i.e., the groups are not symmetric) are
+   measured. Latencies that differ by at most offset belong to the same group. Returns the
+   num. of measured pairs. */
+size_t crawl_infer(const uint n_hwcs, const uint n_sockets, const uint offset, uint64_t* lat_table,
+		   crawl_measure_t measure, void* measure_arg);
+
+/* checkpoint of a (partial) crawl: the n_hwcs x n_hwcs latency table, the pairs that are done,
+   and optionally the n_hwcs x n_sockets mem. latency table */
+typedef struct crawl_ckpt
+{
+  uint n_hwcs;
+  uint n_sockets;
+  uint rows_done;		/* completed rows of the serial crawl */
+  uint has_mem;			/* set by crawl_ckpt_read */
+  uint64_t* lat_table;
+  uint8_t* done;
+  uint64_t** mem_lat_table;	/* NULL: no mem. latencies */
+} crawl_ckpt_t;
+
+typedef enum
+{
+  CRAWL_CKPT_OK,
+  CRAWL_CKPT_NONE,		/* no such file */
+  CRAWL_CKPT_INVALID,		/* not a checkpoint, or of a different n_hwcs / n_sockets */
+  CRAWL_CKPT_TRUNCATED,
+} crawl_ckpt_status_t;
+
+/* Writes ck to ckpt_file. The file is replaced atomically, so an interrupted write leaves the
+   previous checkpoint intact. Returns 1 on success. */
+int crawl_ckpt_write(const char* ckpt_file, const crawl_ckpt_t* ck);
+/* Reads ckpt_file into the tables of ck, for the n_hwcs and n_sockets of ck. The mem. latencies
+   are only read if ck->mem_lat_table is not NULL. */
+crawl_ckpt_status_t crawl_ckpt_read(const char* ckpt_file, crawl_ckpt_t* ck);
+
+#endif	/* __H_MCTOP_CRAWL_SCHED__ */
@@ -43,6 +43,12 @@ const uint test_mem_bw_num_reps    = 4;
 #define DEFAULT_DO_MEM             ON_TOPO_BW
 #define DEFAULT_MEM_BW_SIZE        512 /* in MB */
 #define DEFAULT_MEM_BW_MULTI       (1024 * 1024LL)
+#define DEFAULT_NUM_PARALLEL       1
+#define DEFAULT_ADAPTIVE           0
+#define ADAPTIVE_MIN_REPS          128 /* first early-stopping check */
+#define DEFAULT_INFER              0
+#define DEFAULT_CKPT_FILE          "mctop.ckpt"
+#define CKPT_INTERVAL_SECS         60 /* min. time between two checkpoints */
 
 typedef enum
   {
@@ -108,6 +108,38 @@ return m;
 
 extern int mctop_set_cpu(mctop_t* topo, int cpu);
 
+/* futex wait / wake used by the parking work queues and the topology barrier */
+#if defined(__linux__)
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+static inline void
+mctop_futex_wait(volatile uint32_t* addr, const uint32_t val)
+{
+  syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void
+mctop_futex_wake(volatile uint32_t* addr, const int n)
+{
+  syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
+#else  /* no futex: parked threads yield and poll */
+#  include <sched.h>
+static inline void
+mctop_futex_wait(volatile uint32_t* addr, const uint32_t val)
+{
+  if (*addr == val)
+    {
+      sched_yield();
+    }
+}
+
+static inline void
+mctop_futex_wake(volatile uint32_t* addr, const int n)
+{
+}
+#endif
+
 
 #ifdef __cplusplus
 }
@@ -37,6 +37,8 @@ typedef struct mctop_prof_stats
   uint64_t avg;
   double std_dev;
   double std_dev_perc;
+  uint64_t median_ci_low;	/* 95% confidence interval of the median */
+  uint64_t median_ci_high;
 } mctop_prof_stats_t;
 
 #if MCTOP_PROF_ON == 0
@@ -59,6 +61,8 @@ typedef struct mctop_prof_stats
 mctop_prof_t* mctop_prof_create(size_t num_entries);
 void mctop_prof_free(mctop_prof_t* prof);
 void mctop_prof_stats_calc(mctop_prof_t* prof, mctop_prof_stats_t* stats);
+/* stats on the first n entries only */
+void mctop_prof_stats_calc_n(mctop_prof_t* prof, const size_t n, mctop_prof_stats_t* stats);
 void mctop_prof_stats_print(mctop_prof_stats_t* stats);
 
 
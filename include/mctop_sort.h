@@ -32,6 +32,13 @@ extern "C" {
 
 #define MCTOP_SORT_DEBUG                  0
 
+  /* radix sort: buffers of the sorted data on their socket; write-combining buffers of at
+     least a cache line per bucket */
+#define MCTOP_RADIX_SORT_USE_NUMA_ALLOC   1
+#define MCTOP_RADIX_SORT_WC_MIN_BYTES     64
+  /* sample sort: # of samples per thread and socket */
+#define MCTOP_SAMPLE_SORT_OVERSAMPLING    32
+
   /* partition descriptor */
 typedef struct mctop_sort_pd
 {
@@ -78,6 +85,12 @@ typedef MCTOP_ALIGNED(64) struct mctop_sort_td
 #define unlikely(x)     __builtin_expect(!!(x), 0)
 
   void mctop_sort(MCTOP_SORT_TYPE* array, const size_t n_elems, mctop_node_tree_t* nt);
+  /* LSD radix sort (tests/merge_sort/mctop_radix_sort.cc); any # of sockets */
+  void mctop_radix_sort(MCTOP_SORT_TYPE* array, const size_t n_elems, mctop_node_tree_t* nt);
+  void mctop_radix_sort_u64(uint64_t* array, const size_t n_elems, mctop_node_tree_t* nt);
+  /* splitters and one all-to-all exchange instead of cross-socket merges
+     (tests/merge_sort/mctop_sample_sort.cc); any # of sockets */
+  void mctop_sample_sort(MCTOP_SORT_TYPE* array, const size_t n_elems, mctop_node_tree_t* nt);
 
 
 #ifdef __cplusplus
@@ -0,0 +1,299 @@
+#ifndef __H_MCTOP_SORT_HPP__
+#define __H_MCTOP_SORT_HPP__
+
+/* mct::sort -- the mctop_sort algorithm (tests/merge_sort/mctop_sort.cc) for any element type:
+   1. the array is partitioned across the nodes of the allocator and every thread copies and
+   sorts its chunk in a buffer of its node,
+   2. the chunks of a node are merged in-socket by all threads of the node,
+   3. the nodes are merged following the node tree. With a CORE (or EVERYONE_CORE) tree, only
+   one hw context per core merges across sockets.
+
+   mct::sort(array, n, nt [, less])            : sorts an array of keys
+   mct::sort(kv_array, n, nt [, less_keys])   : sorts an array of mct::kv<Key, Value> (in
+                                                merge_simd_utils.hpp) on the keys
+
+   The merge and chunk-sort kernels are chosen at runtime (merge_simd_utils.hpp). */
+
+#include <mctop_alloc.h>
+#include <mctop_sort.h>
+#include <merge_simd_utils.hpp>
+#include <algorithm>
+#include <functional>
+
+namespace mct
+{
+  /* node data descriptor */
+  template <typename T>
+  struct MCTOP_ALIGNED(64) sort_nd
+  {
+    T* array;
+    size_t n_elems;
+    T* source;
+    T* destination;
+    size_t capacity;		/* # of elements of source / destination */
+    mctop_sort_pd_t* partitions;
+  };
+
+  /* total data descriptor */
+  template <typename T, typename Less>
+  struct sort_td
+  {
+    mctop_node_tree_t* nt;
+    T* array;
+    size_t n_elems;
+    Less less;
+    sort_nd<T>* node_data;
+  };
+
+  template <typename T, typename Less>
+  class sorter
+  {
+  public:
+    static void
+    run(T* array, const size_t n_elems, mctop_node_tree_t* nt, Less less)
+    {
+      mctop_alloc_t* alloc = nt->alloc;
+      const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+      const uint n_sockets = mctop_alloc_get_num_sockets(alloc);
+      if (unlikely(n_elems <= (MCTOP_SORT_MIN_LEN_PARALLEL * sizeof(MCTOP_SORT_TYPE) / sizeof(T))) ||
+	  n_hwcs == 1)
+	{
+	  std::sort(array, array + n_elems, less);
+	  return;
+	}
+
+      sort_td<T, Less> td = { nt, array, n_elems, less, NULL };
+      td.node_data = (sort_nd<T>*) malloc(n_sockets * sizeof(sort_nd<T>));
+      assert(td.node_data != NULL);
+      const size_t n_elems_nd = n_elems / n_sockets;
+      for (uint i = 0; i < n_sockets; i++)
+	{
+	  td.node_data[i].array = array + (i * n_elems_nd);
+	  td.node_data[i].n_elems = n_elems_nd;
+	}
+      td.node_data[n_sockets - 1].n_elems += (n_elems % n_sockets);
+
+      pthread_t threads[n_hwcs];
+      for (uint t = 0; t < n_hwcs; t++)
+	{
+	  if (pthread_create(&threads[t], NULL, sorter::thread, &td))
+	    {
+	      printf("mctop_sort ERROR: pthread_create()\n");
+	      exit(-1);
+	    }
+	}
+      for (uint t = 0; t < n_hwcs; t++)
+	{
+	  if (pthread_join(threads[t], NULL))
+	    {
+	      printf("mctop_sort ERROR: pthread_join()\n");
+	      exit(-1);
+	    }
+	}
+
+      free(td.node_data);
+    }
+
+  private:
+    static T*
+    buffer_alloc(mctop_alloc_t* alloc, const uint node, const size_t size)
+    {
+#if __sparc__ || MCTOP_SORT_USE_NUMA_ALLOC == 0
+      T* mem = (T*) malloc(size);
+#else
+      T* mem = (T*) mctop_alloc_malloc_on_nth_socket(alloc, node, size);
+#endif
+      assert(mem != NULL);
+      return mem;
+    }
+
+    static void
+    buffer_free(T* mem, const size_t size)
+    {
+#if __sparc__ || MCTOP_SORT_USE_NUMA_ALLOC == 0
+      free(mem);
+#else
+      mctop_alloc_malloc_free(mem, size);
+#endif
+    }
+
+    /* a node that never receives data only needs room for its own part */
+    static size_t
+    node_capacity(sort_td<T, Less>* td, sort_nd<T>* nd)
+    {
+      mctop_node_tree_t* nt = td->nt;
+      for (uint l = 0; l < mctop_node_tree_get_num_levels(nt); l++)
+	{
+	  mctop_node_tree_work_t ntw;
+	  if (mctop_node_tree_get_work_description(nt, l, &ntw) && ntw.node_role == DESTINATION)
+	    {
+	      return td->n_elems;
+	    }
+	}
+      return nd->n_elems;
+    }
+
+    static void*
+    thread(void* params)
+    {
+      sort_td<T, Less>* td = (sort_td<T, Less>*) params;
+      mctop_node_tree_t* nt = td->nt;
+      mctop_alloc_t* alloc = nt->alloc;
+      mctop_alloc_pin(alloc);
+
+      const uint my_node = mctop_alloc_thread_node_id();
+      sort_nd<T>* nd = &td->node_data[my_node];
+      const uint n_hwcs_node = mctop_alloc_get_num_hw_contexts_node(alloc, my_node);
+      const uint my_id = mctop_alloc_thread_insocket_id();
+
+      if (mctop_alloc_thread_is_node_leader())
+	{
+	  nd->capacity = node_capacity(td, nd);
+	  nd->source = buffer_alloc(alloc, my_node, 2 * nd->capacity * sizeof(T));
+	  nd->destination = nd->source + nd->capacity;
+	  nd->partitions = (mctop_sort_pd_t*) malloc(n_hwcs_node * sizeof(mctop_sort_pd_t));
+	  assert(nd->partitions != NULL);
+	}
+      mctop_alloc_barrier_wait_node(alloc);
+
+      T* buffer = nd->source;
+      const size_t my_n_elems_even = nd->n_elems / n_hwcs_node;
+      const size_t my_offset = my_id * my_n_elems_even;
+      const size_t my_n_elems = mctop_alloc_thread_is_node_last() ?
+	(nd->n_elems - my_offset) : my_n_elems_even;
+
+      /* sequential sorting of chunks */
+      nd->partitions[my_id].start_index = my_offset;
+      nd->partitions[my_id].n_elems = my_n_elems;
+      memcpy(buffer + my_offset, nd->array + my_offset, my_n_elems * sizeof(T));
+      sort_kernel<T, Less>::sort(buffer + my_offset, nd->destination + my_offset, my_n_elems, td->less);
+
+      T* sorted = merge_in_socket(td, nd, my_id, n_hwcs_node);
+
+      if (nt->n_nodes > 1)
+	{
+	  merge_cross_socket(td, my_node);
+	}
+      else
+	{
+	  memcpy(td->array + my_offset, sorted + my_offset, my_n_elems * sizeof(T));
+	}
+
+      mctop_alloc_barrier_wait_all(alloc);
+      if (mctop_alloc_thread_is_node_leader())
+	{
+	  free(nd->partitions);
+	  buffer_free(buffer, 2 * nd->capacity * sizeof(T));
+	}
+      mctop_alloc_unpin();
+      return NULL;
+    }
+
+    /* all threads of the node merge every pair of partitions together; returns the merged array */
+    static T*
+    merge_in_socket(sort_td<T, Less>* td, sort_nd<T>* nd, const uint my_id, const uint n_threads)
+    {
+      mctop_alloc_t* alloc = td->nt->alloc;
+      T* src = nd->source;
+      T* dest = nd->destination;
+      mctop_sort_pd_t* parts = nd->partitions;
+      uint n_partitions = n_threads;
+
+      while (n_partitions > 1)
+	{
+	  mctop_alloc_barrier_wait_node(alloc);
+	  for (uint p = 0; p + 1 < n_partitions; p += 2)
+	    {
+	      merge_parallel(src + parts[p].start_index, src + parts[p + 1].start_index,
+			     dest + parts[p].start_index, parts[p].n_elems, parts[p + 1].n_elems,
+			     my_id, n_threads, td->less);
+	    }
+	  if ((n_partitions & 1) && mctop_alloc_thread_is_node_leader())
+	    {
+	      mctop_sort_pd_t* last = &parts[n_partitions - 1];
+	      memcpy(dest + last->start_index, src + last->start_index, last->n_elems * sizeof(T));
+	    }
+	  mctop_alloc_barrier_wait_node(alloc);
+
+	  if (mctop_alloc_thread_is_node_leader())
+	    {
+	      for (uint p = 0; p < n_partitions; p += 2)
+		{
+		  parts[p >> 1].start_index = parts[p].start_index;
+		  parts[p >> 1].n_elems = parts[p].n_elems;
+		  if (p + 1 < n_partitions)
+		    {
+		      parts[p >> 1].n_elems += parts[p + 1].n_elems;
+		    }
+		}
+	    }
+	  n_partitions = (n_partitions + 1) >> 1;
+
+	  T* tmp = src;
+	  src = dest;
+	  dest = tmp;
+	}
+
+      if (mctop_alloc_thread_is_node_leader())
+	{
+	  nd->source = src;
+	  nd->destination = dest;
+	}
+      return src;
+    }
+
+    static void
+    merge_cross_socket(sort_td<T, Less>* td, const uint my_node)
+    {
+      mctop_node_tree_t* nt = td->nt;
+      const uint cores_only = (nt->barrier_for == CORE || nt->barrier_for == EVERYONE_CORE);
+      if (cores_only && mctop_alloc_thread_incore_id() != 0)
+	{
+	  return;
+	}
+      const uint my_id = cores_only ? mctop_alloc_thread_core_insocket_id() : mctop_alloc_thread_insocket_id();
+
+      for (int l = mctop_node_tree_get_num_levels(nt) - 1; l >= 0; l--)
+	{
+	  mctop_node_tree_work_t ntw;
+	  if (!mctop_node_tree_get_work_description(nt, l, &ntw))
+	    {
+	      continue;		/* a bye at this level: my data is merged further up */
+	    }
+	  mctop_node_tree_barrier_wait(nt, l);
+
+	  sort_nd<T>* nd_a = &td->node_data[ntw.destination];
+	  sort_nd<T>* nd_b = &td->node_data[ntw.source];
+	  T* dest = (l == 0) ? td->array : nd_a->destination;
+	  merge_parallel(nd_a->source, nd_b->source, dest, nd_a->n_elems, nd_b->n_elems,
+			 my_id + ntw.id_offset, ntw.num_hw_contexts, td->less);
+
+	  mctop_node_tree_barrier_wait(nt, l);
+	  if (ntw.node_role == DESTINATION && mctop_alloc_thread_is_node_leader())
+	    {
+	      nd_a->n_elems += nd_b->n_elems;
+	      T* tmp = nd_a->source;
+	      nd_a->source = nd_a->destination;
+	      nd_a->destination = tmp;
+	    }
+	}
+    }
+  };
+
+  template <typename Key, typename Compare = std::less<Key> >
+  void
+  sort(Key* array, const size_t n_elems, mctop_node_tree_t* nt, Compare cmp = Compare())
+  {
+    sorter<Key, Compare>::run(array, n_elems, nt, cmp);
+  }
+
+  template <typename Key, typename Value, typename Compare = std::less<Key> >
+  void
+  sort(kv<Key, Value>* array, const size_t n_elems, mctop_node_tree_t* nt, Compare cmp = Compare())
+  {
+    sorter<kv<Key, Value>, kv_less<Key, Value, Compare> >::run(array, n_elems, nt,
+							       kv_less<Key, Value, Compare>(cmp));
+  }
+}
+
+#endif	/* __H_MCTOP_SORT_HPP__ */
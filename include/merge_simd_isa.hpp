@@ -0,0 +1,452 @@
+/* Merge and small-sort kernels for one vector ISA. Included by merge_simd_utils.hpp once per ISA,
+   inside a "#pragma GCC target" region and a namespace that defines ops<T>:
+     vec, n_lanes            : the vector type and the # of T in a vector
+     load, store             : unaligned
+     min, max                : lane-wise
+     permute(x, p)           : lane (of 32 bits) i of the result is lane p[i] of x
+     select(a, b, m)         : lane (of 32 bits) i of the result is m[i] ? b[i] : a[i]
+     lt(a, b)                : lane-wise a < b, as a mask for select
+   No include guard on purpose. */
+
+/* the compare-exchange steps of the networks, as permutations / selections on 32-bit lanes */
+template <typename T>
+struct net_tables
+{
+  typedef ops<T> V;
+  typedef typename V::vec vec;
+  enum { W = V::n_lanes, U = sizeof(vec) / sizeof(int32_t), R = U / W, MAX_STEPS = 16 };
+
+  uint n_sort_steps;
+  vec sort_perm[MAX_STEPS], sort_sel[MAX_STEPS];
+  uint n_merge_steps;
+  vec merge_perm[MAX_STEPS], merge_sel[MAX_STEPS];
+  vec reverse;
+
+  /* lane i is compared with lane i ^ j and keeps the max if take_max(i) */
+  void
+  step(vec* perm, vec* sel, const uint j, const uint k, const uint merge)
+  {
+    int32_t p[U], s[U];
+    for (uint i = 0; i < W; i++)
+      {
+	const uint take_max = merge ? ((i & j) != 0) : (((i & j) != 0) ^ ((i & k) != 0));
+	for (uint r = 0; r < R; r++)
+	  {
+	    p[i * R + r] = (i ^ j) * R + r;
+	    s[i * R + r] = take_max ? -1 : 0;
+	  }
+      }
+    *perm = V::load((const T*) p);
+    *sel = V::load((const T*) s);
+  }
+
+  net_tables()
+  {
+    /* bitonic sort of one vector */
+    n_sort_steps = 0;
+    for (uint k = 2; k <= W; k <<= 1)
+      {
+	for (uint j = k >> 1; j > 0; j >>= 1)
+	  {
+	    step(&sort_perm[n_sort_steps], &sort_sel[n_sort_steps], j, k, 0);
+	    n_sort_steps++;
+	  }
+      }
+    /* half-cleaners of a bitonic sequence of one vector */
+    n_merge_steps = 0;
+    for (uint j = W >> 1; j > 0; j >>= 1)
+      {
+	step(&merge_perm[n_merge_steps], &merge_sel[n_merge_steps], j, 0, 1);
+	n_merge_steps++;
+      }
+
+    int32_t p[U];
+    for (uint i = 0; i < W; i++)
+      {
+	for (uint r = 0; r < R; r++)
+	  {
+	    p[i * R + r] = (W - 1 - i) * R + r;
+	  }
+      }
+    reverse = V::load((const T*) p);
+  }
+
+  static const net_tables&
+  get()
+  {
+    static const net_tables tables;
+    return tables;
+  }
+};
+
+template <typename T>
+static inline typename ops<T>::vec
+cmpxchg(const typename ops<T>::vec x, const typename ops<T>::vec perm, const typename ops<T>::vec sel)
+{
+  typedef ops<T> V;
+  const typename V::vec y = V::permute(x, perm);
+  return V::select(V::min(x, y), V::max(x, y), sel);
+}
+
+template <typename T>
+static inline typename ops<T>::vec
+sort_vec(typename ops<T>::vec x, const net_tables<T>& nt)
+{
+  for (uint s = 0; s < nt.n_sort_steps; s++)
+    {
+      x = cmpxchg<T>(x, nt.sort_perm[s], nt.sort_sel[s]);
+    }
+  return x;
+}
+
+/* merges two sorted vectors a and b into the sorted lo, hi */
+template <typename T>
+static inline void
+bitonic_merge(typename ops<T>::vec a, typename ops<T>::vec b,
+	      typename ops<T>::vec* lo, typename ops<T>::vec* hi, const net_tables<T>& nt)
+{
+  typedef ops<T> V;
+  b = V::permute(b, nt.reverse);
+  typename V::vec l = V::min(a, b), h = V::max(a, b);
+  for (uint s = 0; s < nt.n_merge_steps; s++)
+    {
+      l = cmpxchg<T>(l, nt.merge_perm[s], nt.merge_sel[s]);
+      h = cmpxchg<T>(h, nt.merge_perm[s], nt.merge_sel[s]);
+    }
+  *lo = l;
+  *hi = h;
+}
+
+/* same structure as the SSE merge_simd */
+template <typename T>
+static inline void
+merge(const T* a, const T* b, T* dest, size_t n_a, size_t n_b)
+{
+  typedef ops<T> V;
+  typedef typename V::vec vec;
+  const size_t w = V::n_lanes;
+  if (n_a < w || n_b < w)
+    {
+      merge_scalar(a, b, dest, n_a, n_b, std::less<T>());
+      return;
+    }
+
+  const net_tables<T>& nt = net_tables<T>::get();
+  size_t i, j, k = 0;
+  vec next;
+  if (b[0] < a[0])
+    {
+      next = V::load(b);
+      i = 0;
+      j = w;
+    }
+  else
+    {
+      next = V::load(a);
+      i = w;
+      j = 0;
+    }
+
+  while (i + w <= n_a && j + w <= n_b)
+    {
+      const T* in;
+      if (b[j] < a[i])
+	{
+	  in = b + j;
+	  j += w;
+	}
+      else
+	{
+	  in = a + i;
+	  i += w;
+	}
+      vec lo;
+      bitonic_merge<T>(next, V::load(in), &lo, &next, nt);
+      V::store(dest + k, lo);
+      k += w;
+    }
+
+  T carry[w];
+  V::store(carry, next);
+  merge_carry(carry, w, a, b, dest + k, i, j, n_a, n_b, std::less<T>());
+}
+
+/* bottom-up merge passes of runs of size run, ping-ponging between data and tmp. Returns the
+   array that holds the result. */
+template <typename T, void (*merge_fn)(const T*, const T*, T*, size_t, size_t)>
+static inline T*
+merge_passes(T* data, T* tmp, const size_t n, size_t run)
+{
+  T* src = data;
+  T* dst = tmp;
+  for (; run < n; run <<= 1)
+    {
+      for (size_t s = 0; s < n; s += (run << 1))
+	{
+	  const size_t n_a = (s + run < n) ? run : (n - s);
+	  const size_t n_b = (s + run < n) ? (((s + (run << 1)) <= n) ? run : (n - s - run)) : 0;
+	  merge_fn(src + s, src + s + n_a, dst + s, n_a, n_b);
+	}
+      T* t = src;
+      src = dst;
+      dst = t;
+    }
+  return src;
+}
+
+/* merge passes from sorted runs of size run: first within blocks that fit in the L2, then across
+   the blocks */
+template <typename T, void (*merge_fn)(const T*, const T*, T*, size_t, size_t)>
+static inline void
+merge_blocks(T* data, T* tmp, const size_t n, const size_t run)
+{
+  const size_t block = MCTOP_SORT_SIMD_BLOCK_BYTES / sizeof(T);
+  for (size_t s = 0; s < n; s += block)
+    {
+      const size_t n_block = (s + block <= n) ? block : (n - s);
+      T* res = merge_passes<T, merge_fn>(data + s, tmp + s, n_block, run);
+      if (res != data + s)
+	{
+	  memcpy(data + s, res, n_block * sizeof(T));
+	}
+    }
+
+  T* res = merge_passes<T, merge_fn>(data, tmp, n, block);
+  if (res != data)
+    {
+      memcpy(data, res, n * sizeof(T));
+    }
+}
+
+/* in-register sort of blocks of two vectors, then merge passes: first within blocks that fit in
+   the L2, then across the blocks. tmp must have room for n elements. */
+template <typename T>
+static inline void
+sort(T* data, T* tmp, const size_t n)
+{
+  typedef ops<T> V;
+  typedef typename V::vec vec;
+  const size_t w = V::n_lanes;
+  if (n < 4 * w)
+    {
+      std::sort(data, data + n);
+      return;
+    }
+
+  const net_tables<T>& nt = net_tables<T>::get();
+  const size_t n_full = n - (n % (2 * w));
+  for (size_t s = 0; s < n_full; s += 2 * w)
+    {
+      vec lo, hi;
+      bitonic_merge<T>(sort_vec<T>(V::load(data + s), nt), sort_vec<T>(V::load(data + s + w), nt),
+		       &lo, &hi, nt);
+      V::store(data + s, lo);
+      V::store(data + s + w, hi);
+    }
+  std::sort(data + n_full, data + n);
+  merge_blocks<T, merge<T> >(data, tmp, n, 2 * w);
+}
+
+/* Pairs kv<K, Val> with sizeof(Val) == sizeof(K): the networks run on a vector of W keys, and a
+   vector of W values follows every permutation / selection of the keys. Two vectors of pairs are
+   split into one of keys and one of values (and back) with the tables below. */
+template <typename K>
+struct kv_tables
+{
+  typedef ops<K> V;
+  typedef typename V::vec vec;
+  enum { W = V::n_lanes, U = sizeof(vec) / sizeof(int32_t), R = U / W };
+
+  vec split_key, split_val, split_hi;	/* pair i is in the second vector if i >= W / 2 */
+  vec join_idx[2], join_val;		/* unit u of the vector h of pairs */
+
+  kv_tables()
+  {
+    int32_t k[U], v[U], h[U], j[2][U], jv[U];
+    for (uint i = 0; i < W; i++)
+      {
+	for (uint r = 0; r < R; r++)
+	  {
+	    k[i * R + r] = (2 * i * R + r) % U;
+	    v[i * R + r] = (2 * i * R + R + r) % U;
+	    h[i * R + r] = (i >= W / 2) ? -1 : 0;
+	  }
+      }
+    for (uint u = 0; u < U; u++)
+      {
+	const uint off = u % (2 * R);
+	for (uint hv = 0; hv < 2; hv++)
+	  {
+	    j[hv][u] = (hv * (W / 2) + u / (2 * R)) * R + (off % R);
+	  }
+	jv[u] = (off >= R) ? -1 : 0;
+      }
+    split_key = V::load((const K*) k);
+    split_val = V::load((const K*) v);
+    split_hi = V::load((const K*) h);
+    join_idx[0] = V::load((const K*) j[0]);
+    join_idx[1] = V::load((const K*) j[1]);
+    join_val = V::load((const K*) jv);
+  }
+
+  static const kv_tables&
+  get()
+  {
+    static const kv_tables tables;
+    return tables;
+  }
+};
+
+template <typename K, typename Val>
+static inline void
+kv_load(const kv<K, Val>* p, typename ops<K>::vec* keys, typename ops<K>::vec* vals, const kv_tables<K>& kt)
+{
+  typedef ops<K> V;
+  const typename V::vec x0 = V::load((const K*) p), x1 = V::load((const K*) p + V::n_lanes);
+  *keys = V::select(V::permute(x0, kt.split_key), V::permute(x1, kt.split_key), kt.split_hi);
+  *vals = V::select(V::permute(x0, kt.split_val), V::permute(x1, kt.split_val), kt.split_hi);
+}
+
+template <typename K, typename Val>
+static inline void
+kv_store(kv<K, Val>* p, const typename ops<K>::vec keys, const typename ops<K>::vec vals, const kv_tables<K>& kt)
+{
+  typedef ops<K> V;
+  V::store((K*) p, V::select(V::permute(keys, kt.join_idx[0]), V::permute(vals, kt.join_idx[0]), kt.join_val));
+  V::store((K*) p + V::n_lanes,
+	   V::select(V::permute(keys, kt.join_idx[1]), V::permute(vals, kt.join_idx[1]), kt.join_val));
+}
+
+/* on equal keys both lanes keep their own pair */
+template <typename K>
+static inline void
+cmpxchg_kv(typename ops<K>::vec* keys, typename ops<K>::vec* vals,
+	   const typename ops<K>::vec perm, const typename ops<K>::vec sel)
+{
+  typedef ops<K> V;
+  const typename V::vec yk = V::permute(*keys, perm), yv = V::permute(*vals, perm);
+  const typename V::vec take = V::select(V::lt(yk, *keys), V::lt(*keys, yk), sel);
+  *keys = V::select(*keys, yk, take);
+  *vals = V::select(*vals, yv, take);
+}
+
+template <typename K>
+static inline void
+sort_vec_kv(typename ops<K>::vec* keys, typename ops<K>::vec* vals, const net_tables<K>& nt)
+{
+  for (uint s = 0; s < nt.n_sort_steps; s++)
+    {
+      cmpxchg_kv<K>(keys, vals, nt.sort_perm[s], nt.sort_sel[s]);
+    }
+}
+
+/* merges the sorted (ak, av) and (bk, bv) into (ak, av) (low half) and (bk, bv) */
+template <typename K>
+static inline void
+bitonic_merge_kv(typename ops<K>::vec* ak, typename ops<K>::vec* av,
+		 typename ops<K>::vec* bk, typename ops<K>::vec* bv, const net_tables<K>& nt)
+{
+  typedef ops<K> V;
+  typedef typename V::vec vec;
+  const vec rk = V::permute(*bk, nt.reverse), rv = V::permute(*bv, nt.reverse);
+  const vec m = V::lt(rk, *ak);
+  vec lk = V::select(*ak, rk, m), lv = V::select(*av, rv, m);
+  vec hk = V::select(rk, *ak, m), hv = V::select(rv, *av, m);
+  for (uint s = 0; s < nt.n_merge_steps; s++)
+    {
+      cmpxchg_kv<K>(&lk, &lv, nt.merge_perm[s], nt.merge_sel[s]);
+      cmpxchg_kv<K>(&hk, &hv, nt.merge_perm[s], nt.merge_sel[s]);
+    }
+  *ak = lk;
+  *av = lv;
+  *bk = hk;
+  *bv = hv;
+}
+
+template <typename K, typename Val>
+static inline void
+merge_kv(const kv<K, Val>* a, const kv<K, Val>* b, kv<K, Val>* dest, size_t n_a, size_t n_b)
+{
+  typedef ops<K> V;
+  typedef typename V::vec vec;
+  const kv_less<K, Val, std::less<K> > less((std::less<K>()));
+  const size_t w = V::n_lanes;
+  if (n_a < w || n_b < w)
+    {
+      merge_scalar(a, b, dest, n_a, n_b, less);
+      return;
+    }
+
+  const net_tables<K>& nt = net_tables<K>::get();
+  const kv_tables<K>& kt = kv_tables<K>::get();
+  size_t i, j, k = 0;
+  vec nk, nv;
+  if (b[0].key < a[0].key)
+    {
+      kv_load(b, &nk, &nv, kt);
+      i = 0;
+      j = w;
+    }
+  else
+    {
+      kv_load(a, &nk, &nv, kt);
+      i = w;
+      j = 0;
+    }
+
+  while (i + w <= n_a && j + w <= n_b)
+    {
+      const kv<K, Val>* in;
+      if (b[j].key < a[i].key)
+	{
+	  in = b + j;
+	  j += w;
+	}
+      else
+	{
+	  in = a + i;
+	  i += w;
+	}
+      vec lk, lv;
+      kv_load(in, &lk, &lv, kt);
+      bitonic_merge_kv<K>(&lk, &lv, &nk, &nv, nt);
+      kv_store(dest + k, lk, lv, kt);
+      k += w;
+    }
+
+  kv<K, Val> carry[w];
+  kv_store(carry, nk, nv, kt);
+  merge_carry(carry, w, a, b, dest + k, i, j, n_a, n_b, less);
+}
+
+template <typename K, typename Val>
+static inline void
+sort_kv(kv<K, Val>* data, kv<K, Val>* tmp, const size_t n)
+{
+  typedef ops<K> V;
+  typedef typename V::vec vec;
+  const kv_less<K, Val, std::less<K> > less((std::less<K>()));
+  const size_t w = V::n_lanes;
+  if (n < 4 * w)
+    {
+      std::sort(data, data + n, less);
+      return;
+    }
+
+  const net_tables<K>& nt = net_tables<K>::get();
+  const kv_tables<K>& kt = kv_tables<K>::get();
+  const size_t n_full = n - (n % (2 * w));
+  for (size_t s = 0; s < n_full; s += 2 * w)
+    {
+      vec ak, av, bk, bv;
+      kv_load(data + s, &ak, &av, kt);
+      kv_load(data + s + w, &bk, &bv, kt);
+      sort_vec_kv<K>(&ak, &av, nt);
+      sort_vec_kv<K>(&bk, &bv, nt);
+      bitonic_merge_kv<K>(&ak, &av, &bk, &bv, nt);
+      kv_store(data + s, ak, av, kt);
+      kv_store(data + s + w, bk, bv, kt);
+    }
+  std::sort(data + n_full, data + n, less);
+  merge_blocks<kv<K, Val>, merge_kv<K, Val> >(data, tmp, n, 2 * w);
+}
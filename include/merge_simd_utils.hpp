@@ -0,0 +1,853 @@
+#ifndef __H_MERGE_SIMD_UTILS__
+#define __H_MERGE_SIMD_UTILS__
+
+/* Sequential merge and sort kernels for mct::sort (mctop_sort.hpp). For keys sorted with
+   std::less the kernel is picked at runtime (CPUID), among:
+     AVX-512 : 16 (32-bit keys) or 8 (64-bit keys) lanes bitonic networks, merge and small sort
+     AVX2    : 8 or 4 lanes bitonic networks, merge (32-bit keys only) and small sort
+     SSE     : 4 or 2 lanes bitonic merge network (64-bit integers need SSE4.2 at compile time)
+   Pairs kv<Key, Value> sorted on std::less keys use the AVX-512 (and AVX2, for 32-bit keys)
+   networks on the keys, and move the values with the same permutations, if Value has the size of
+   Key (e.g., uint64_t keys with pointers).
+   Everything else uses a branchless scalar merge and std::sort. The AVX kernels are compiled
+   with target pragmas, thus the library does not need to be built with -mavx2 / -mavx512f.
+   MCTOP_SIMD=scalar|sse|avx2|avx512 in the environment caps the ISA that is used. */
+
+#define MCTOP_SORT_SIMD_BLOCK_BYTES (256 * 1024LL) /* the small sort merges in blocks of this size first */
+
+#include <stdint.h>
+#include <string.h>
+#include <functional>
+#include <type_traits>
+#include <algorithm>
+#include <stdlib.h>
+#if defined(__x86_64__)
+#  include <immintrin.h>
+#endif
+
+namespace mct
+{
+  template <typename Key, typename Value>
+  struct kv
+  {
+    Key key;
+    Value value;
+  };
+
+  template <typename Key, typename Value, typename Compare>
+  struct kv_less
+  {
+    Compare cmp;
+    kv_less(Compare c) : cmp(c) { }
+    inline bool operator()(const kv<Key, Value>& a, const kv<Key, Value>& b) const
+    {
+      return cmp(a.key, b.key);
+    }
+  };
+
+  /* stable: on ties, the element of a goes first */
+  template <typename T, typename Less>
+  static inline void
+  merge_scalar(const T* a, const T* b, T* dest, size_t n_a, size_t n_b, Less less)
+  {
+    size_t i = 0, j = 0, k = 0;
+    while (i < n_a && j < n_b)
+      {
+	const bool take_b = less(b[j], a[i]);
+	dest[k++] = take_b ? b[j] : a[i];
+	j += take_b;
+	i += !take_b;
+      }
+    memcpy(dest + k, a + i, (n_a - i) * sizeof(T));
+    memcpy(dest + k + (n_a - i), b + j, (n_b - j) * sizeof(T));
+  }
+
+  /* the vector merges carry the largest w merged elements in a register: merges them with the
+     remaining a[i..n_a) and b[j..n_b) */
+  template <typename T, typename Less>
+  static inline void
+  merge_carry(const T* carry, const size_t w, const T* a, const T* b, T* dest,
+	      size_t i, size_t j, const size_t n_a, const size_t n_b, Less less)
+  {
+    size_t c = 0, k = 0;
+    while (c < w)
+      {
+	uint from = 0;		/* 0: carry, 1: a, 2: b */
+	T min = carry[c];
+	if (i < n_a && less(a[i], min))
+	  {
+	    min = a[i];
+	    from = 1;
+	  }
+	if (j < n_b && less(b[j], min))
+	  {
+	    min = b[j];
+	    from = 2;
+	  }
+
+	dest[k++] = min;
+	i += (from == 1);
+	j += (from == 2);
+	c += (from == 0);
+      }
+    merge_scalar(a + i, b + j, dest + k, n_a - i, n_b - j, less);
+  }
+
+  typedef enum
+    {
+      SIMD_SCALAR,
+      SIMD_SSE,
+      SIMD_AVX2,
+      SIMD_AVX512,
+    } simd_isa_t;
+
+  static inline const char*
+  simd_isa_name(const simd_isa_t isa)
+  {
+    static const char* names[] = { "scalar", "sse", "avx2", "avx512" };
+    return names[isa];
+  }
+
+  static inline simd_isa_t
+  simd_isa_detect()
+  {
+    simd_isa_t isa = SIMD_SCALAR;
+#if defined(__x86_64__)
+    isa = SIMD_SSE;
+    if (__builtin_cpu_supports("avx2"))
+      {
+	isa = SIMD_AVX2;
+      }
+    if (__builtin_cpu_supports("avx512f"))
+      {
+	isa = SIMD_AVX512;
+      }
+#endif
+    const char* env = getenv("MCTOP_SIMD");
+    if (env != NULL)
+      {
+	for (int i = SIMD_SCALAR; i < isa; i++)
+	  {
+	    if (!strcmp(env, simd_isa_name((simd_isa_t) i)))
+	      {
+		isa = (simd_isa_t) i;
+	      }
+	  }
+      }
+    return isa;
+  }
+
+  /* the best ISA of this processor */
+  static inline simd_isa_t
+  simd_isa()
+  {
+    static const simd_isa_t isa = simd_isa_detect();
+    return isa;
+  }
+
+  template <typename T>
+  struct simd_traits
+  {
+    static const bool enabled = false;
+  };
+
+#if defined(__x86_64__)
+  /* min / max of the lanes of two vectors; the data are always kept in __m128i */
+  template <> struct simd_traits<int32_t>
+  {
+    static const bool enabled = true;
+    static const uint n_lanes = 4;
+    static inline __m128i min(__m128i a, __m128i b)
+    {
+      const __m128i gt = _mm_cmpgt_epi32(a, b);
+      return _mm_or_si128(_mm_and_si128(gt, b), _mm_andnot_si128(gt, a));
+    }
+    static inline __m128i max(__m128i a, __m128i b)
+    {
+      const __m128i gt = _mm_cmpgt_epi32(a, b);
+      return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+    }
+  };
+
+  template <> struct simd_traits<uint32_t>
+  {
+    static const bool enabled = true;
+    static const uint n_lanes = 4;
+    static inline __m128i gt(__m128i a, __m128i b)
+    {
+      const __m128i bias = _mm_set1_epi32(0x80000000);
+      return _mm_cmpgt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+    }
+    static inline __m128i min(__m128i a, __m128i b)
+    {
+      const __m128i g = gt(a, b);
+      return _mm_or_si128(_mm_and_si128(g, b), _mm_andnot_si128(g, a));
+    }
+    static inline __m128i max(__m128i a, __m128i b)
+    {
+      const __m128i g = gt(a, b);
+      return _mm_or_si128(_mm_and_si128(g, a), _mm_andnot_si128(g, b));
+    }
+  };
+
+  template <> struct simd_traits<float>
+  {
+    static const bool enabled = true;
+    static const uint n_lanes = 4;
+    static inline __m128i min(__m128i a, __m128i b)
+    {
+      return _mm_castps_si128(_mm_min_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    }
+    static inline __m128i max(__m128i a, __m128i b)
+    {
+      return _mm_castps_si128(_mm_max_ps(_mm_castsi128_ps(a), _mm_castsi128_ps(b)));
+    }
+  };
+
+  template <> struct simd_traits<double>
+  {
+    static const bool enabled = true;
+    static const uint n_lanes = 2;
+    static inline __m128i min(__m128i a, __m128i b)
+    {
+      return _mm_castpd_si128(_mm_min_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b)));
+    }
+    static inline __m128i max(__m128i a, __m128i b)
+    {
+      return _mm_castpd_si128(_mm_max_pd(_mm_castsi128_pd(a), _mm_castsi128_pd(b)));
+    }
+  };
+
+  /* 64-bit integer compares need SSE4.2 (e.g., -msse4.2 or -march=native) */
+#  if defined(__SSE4_2__)
+  template <> struct simd_traits<int64_t>
+  {
+    static const bool enabled = true;
+    static const uint n_lanes = 2;
+    static inline __m128i min(__m128i a, __m128i b)
+    {
+      return _mm_blendv_epi8(a, b, _mm_cmpgt_epi64(a, b));
+    }
+    static inline __m128i max(__m128i a, __m128i b)
+    {
+      return _mm_blendv_epi8(b, a, _mm_cmpgt_epi64(a, b));
+    }
+  };
+
+  template <> struct simd_traits<uint64_t>
+  {
+    static const bool enabled = true;
+    static const uint n_lanes = 2;
+    static inline __m128i gt(__m128i a, __m128i b)
+    {
+      const __m128i bias = _mm_set1_epi64x(0x8000000000000000LL);
+      return _mm_cmpgt_epi64(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+    }
+    static inline __m128i min(__m128i a, __m128i b)
+    {
+      return _mm_blendv_epi8(a, b, gt(a, b));
+    }
+    static inline __m128i max(__m128i a, __m128i b)
+    {
+      return _mm_blendv_epi8(b, a, gt(a, b));
+    }
+  };
+#  endif	/* __SSE4_2__ */
+
+  /* merges two sorted vectors a and b into the sorted lo, hi */
+  template <typename T>
+  static inline void
+  simd_bitonic_merge(__m128i a, __m128i b, __m128i* lo, __m128i* hi)
+  {
+    typedef simd_traits<T> V;
+    if (V::n_lanes == 4)
+      {
+	b = _mm_shuffle_epi32(b, _MM_SHUFFLE(0, 1, 2, 3));
+	const __m128i l1 = V::min(a, b), h1 = V::max(a, b);
+	const __m128i l1p = _mm_unpacklo_epi64(l1, h1), h1p = _mm_unpackhi_epi64(l1, h1);
+	const __m128i l2 = V::min(l1p, h1p), h2 = V::max(l1p, h1p);
+	const __m128i l2u = _mm_unpacklo_epi32(l2, h2), h2u = _mm_unpackhi_epi32(l2, h2);
+	const __m128i l2p = _mm_unpacklo_epi64(l2u, h2u), h2p = _mm_unpackhi_epi64(l2u, h2u);
+	const __m128i l3 = V::min(l2p, h2p), h3 = V::max(l2p, h2p);
+	*lo = _mm_unpacklo_epi32(l3, h3);
+	*hi = _mm_unpackhi_epi32(l3, h3);
+      }
+    else
+      {
+	b = _mm_shuffle_epi32(b, _MM_SHUFFLE(1, 0, 3, 2));
+	const __m128i l1 = V::min(a, b), h1 = V::max(a, b);
+	const __m128i l1p = _mm_unpacklo_epi64(l1, h1), h1p = _mm_unpackhi_epi64(l1, h1);
+	const __m128i l2 = V::min(l1p, h1p), h2 = V::max(l1p, h1p);
+	*lo = _mm_unpacklo_epi64(l2, h2);
+	*hi = _mm_unpackhi_epi64(l2, h2);
+      }
+  }
+
+  /* The last vector of the network (the largest n_lanes merged elements) is carried over and
+     merged with the tails of a and b once one input runs out of full vectors. */
+  template <typename T>
+  static inline void
+  merge_simd(const T* a, const T* b, T* dest, size_t n_a, size_t n_b)
+  {
+    const size_t w = simd_traits<T>::n_lanes;
+    if (n_a < w || n_b < w)
+      {
+	merge_scalar(a, b, dest, n_a, n_b, std::less<T>());
+	return;
+      }
+
+    size_t i, j, k = 0;
+    __m128i next, lo;
+    if (b[0] < a[0])
+      {
+	next = _mm_loadu_si128((const __m128i*) b);
+	i = 0;
+	j = w;
+      }
+    else
+      {
+	next = _mm_loadu_si128((const __m128i*) a);
+	i = w;
+	j = 0;
+      }
+
+    while (i + w <= n_a && j + w <= n_b)
+      {
+	const T* in;
+	if (b[j] < a[i])
+	  {
+	    in = b + j;
+	    j += w;
+	  }
+	else
+	  {
+	    in = a + i;
+	    i += w;
+	  }
+	simd_bitonic_merge<T>(next, _mm_loadu_si128((const __m128i*) in), &lo, &next);
+	_mm_storeu_si128((__m128i*) (dest + k), lo);
+	k += w;
+      }
+
+    T carry[w];
+    _mm_storeu_si128((__m128i*) carry, next);
+    merge_carry(carry, w, a, b, dest + k, i, j, n_a, n_b, std::less<T>());
+  }
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+  namespace avx2
+  {
+    struct ops_base
+    {
+      typedef __m256i vec;
+      template <typename T> static inline vec load(const T* p)
+      {
+	return _mm256_loadu_si256((const __m256i*) p);
+      }
+      template <typename T> static inline void store(T* p, const vec v)
+      {
+	_mm256_storeu_si256((__m256i*) p, v);
+      }
+      static inline vec permute(const vec x, const vec p)
+      {
+	return _mm256_permutevar8x32_epi32(x, p);
+      }
+      static inline vec select(const vec a, const vec b, const vec m)
+      {
+	return _mm256_blendv_epi8(a, b, m);
+      }
+    };
+
+    template <typename T>
+    struct ops
+    {
+      static const bool enabled = false;
+    };
+
+    template <> struct ops<int32_t> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 8;
+      static inline vec min(const vec a, const vec b) { return _mm256_min_epi32(a, b); }
+      static inline vec max(const vec a, const vec b) { return _mm256_max_epi32(a, b); }
+      static inline vec lt(const vec a, const vec b) { return _mm256_cmpgt_epi32(b, a); }
+    };
+
+    template <> struct ops<uint32_t> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 8;
+      static inline vec min(const vec a, const vec b) { return _mm256_min_epu32(a, b); }
+      static inline vec max(const vec a, const vec b) { return _mm256_max_epu32(a, b); }
+      static inline vec lt(const vec a, const vec b)
+      {
+	const vec bias = _mm256_set1_epi32(0x80000000);
+	return _mm256_cmpgt_epi32(_mm256_xor_si256(b, bias), _mm256_xor_si256(a, bias));
+      }
+    };
+
+    template <> struct ops<float> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 8;
+      static inline vec min(const vec a, const vec b)
+      {
+	return _mm256_castps_si256(_mm256_min_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+      }
+      static inline vec max(const vec a, const vec b)
+      {
+	return _mm256_castps_si256(_mm256_max_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b)));
+      }
+      static inline vec lt(const vec a, const vec b)
+      {
+	return _mm256_castps_si256(_mm256_cmp_ps(_mm256_castsi256_ps(a), _mm256_castsi256_ps(b), _CMP_LT_OQ));
+      }
+    };
+
+    template <> struct ops<int64_t> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 4;
+      static inline vec min(const vec a, const vec b)
+      {
+	return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+      }
+      static inline vec max(const vec a, const vec b)
+      {
+	return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+      }
+      static inline vec lt(const vec a, const vec b) { return _mm256_cmpgt_epi64(b, a); }
+    };
+
+    template <> struct ops<uint64_t> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 4;
+      static inline vec gt(const vec a, const vec b)
+      {
+	const vec bias = _mm256_set1_epi64x(0x8000000000000000LL);
+	return _mm256_cmpgt_epi64(_mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+      }
+      static inline vec min(const vec a, const vec b) { return _mm256_blendv_epi8(a, b, gt(a, b)); }
+      static inline vec max(const vec a, const vec b) { return _mm256_blendv_epi8(b, a, gt(a, b)); }
+      static inline vec lt(const vec a, const vec b) { return gt(b, a); }
+    };
+
+    template <> struct ops<double> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 4;
+      static inline vec min(const vec a, const vec b)
+      {
+	return _mm256_castpd_si256(_mm256_min_pd(_mm256_castsi256_pd(a), _mm256_castsi256_pd(b)));
+      }
+      static inline vec max(const vec a, const vec b)
+      {
+	return _mm256_castpd_si256(_mm256_max_pd(_mm256_castsi256_pd(a), _mm256_castsi256_pd(b)));
+      }
+      static inline vec lt(const vec a, const vec b)
+      {
+	return _mm256_castpd_si256(_mm256_cmp_pd(_mm256_castsi256_pd(a), _mm256_castsi256_pd(b), _CMP_LT_OQ));
+      }
+    };
+
+#include <merge_simd_isa.hpp>
+  }
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+  /* the _mm512_undefined_* of the intrinsics trigger false positives in some versions of gcc */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+  namespace avx512
+  {
+    struct ops_base
+    {
+      typedef __m512i vec;
+      template <typename T> static inline vec load(const T* p)
+      {
+	return _mm512_loadu_si512((const void*) p);
+      }
+      template <typename T> static inline void store(T* p, const vec v)
+      {
+	_mm512_storeu_si512((void*) p, v);
+      }
+      static inline vec permute(const vec x, const vec p)
+      {
+	return _mm512_permutexvar_epi32(p, x);
+      }
+      static inline vec select(const vec a, const vec b, const vec m)
+      {
+	return _mm512_mask_blend_epi32(_mm512_test_epi32_mask(m, m), a, b);
+      }
+      /* compare masks as vectors, as the ones of AVX2 */
+      static inline vec mask32(const __mmask16 m) { return _mm512_maskz_mov_epi32(m, _mm512_set1_epi32(-1)); }
+      static inline vec mask64(const __mmask8 m) { return _mm512_maskz_mov_epi64(m, _mm512_set1_epi64(-1)); }
+    };
+
+    template <typename T>
+    struct ops
+    {
+      static const bool enabled = false;
+    };
+
+    template <> struct ops<int32_t> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 16;
+      static inline vec min(const vec a, const vec b) { return _mm512_min_epi32(a, b); }
+      static inline vec max(const vec a, const vec b) { return _mm512_max_epi32(a, b); }
+      static inline vec lt(const vec a, const vec b) { return mask32(_mm512_cmplt_epi32_mask(a, b)); }
+    };
+
+    template <> struct ops<uint32_t> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 16;
+      static inline vec min(const vec a, const vec b) { return _mm512_min_epu32(a, b); }
+      static inline vec max(const vec a, const vec b) { return _mm512_max_epu32(a, b); }
+      static inline vec lt(const vec a, const vec b) { return mask32(_mm512_cmplt_epu32_mask(a, b)); }
+    };
+
+    template <> struct ops<float> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 16;
+      static inline vec min(const vec a, const vec b)
+      {
+	return _mm512_castps_si512(_mm512_min_ps(_mm512_castsi512_ps(a), _mm512_castsi512_ps(b)));
+      }
+      static inline vec max(const vec a, const vec b)
+      {
+	return _mm512_castps_si512(_mm512_max_ps(_mm512_castsi512_ps(a), _mm512_castsi512_ps(b)));
+      }
+      static inline vec lt(const vec a, const vec b)
+      {
+	return mask32(_mm512_cmp_ps_mask(_mm512_castsi512_ps(a), _mm512_castsi512_ps(b), _CMP_LT_OQ));
+      }
+    };
+
+    template <> struct ops<int64_t> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 8;
+      static inline vec min(const vec a, const vec b) { return _mm512_min_epi64(a, b); }
+      static inline vec max(const vec a, const vec b) { return _mm512_max_epi64(a, b); }
+      static inline vec lt(const vec a, const vec b) { return mask64(_mm512_cmplt_epi64_mask(a, b)); }
+    };
+
+    template <> struct ops<uint64_t> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 8;
+      static inline vec min(const vec a, const vec b) { return _mm512_min_epu64(a, b); }
+      static inline vec max(const vec a, const vec b) { return _mm512_max_epu64(a, b); }
+      static inline vec lt(const vec a, const vec b) { return mask64(_mm512_cmplt_epu64_mask(a, b)); }
+    };
+
+    template <> struct ops<double> : ops_base
+    {
+      static const bool enabled = true;
+      static const uint n_lanes = 8;
+      static inline vec min(const vec a, const vec b)
+      {
+	return _mm512_castpd_si512(_mm512_min_pd(_mm512_castsi512_pd(a), _mm512_castsi512_pd(b)));
+      }
+      static inline vec max(const vec a, const vec b)
+      {
+	return _mm512_castpd_si512(_mm512_max_pd(_mm512_castsi512_pd(a), _mm512_castsi512_pd(b)));
+      }
+      static inline vec lt(const vec a, const vec b)
+      {
+	return mask64(_mm512_cmp_pd_mask(_mm512_castsi512_pd(a), _mm512_castsi512_pd(b), _CMP_LT_OQ));
+      }
+    };
+
+#include <merge_simd_isa.hpp>
+  }
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+  /* call the kernels of an ISA only for the types it supports; return 0 otherwise */
+  template <typename T, bool enabled = simd_traits<T>::enabled>
+  struct sse_kernels
+  {
+    static inline uint merge(const T*, const T*, T*, size_t, size_t) { return 0; }
+  };
+  template <typename T>
+  struct sse_kernels<T, true>
+  {
+    static inline uint merge(const T* a, const T* b, T* dest, size_t n_a, size_t n_b)
+    {
+      merge_simd(a, b, dest, n_a, n_b);
+      return 1;
+    }
+  };
+
+  template <typename T, bool enabled = avx2::ops<T>::enabled>
+  struct avx2_kernels
+  {
+    static inline uint merge(const T*, const T*, T*, size_t, size_t) { return 0; }
+    static inline uint sort(T*, T*, size_t) { return 0; }
+  };
+  template <typename T>
+  struct avx2_kernels<T, true>
+  {
+    static inline uint merge(const T* a, const T* b, T* dest, size_t n_a, size_t n_b)
+    {
+      if (sizeof(T) == 8)	/* 4 lanes do not beat the SSE / scalar merge (see merge_kernels) */
+	{
+	  return 0;
+	}
+      avx2::merge(a, b, dest, n_a, n_b);
+      return 1;
+    }
+    static inline uint sort(T* data, T* tmp, size_t n)
+    {
+      avx2::sort(data, tmp, n);
+      return 1;
+    }
+  };
+
+  template <typename T, bool enabled = avx512::ops<T>::enabled>
+  struct avx512_kernels
+  {
+    static inline uint merge(const T*, const T*, T*, size_t, size_t) { return 0; }
+    static inline uint sort(T*, T*, size_t) { return 0; }
+  };
+  template <typename T>
+  struct avx512_kernels<T, true>
+  {
+    static inline uint merge(const T* a, const T* b, T* dest, size_t n_a, size_t n_b)
+    {
+      avx512::merge(a, b, dest, n_a, n_b);
+      return 1;
+    }
+    static inline uint sort(T* data, T* tmp, size_t n)
+    {
+      avx512::sort(data, tmp, n);
+      return 1;
+    }
+  };
+
+  /* pairs go through the vector networks if the values fill the lanes of the keys */
+  template <typename Key, typename Value>
+  struct kv_simd
+  {
+    static const bool enabled = (sizeof(Value) == sizeof(Key)) && (sizeof(kv<Key, Value>) == 2 * sizeof(Key)) &&
+      std::is_trivially_copyable<Value>::value;
+  };
+
+  /* with 4 lanes of 64-bit keys, AVX2 is slower than the scalar kernels */
+  template <typename Key, typename Value,
+	    bool enabled = avx2::ops<Key>::enabled && kv_simd<Key, Value>::enabled && (sizeof(Key) == 4)>
+  struct avx2_kv_kernels
+  {
+    static inline uint merge(const kv<Key, Value>*, const kv<Key, Value>*, kv<Key, Value>*, size_t, size_t) { return 0; }
+    static inline uint sort(kv<Key, Value>*, kv<Key, Value>*, size_t) { return 0; }
+  };
+  template <typename Key, typename Value>
+  struct avx2_kv_kernels<Key, Value, true>
+  {
+    static inline uint merge(const kv<Key, Value>* a, const kv<Key, Value>* b, kv<Key, Value>* dest,
+			     size_t n_a, size_t n_b)
+    {
+      avx2::merge_kv(a, b, dest, n_a, n_b);
+      return 1;
+    }
+    static inline uint sort(kv<Key, Value>* data, kv<Key, Value>* tmp, size_t n)
+    {
+      avx2::sort_kv(data, tmp, n);
+      return 1;
+    }
+  };
+
+  template <typename Key, typename Value,
+	    bool enabled = avx512::ops<Key>::enabled && kv_simd<Key, Value>::enabled>
+  struct avx512_kv_kernels
+  {
+    static inline uint merge(const kv<Key, Value>*, const kv<Key, Value>*, kv<Key, Value>*, size_t, size_t) { return 0; }
+    static inline uint sort(kv<Key, Value>*, kv<Key, Value>*, size_t) { return 0; }
+  };
+  template <typename Key, typename Value>
+  struct avx512_kv_kernels<Key, Value, true>
+  {
+    static inline uint merge(const kv<Key, Value>* a, const kv<Key, Value>* b, kv<Key, Value>* dest,
+			     size_t n_a, size_t n_b)
+    {
+      avx512::merge_kv(a, b, dest, n_a, n_b);
+      return 1;
+    }
+    static inline uint sort(kv<Key, Value>* data, kv<Key, Value>* tmp, size_t n)
+    {
+      avx512::sort_kv(data, tmp, n);
+      return 1;
+    }
+  };
+#endif	/* __x86_64__ */
+
+  /* merge / sort with the kernels of isa (or the next best ones for T) */
+  template <typename T>
+  static inline void
+  merge_isa(const simd_isa_t isa, const T* a, const T* b, T* dest, size_t n_a, size_t n_b)
+  {
+#if defined(__x86_64__)
+    if ((isa >= SIMD_AVX512 && avx512_kernels<T>::merge(a, b, dest, n_a, n_b)) ||
+	(isa >= SIMD_AVX2 && avx2_kernels<T>::merge(a, b, dest, n_a, n_b)) ||
+	(isa >= SIMD_SSE && sse_kernels<T>::merge(a, b, dest, n_a, n_b)))
+      {
+	return;
+      }
+#endif
+    merge_scalar(a, b, dest, n_a, n_b, std::less<T>());
+  }
+
+  /* tmp: scratch space for n elements */
+  template <typename T>
+  static inline void
+  sort_isa(const simd_isa_t isa, T* data, T* tmp, size_t n)
+  {
+#if defined(__x86_64__)
+    if ((isa >= SIMD_AVX512 && avx512_kernels<T>::sort(data, tmp, n)) ||
+	(isa >= SIMD_AVX2 && avx2_kernels<T>::sort(data, tmp, n)))
+      {
+	return;
+      }
+#endif
+    std::sort(data, data + n);
+  }
+
+  /* the same for pairs, on std::less keys */
+  template <typename Key, typename Value>
+  static inline void
+  merge_kv_isa(const simd_isa_t isa, const kv<Key, Value>* a, const kv<Key, Value>* b, kv<Key, Value>* dest,
+	       size_t n_a, size_t n_b)
+  {
+#if defined(__x86_64__)
+    if ((isa >= SIMD_AVX512 && avx512_kv_kernels<Key, Value>::merge(a, b, dest, n_a, n_b)) ||
+	(isa >= SIMD_AVX2 && avx2_kv_kernels<Key, Value>::merge(a, b, dest, n_a, n_b)))
+      {
+	return;
+      }
+#endif
+    merge_scalar(a, b, dest, n_a, n_b, kv_less<Key, Value, std::less<Key> >(std::less<Key>()));
+  }
+
+  template <typename Key, typename Value>
+  static inline void
+  sort_kv_isa(const simd_isa_t isa, kv<Key, Value>* data, kv<Key, Value>* tmp, size_t n)
+  {
+#if defined(__x86_64__)
+    if ((isa >= SIMD_AVX512 && avx512_kv_kernels<Key, Value>::sort(data, tmp, n)) ||
+	(isa >= SIMD_AVX2 && avx2_kv_kernels<Key, Value>::sort(data, tmp, n)))
+      {
+	return;
+      }
+#endif
+    std::sort(data, data + n, kv_less<Key, Value, std::less<Key> >(std::less<Key>()));
+  }
+
+  template <typename T, typename Less>
+  struct merge_kernel
+  {
+    static inline void
+    merge(const T* a, const T* b, T* dest, size_t n_a, size_t n_b, Less less)
+    {
+      merge_scalar(a, b, dest, n_a, n_b, less);
+    }
+  };
+
+  template <typename T>
+  struct merge_kernel<T, std::less<T> >
+  {
+    static inline void
+    merge(const T* a, const T* b, T* dest, size_t n_a, size_t n_b, std::less<T> less)
+    {
+      merge_isa(simd_isa(), a, b, dest, n_a, n_b);
+    }
+  };
+
+  template <typename Key, typename Value>
+  struct merge_kernel<kv<Key, Value>, kv_less<Key, Value, std::less<Key> > >
+  {
+    static inline void
+    merge(const kv<Key, Value>* a, const kv<Key, Value>* b, kv<Key, Value>* dest, size_t n_a, size_t n_b,
+	  kv_less<Key, Value, std::less<Key> > less)
+    {
+      merge_kv_isa(simd_isa(), a, b, dest, n_a, n_b);
+    }
+  };
+
+  template <typename T, typename Less>
+  struct sort_kernel
+  {
+    static inline void
+    sort(T* data, T* tmp, size_t n, Less less)
+    {
+      std::sort(data, data + n, less);
+    }
+  };
+
+  template <typename T>
+  struct sort_kernel<T, std::less<T> >
+  {
+    static inline void
+    sort(T* data, T* tmp, size_t n, std::less<T> less)
+    {
+      sort_isa(simd_isa(), data, tmp, n);
+    }
+  };
+
+  template <typename Key, typename Value>
+  struct sort_kernel<kv<Key, Value>, kv_less<Key, Value, std::less<Key> > >
+  {
+    static inline void
+    sort(kv<Key, Value>* data, kv<Key, Value>* tmp, size_t n, kv_less<Key, Value, std::less<Key> > less)
+    {
+      sort_kv_isa(simd_isa(), data, tmp, n);
+    }
+  };
+
+  /* Parallel merge of a and b: thread my_id of n_threads merges its equal share of the output.
+     The split points are found with a binary search on the merge path: "Merge Path - Parallel
+     Merging Made Simple", Odeh et al., IPDPSW'12 */
+  template <typename T, typename Less>
+  static inline size_t
+  merge_path_split(const T* a, const T* b, const size_t n_a, const size_t n_b, const size_t diag, Less less)
+  {
+    size_t lo = (diag > n_b) ? (diag - n_b) : 0;
+    size_t hi = (diag < n_a) ? diag : n_a;
+    while (lo < hi)
+      {
+	const size_t mid = lo + ((hi - lo) >> 1);
+	if (less(b[diag - mid - 1], a[mid]))
+	  {
+	    hi = mid;
+	  }
+	else
+	  {
+	    lo = mid + 1;
+	  }
+      }
+    return lo;
+  }
+
+  template <typename T, typename Less>
+  static inline void
+  merge_parallel(const T* a, const T* b, T* dest, const size_t n_a, const size_t n_b,
+		 const uint my_id, const uint n_threads, Less less)
+  {
+    const size_t n = n_a + n_b;
+    const size_t diag_start = (n * my_id) / n_threads;
+    const size_t diag_stop = (n * (my_id + 1)) / n_threads;
+    const size_t a_start = merge_path_split(a, b, n_a, n_b, diag_start, less);
+    const size_t a_stop = merge_path_split(a, b, n_a, n_b, diag_stop, less);
+    const size_t b_start = diag_start - a_start, b_stop = diag_stop - a_stop;
+    merge_kernel<T, Less>::merge(a + a_start, b + b_start, dest + diag_start,
+				 a_stop - a_start, b_stop - b_start, less);
+  }
+}
+
+#endif	/* __H_MERGE_SIMD_UTILS__ */
@@ -9,6 +9,9 @@ main(int argc, char **argv)
   uint manual_file = 0;
   uint test_do_dot = 1;
   uint max_cross_socket_lvl = 0;
+  char* mctb_file = NULL;
+  char* shm_publish = NULL;
+  char* shm_attach = NULL;
 
   struct option long_options[] = 
     {
@@ -17,6 +20,10 @@ main(int argc, char **argv)
       {"mct",                       required_argument,       NULL, 'm'},
       {"level",                     required_argument,       NULL, 'l'},
       {"no-dot",                    no_argument,             NULL, 'n'},
+      {"binary",                    required_argument,       NULL, 'b'},
+      {"publish",                   optional_argument,       NULL, 'p'},
+      {"attach",                    optional_argument,       NULL, 'a'},
+      {"unpublish",                 optional_argument,       NULL, 'u'},
       {NULL, 0, NULL, 0}
     };
 
@@ -25,7 +32,7 @@ main(int argc, char **argv)
   while(1) 
     {
       i = 0;
-      c = getopt_long(argc, argv, "hm:l:n", long_options, &i);
+      c = getopt_long(argc, argv, "hm:l:nb:p::a::u::", long_options, &i);
 
       if(c == -1)
 	break;
@@ -48,6 +55,22 @@ main(int argc, char **argv)
 	case 'n':
 	  test_do_dot = 0;
 	  break;
+	case 'b':
+	  mctb_file = optarg;
+	  break;
+	case 'p':
+	  shm_publish = optarg ? optarg : MCTOP_SHM_NAME;
+	  break;
+	case 'a':
+	  shm_attach = optarg ? optarg : MCTOP_SHM_NAME;
+	  break;
+	case 'u':
+	  if (!mctop_unpublish(optarg ? optarg : MCTOP_SHM_NAME))
+	    {
+	      perror("MCTOP Error: Cannot unpublish topology");
+	      exit(1);
+	    }
+	  exit(0);
 	case 'h':
 	  printf("mctop_load  Copyright (C) 2016  Vasileios Trigonakis <vasileios.trigonakis@epfl.ch>\n"
 		 "This program comes with ABSOLUTELY NO WARRANTY.\n"
@@ -65,6 +88,17 @@ main(int argc, char **argv)
 		 "        only plot level 4 for cross socket.\n"
 		 "  -n, --no-dot\n"
 		 "        Do not plot the dot graph representation.\n"
+		 "  -b, --binary <string>\n"
+		 "        Also store the loaded topology as a binary MCT file (.mctb), which loads w/o parsing.\n"
+		 "        mctop_load(NULL) prefers ./desc/<hostname>.mctb over ./desc/<hostname>.mct.\n"
+		 "  -p, --publish[=<string>]\n"
+		 "        Publish the loaded topology in the named shm segment (default: " MCTOP_SHM_NAME ").\n"
+		 "        Other processes attach to it w/o parsing; mctop_load(NULL) tries " MCTOP_SHM_NAME " first,\n"
+		 "        if it was published on this host for a topology with as many hw contexts.\n"
+		 "  -a, --attach[=<string>]\n"
+		 "        Attach to the topology published in the named shm segment (default: " MCTOP_SHM_NAME ").\n"
+		 "  -u, --unpublish[=<string>]\n"
+		 "        Remove the named shm segment (default: " MCTOP_SHM_NAME "). Attached processes are not affected.\n"
 		 );
 	  exit(0);
 	case '?':
@@ -76,7 +110,15 @@ main(int argc, char **argv)
     }
 
   mctop_t* topo;
-  if (manual_file)
+  if (shm_attach != NULL)
+    {
+      topo = mctop_attach(shm_attach);
+      if (topo == NULL)
+	{
+	  fprintf(stderr, "MCTOP Error: No topology published in %s!\n", shm_attach);
+	}
+    }
+  else if (manual_file)
     {
       topo = mctop_load(mct_file);
     }
@@ -87,6 +129,14 @@ main(int argc, char **argv)
 
   if (topo != NULL)
     {
+      if (mctb_file != NULL && mctop_save_bin(topo, mctb_file))
+	{
+	  printf("MCTOP Info: Stored binary MCT file %s\n", mctb_file);
+	}
+      if (shm_publish != NULL && mctop_publish(topo, shm_publish))
+	{
+	  printf("MCTOP Info: Published topology in %s\n", shm_publish);
+	}
       mctop_print(topo);
       if (test_do_dot)
 	{
@@ -1,6 +1,7 @@
 #include <mctop_crawler.h>
 #include <mctop_mem.h>
 #include <mctop_profiler.h>
+#include <mctop_crawl_sched.h>
 #include <mctop.h>
 #include <mctop_internal.h>
 #include <atomics.h>
@@ -22,6 +23,11 @@ test_format_t test_format = DEFAULT_FORMAT;
 int test_verbose = DEFAULT_VERBOSE;
 mctop_test_mem_type_t test_do_mem = DEFAULT_DO_MEM;
 size_t test_mem_bw_size = DEFAULT_MEM_BW_SIZE;
+uint test_num_parallel = DEFAULT_NUM_PARALLEL;
+int test_adaptive = DEFAULT_ADAPTIVE;
+int test_infer = DEFAULT_INFER;
+char* test_ckpt_file = NULL;
+int test_resume = 0;
 
 /* variables set by the main thread */
 size_t test_max_stdev_max;
@@ -31,6 +37,9 @@ int test_num_sockets = -1;	/* num nodes / sockets */
 int test_num_hw_ctx;
 ticks* lat_table = NULL;
 ticks** mem_lat_table = NULL;
+uint8_t* crawl_done = NULL;	/* pairs with a final measurement (n x n) */
+uint ckpt_rows_done = 0;	/* rows of crawl() restored from the checkpoint */
+time_t ckpt_last = 0;
 volatile uint64_t** node_mem;
 int test_mem_on_demand = 0;
 double** mem_bw_table_r, ** mem_bw_table_w;
@@ -39,9 +48,27 @@ double** mem_bw_table1_r, ** mem_bw_table1_w; /* single-threaded */
 /* variables set by worker threads */
 cache_line_t* test_cache_line = NULL;
 volatile int high_stdev_retry = 0;
+volatile int adaptive_stop = 0;
+size_t adaptive_n_samples = 0;	/* samples taken by tid 0 with early stopping */
+size_t infer_n_measured = 0;	/* pairs measured with incremental inference */
 volatile uint32_t mem_bw_barrier = 0;
 volatile double* mem_bw_gbps_r, * mem_bw_gbps_w;
 
+/* parallel crawl: one slot per pair of threads measuring concurrently */
+typedef struct crawl_slot
+{
+  cache_line_t* cache_line;
+  volatile int high_stdev_retry;
+  volatile int adaptive_stop;
+  size_t n_samples;
+  uint8_t padding[CACHE_LINE_SIZE - sizeof(cache_line_t*) - 2 * sizeof(int) - sizeof(size_t)];
+} crawl_slot_t;
+
+crawl_sched_t* crawl_schedule = NULL;
+crawl_slot_t* crawl_slots = NULL;
+crawl_batch_t* volatile crawl_batch_cur = NULL;
+pthread_barrier_t crawl_pool_barrier; /* crawl threads + main: a schedule starts / ends */
+
 void ll_random_create(volatile uint64_t* mem, const size_t size);
 ticks ll_random_traverse(volatile uint64_t* list, const size_t reps);
 
@@ -129,6 +156,114 @@ abs_sub(const size_t a, const size_t b)
   return b - a;
 }
 
+/* Runs up to test_num_reps round trips on cache_line and returns how many were done. With
+   early stopping (-e), tid 0 checks the 95% confidence interval of the median after
+   ADAPTIVE_MIN_REPS, 2x, 4x, ... samples and both threads stop once it is narrower than the
+   cdf cluster offset, i.e., the minimum gap between two adjacent latency levels. Thus, the
+   median cannot end up in a different latency level than with all repetitions. */
+static size_t
+crawl_reps(volatile cache_line_t* cache_line, barrier2_t* barrier2, const int tid, mctop_prof_t* profiler,
+	   mctop_prof_stats_t* stats, volatile int* stop, volatile size_t* sum)
+{
+  const size_t _num_reps = test_num_reps;
+  size_t next_check = test_adaptive ? ADAPTIVE_MIN_REPS : _num_reps;
+  size_t rep;
+  for (rep = 0; rep < _num_reps; rep++)
+    {
+      if (unlikely(rep == next_check))
+	{
+	  if (tid == 0)
+	    {
+	      mctop_prof_stats_calc_n(profiler, rep, stats);
+	      *stop = ((stats->median_ci_high - stats->median_ci_low) < test_cdf_cluster_offset);
+	    }
+	  barrier2_cross_explicit(barrier2, tid, 8);
+	  if (*stop)
+	    {
+	      break;
+	    }
+	  next_check <<= 1;
+	}
+
+      barrier2_cross_explicit(barrier2, tid, 5);
+
+      if (likely(tid == 0))
+	{
+	  barrier2_cross(barrier2, tid, rep);
+	  *sum += ATOMIC_OP(cache_line, rep, profiler);
+	}
+      else
+	{
+	  *sum += ATOMIC_OP(cache_line, rep, profiler);
+	  barrier2_cross(barrier2, tid, rep);
+	}
+    }
+  return rep;
+}
+
+/* ******************************************************************************** */
+/* checkpointing of the crawl */
+/* ******************************************************************************** */
+
+/* Writes the partial latency tables to test_ckpt_file (see crawl_ckpt_write) */
+static void
+ckpt_write(const uint rows_done)
+{
+  const crawl_ckpt_t ck = { .n_hwcs = test_num_hw_ctx, .n_sockets = test_num_sockets, .rows_done = rows_done,
+			    .lat_table = lat_table, .done = crawl_done, .mem_lat_table = mem_lat_table };
+  if (!crawl_ckpt_write(test_ckpt_file, &ck))
+    {
+      fprintf(stderr, "MCTOP Warning: Writing checkpoint file %s failed!\n", test_ckpt_file);
+    }
+  ckpt_last = time(NULL);
+}
+
+static inline void
+ckpt_write_periodic(const uint rows_done)
+{
+  if (test_ckpt_file != NULL && (time(NULL) - ckpt_last) >= CKPT_INTERVAL_SECS)
+    {
+      ckpt_write(rows_done);
+    }
+}
+
+/* Restores the tables from test_ckpt_file. Returns the num. of restored pairs. */
+static size_t
+ckpt_read()
+{
+  const size_t n = test_num_hw_ctx;
+  crawl_ckpt_t ck = { .n_hwcs = n, .n_sockets = test_num_sockets,
+		      .lat_table = lat_table, .done = crawl_done, .mem_lat_table = mem_lat_table };
+  switch (crawl_ckpt_read(test_ckpt_file, &ck))
+    {
+    case CRAWL_CKPT_OK:
+      break;
+    case CRAWL_CKPT_NONE:
+      fprintf(stderr, "MCTOP Warning: No checkpoint file %s. Starting from scratch.\n", test_ckpt_file);
+      return 0;
+    case CRAWL_CKPT_INVALID:
+      fprintf(stderr, "MCTOP Error: Checkpoint file %s is invalid or from a different setting!\n",
+	      test_ckpt_file);
+      exit(-1);
+    case CRAWL_CKPT_TRUNCATED:
+      fprintf(stderr, "MCTOP Error: Checkpoint file %s is truncated!\n", test_ckpt_file);
+      exit(-1);
+    }
+
+  /* mem. latencies are measured along the rows */
+  ckpt_rows_done = (test_do_mem != ON_TIME || ck.has_mem) ? ck.rows_done : 0;
+
+  size_t n_done = 0;
+  for (size_t x = 0; x < n; x++)
+    {
+      for (size_t y = x + 1; y < n; y++)
+	{
+	  n_done += crawl_done[x * n + y];
+	}
+    }
+  return n_done;
+}
+
 void*
 crawl(void* param)
 {
@@ -138,7 +273,7 @@ crawl(void* param)
   barrier2_t* barrier2 = tld->barrier2;
   
   const double test_completion_perc_step = 100.0 / test_num_hw_ctx;
-  double test_completion_perc = 0;
+  double test_completion_perc = ckpt_rows_done * test_completion_perc_step;
   double test_completion_time = 0;
 
   const uint _num_reps = test_num_reps; /* local copy */
@@ -158,9 +293,10 @@ crawl(void* param)
 
   volatile size_t sum = 0;
   int node_local = -1;
-  for (int x = 0; x < _num_hw_ctx; x++)
+  for (int x = ckpt_rows_done; x < _num_hw_ctx; x++)
     {
       clock_t _clock_start = clock();
+      uint n_restored = 0;
       if (tid == 0)
 	{
 	  mctop_set_cpu(NULL, x); 
@@ -212,6 +348,12 @@ crawl(void* param)
       size_t history_med[2] = { 0 };
       for (int y = x + 1; y < _num_hw_ctx; y++)
 	{
+	  if (crawl_done[x * _num_hw_ctx + y])
+	    {
+	      n_restored++;	/* from the checkpoint */
+	      continue;
+	    }
+
 	  ID1_DO(
 		 mctop_set_cpu(NULL, y);
 		 if (_do_dvfs)
@@ -222,23 +364,10 @@ crawl(void* param)
 
 	  hw_warmup(cache_line, _num_warmup_reps, barrier2, tid, profiler);
 
-	  for (size_t rep = 0; rep < _num_reps; rep++)
-	    {
-	      barrier2_cross_explicit(barrier2, tid, 5);
-
-	      if (likely(tid == 0))
-		{
-		  barrier2_cross(barrier2, tid, rep);
-		  sum += ATOMIC_OP(cache_line, rep, profiler);
-		}
-	      else
-		{
-		  sum += ATOMIC_OP(cache_line, rep, profiler);
-		  barrier2_cross(barrier2, tid, rep);
-		}
-	    }
+	  size_t n_reps = crawl_reps(cache_line, barrier2, tid, profiler, stats, &adaptive_stop, &sum);
+	  ID0_DO(adaptive_n_samples += n_reps);
 
-	  mctop_prof_stats_calc(profiler, stats);
+	  mctop_prof_stats_calc_n(profiler, n_reps, stats);
 	  double stdev = stats->std_dev_perc;
 	  int64_t median = stats->median;
 	  if (likely(tid == 0))
@@ -301,6 +430,7 @@ crawl(void* param)
 	    }
 	  else
 	    {
+	      ID0_DO(crawl_done[x * _num_hw_ctx + y] = crawl_done[y * _num_hw_ctx + x] = 1);
 	      max_stdev = test_max_stdev;
 	      history_med[0] = history_med[1] = 0;
 	      n_retries = 0;
@@ -317,7 +447,8 @@ crawl(void* param)
 			     test_completion_perc, test_completion_time, sec);
 		      fflush(stdout);
 		      );
-	  assert(sum != 0);
+	  assert(sum != 0 || n_restored == (_num_hw_ctx - x - 1));
+	  ckpt_write_periodic(x + 1);
 	}
     }
 
@@ -340,6 +471,203 @@ crawl(void* param)
   return NULL;
 }
 
+/* measures the latency of a single pair on the cache lines of the slot. Both threads of the
+   pair must be already pinned. Returns the median of the thread with tid 0. */
+static ticks
+crawl_pair(crawl_slot_t* slot, barrier2_t* barrier2, const int tid, const int x, const int y,
+	   mctop_prof_t* profiler, mctop_prof_stats_t* stats)
+{
+  const uint _num_warmup_reps = test_num_warmup_reps;
+  const uint _test_cl_size = test_num_cache_lines * sizeof(cache_line_t);
+  int max_stdev = test_max_stdev;
+  uint n_retries = 0;
+  size_t history_med[2] = { 0 };
+  volatile size_t sum = 0;
+
+  while (1)
+    {
+      volatile cache_line_t* cache_line = slot->cache_line;
+      hw_warmup(cache_line, _num_warmup_reps, barrier2, tid, profiler);
+
+      size_t n_reps = crawl_reps(cache_line, barrier2, tid, profiler, stats, &slot->adaptive_stop, &sum);
+      ID0_DO(slot->n_samples += n_reps);
+
+      mctop_prof_stats_calc_n(profiler, n_reps, stats);
+      double stdev = stats->std_dev_perc;
+      int64_t median = stats->median;
+      if (likely(tid == 0))
+	{
+	  if (unlikely(median < 0) ||
+	      (stdev > max_stdev && (history_med[0] != median || history_med[1] != median)))
+	    {
+	      slot->high_stdev_retry = 1;
+	      cache_lines_destroy(slot->cache_line, _test_cl_size, 0);
+	      slot->cache_line = cache_lines_create(_test_cl_size, -1);
+	      if (unlikely(n_retries == 100))
+		{
+		  printf("100 retries!\n");
+		}
+	    }
+	  if (likely(median >= 0))
+	    {
+	      history_med[0] = history_med[1];
+	      history_med[1] = median;
+	    }
+
+	  if (unlikely(test_verbose))
+	    {
+	      printf(" [%02d->%02d] median %-4zd with stdv %-7.2f%% | limit %2d%% %s\n",
+		     x, y, median, stdev, max_stdev, slot->high_stdev_retry ? "(high)" : "");
+	    }
+	}
+
+      barrier2_cross_explicit(barrier2, tid, 6);
+
+      if (likely(!slot->high_stdev_retry))
+	{
+	  return median;
+	}
+
+      barrier2_cross_explicit(barrier2, tid, 7);
+      if (++max_stdev > test_max_stdev_max)
+	{
+	  max_stdev = test_max_stdev_max;
+	}
+      slot->high_stdev_retry = 0;
+      n_retries++;
+    }
+}
+
+/* parallel crawl: thread 2k and 2k+1 form slot k and measure the k-th pair of each batch
+   of crawl_schedule. All slots work concurrently and synchronize at the end of every batch.
+   The threads wait for the next schedule until crawl_schedule is NULL. */
+void*
+crawl_parallel(void* param)
+{
+  tld_t* tld = (tld_t*) param;
+  const int id = tld->id;
+  const int tid = id & 0x1;	/* role within the pair */
+  const uint nth_slot = id >> 1;
+  pthread_barrier_t* barrier_all = tld->barrier;
+  barrier2_t* barrier2 = tld->barrier2;
+  crawl_slot_t* slot = &crawl_slots[nth_slot];
+
+  const uint _num_hw_ctx = test_num_hw_ctx;
+  const int _do_dvfs = test_dvfs;
+  clock_t _clock_start = clock();
+  size_t n_pairs_done = 0;
+
+  mctop_prof_t* profiler = mctop_prof_create(test_num_reps);
+  mctop_prof_stats_t* stats = malloc_assert(sizeof(mctop_prof_stats_t));
+
+  int hwc_prev = -1;
+  while (1)
+    {
+      pthread_barrier_wait(&crawl_pool_barrier);
+      crawl_sched_t* cs = crawl_schedule;
+      if (cs == NULL)
+	{
+	  break;
+	}
+      const uint _n_batches = cs->n_batches;
+      uint n_batches_done = 0;
+
+      while (1)
+	{
+	  if (id == 0)
+	    {
+	      crawl_batch_cur = crawl_sched_next(cs);
+	    }
+	  pthread_barrier_wait(barrier_all);
+	  crawl_batch_t* cb = crawl_batch_cur;
+	  if (cb == NULL)
+	    {
+	      break;
+	    }
+
+	  if (nth_slot < cb->n_pairs)
+	    {
+	      const int x = cb->pairs[nth_slot].x;
+	      const int y = cb->pairs[nth_slot].y;
+	      const int hwc = (tid == 0) ? x : y;
+	      if (hwc != hwc_prev)
+		{
+		  mctop_set_cpu(NULL, hwc);
+		  if (_do_dvfs && tid == 0)
+		    {
+		      dvfs_scale_up(test_num_dvfs_reps, test_dvfs_ratio, NULL);
+		    }
+		  hwc_prev = hwc;
+		}
+
+	      ticks median = crawl_pair(slot, barrier2, tid, x, y, profiler, stats);
+	      if (tid == 0)
+		{
+		  lat_table_2d_set(lat_table, _num_hw_ctx, x, y, median);
+		  lat_table_2d_set(lat_table, _num_hw_ctx, y, x, median);
+		  crawl_done[x * _num_hw_ctx + y] = crawl_done[y * _num_hw_ctx + x] = 1;
+		}
+	    }
+
+	  pthread_barrier_wait(barrier_all);
+
+	  if (id == 0)
+	    {
+	      n_batches_done++;
+	      n_pairs_done += cb->n_pairs;
+	      double sec = (clock() - _clock_start) / (double) CLOCKS_PER_SEC;
+	      if (test_infer)	/* the total num. of pairs is not known upfront */
+		{
+		  NOT_VERBOSE(printf("\r# Progress : %8zu pairs measured in %8.1f secs", n_pairs_done, sec);
+			      fflush(stdout);
+			      );
+		}
+	      else
+		{
+		  NOT_VERBOSE(printf("\r# Progress : %6.1f%% completed in %8.1f secs (batch %u of %u)",
+				     (100.0 * n_batches_done) / _n_batches, sec, n_batches_done, _n_batches);
+			      fflush(stdout);
+			      );
+		}
+	      ckpt_write_periodic(0);
+	    }
+	}
+
+      pthread_barrier_wait(&crawl_pool_barrier);
+    }
+
+  if (id == 0)
+    {
+      printf("\n");
+    }
+
+  mctop_prof_free(profiler);
+  free(stats);
+  return NULL;
+}
+
+/* NUMA node of each hw context, as given by the OS. Only used to keep concurrently measured
+   pairs apart, so a wrong OS mapping can only make the measurements noisier. */
+static int*
+crawl_hwc_nodes_get(const int n_hwcs, const int n_nodes)
+{
+  int* hwc_node = malloc_assert(n_hwcs * sizeof(int));
+  const int hwc_per_node = (n_hwcs + n_nodes - 1) / n_nodes;
+  for (int h = 0; h < n_hwcs; h++)
+    {
+#ifdef __x86_64__
+      hwc_node[h] = numa_node_of_cpu(h);
+#else
+      hwc_node[h] = -1;
+#endif
+      if (hwc_node[h] < 0)
+	{
+	  hwc_node[h] = h / hwc_per_node;
+	}
+    }
+  return hwc_node;
+}
+
 void*
 init_mem(void* param)
 {
@@ -596,6 +924,114 @@ mem_bandwidth(void* param)
   return NULL;
 }
 
+/* hands cs to the crawl threads and waits until all its pairs are measured */
+static void
+crawl_parallel_measure(crawl_sched_t* cs)
+{
+  crawl_schedule = cs;
+  pthread_barrier_wait(&crawl_pool_barrier);
+  pthread_barrier_wait(&crawl_pool_barrier);
+}
+
+static void
+crawl_infer_measure(const crawl_pair_t* pairs, const uint n_pairs, void* arg)
+{
+  const int* hwc_node = (const int*) arg;
+  crawl_pair_t* todo = malloc_assert(n_pairs * sizeof(crawl_pair_t));
+  uint n_todo = 0;
+  for (uint p = 0; p < n_pairs; p++)
+    {
+      if (!crawl_done[pairs[p].x * test_num_hw_ctx + pairs[p].y]) /* else from the checkpoint */
+	{
+	  todo[n_todo++] = pairs[p];
+	}
+    }
+
+  crawl_sched_t* cs = crawl_sched_create_pairs(test_num_hw_ctx, hwc_node, test_num_parallel, todo, n_todo);
+  free(todo);
+  VERBOSE(crawl_sched_print(cs););
+  crawl_parallel_measure(cs);
+  crawl_sched_free(cs);
+}
+
+static void
+crawl_parallel_run(pthread_attr_t* attr)
+{
+  const uint n_threads = 2 * test_num_parallel;
+  int* hwc_node = crawl_hwc_nodes_get(test_num_hw_ctx, test_num_sockets);
+
+  const uint _test_cl_size = test_num_cache_lines * sizeof(cache_line_t);
+  crawl_slots = (crawl_slot_t*) memalign(CACHE_LINE_SIZE, test_num_parallel * sizeof(crawl_slot_t));
+  assert(crawl_slots != NULL);
+  barrier2_t** barriers2 = malloc_assert(test_num_parallel * sizeof(barrier2_t*));
+  for (uint s = 0; s < test_num_parallel; s++)
+    {
+      crawl_slots[s].cache_line = cache_lines_create(_test_cl_size, -1);
+      crawl_slots[s].high_stdev_retry = 0;
+      crawl_slots[s].adaptive_stop = 0;
+      crawl_slots[s].n_samples = 0;
+      barriers2[s] = barrier2_create();
+    }
+
+  pthread_barrier_t barrier_all;
+  pthread_barrier_init(&barrier_all, NULL, n_threads);
+  pthread_barrier_init(&crawl_pool_barrier, NULL, n_threads + 1);
+  pthread_t threads[n_threads];
+  tld_t tds[n_threads];
+  for (uint t = 0; t < n_threads; t++)
+    {
+      tds[t].id = t;
+      tds[t].n_threads = n_threads;
+      tds[t].barrier = &barrier_all;
+      tds[t].barrier2 = barriers2[t >> 1];
+      int rc = pthread_create(&threads[t], attr, crawl_parallel, tds + t);
+      if (rc)
+	{
+	  printf("ERROR; return code from pthread_create() is %d\n", rc);
+	  exit(-1);
+	}
+    }
+
+  if (test_infer)
+    {
+      infer_n_measured = crawl_infer(test_num_hw_ctx, test_num_sockets, test_cdf_cluster_offset,
+				     lat_table, crawl_infer_measure, hwc_node);
+    }
+  else
+    {
+      crawl_sched_t* cs = crawl_sched_create_masked(test_num_hw_ctx, hwc_node, test_num_parallel, crawl_done);
+      assert(test_resume || crawl_sched_validate(cs, hwc_node));
+      VERBOSE(crawl_sched_print(cs););
+      crawl_parallel_measure(cs);
+      crawl_sched_free(cs);
+    }
+  crawl_schedule = NULL;	/* terminates the crawl threads */
+  pthread_barrier_wait(&crawl_pool_barrier);
+
+  for (uint t = 0; t < n_threads; t++)
+    {
+      void* status;
+      int rc = pthread_join(threads[t], &status);
+      if (rc)
+	{
+	  printf("ERROR; return code from pthread_join() is %d\n", rc);
+	  exit(-1);
+	}
+    }
+
+  for (uint s = 0; s < test_num_parallel; s++)
+    {
+      adaptive_n_samples += crawl_slots[s].n_samples;
+      cache_lines_destroy(crawl_slots[s].cache_line, _test_cl_size, 0);
+      free(barriers2[s]);
+    }
+  pthread_barrier_destroy(&crawl_pool_barrier);
+  pthread_barrier_destroy(&barrier_all);
+  free(barriers2);
+  free(crawl_slots);
+  free(hwc_node);
+}
+
 int
 main(int argc, char **argv)
 {
@@ -621,6 +1057,11 @@ main(int argc, char **argv)
       {"repetitions",               required_argument, NULL, 'r'},
       {"format",                    required_argument, NULL, 'f'},
       {"augment",                   no_argument,       NULL, 'a'},
+      {"parallel",                  required_argument, NULL, 'p'},
+      {"early-stop",                no_argument,       NULL, 'e'},
+      {"infer",                     no_argument,       NULL, 'I'},
+      {"checkpoint",                required_argument, NULL, 'C'},
+      {"resume",                    no_argument,       NULL, 'R'},
       {"verbose",                   no_argument,       NULL, 'v'},
       {NULL, 0, NULL, 0}
     };
@@ -630,7 +1071,7 @@ main(int argc, char **argv)
   while(1)
     {
       i = 0;
-      c = getopt_long(argc, argv, "hvn:c:r:f:s:m:M:i:ad:", long_options, &i);
+      c = getopt_long(argc, argv, "hvn:c:r:f:s:m:M:i:ad:p:eIC:R", long_options, &i);
 
       if(c == -1)
 	break;
@@ -685,6 +1126,21 @@ main(int argc, char **argv)
 		 "  -a, --augment\n"
 		 "        Augment an existing MCT description file with memory measurements (default=" XSTR(DEFAULT_MEM_AUGMENT) ")\n"
 		 "        If the MCT file already contains memory measurements mctop with return w/o any effects.\n"
+		 "  -p, --parallel <int>\n"
+		 "        Measure up to this many hw context pairs concurrently (default=" XSTR(DEFAULT_NUM_PARALLEL) ").\n"
+		 "        Concurrent pairs are always placed on different NUMA nodes. Not compatible with -m1.\n"
+		 "  -e, --early-stop\n"
+		 "        Stop measuring a pair once the 95%% confidence interval of its median is narrower than the\n"
+		 "        cdf offset (-c), instead of always doing all repetitions (default=" XSTR(DEFAULT_ADAPTIVE) ")\n"
+		 "  -I, --infer\n"
+		 "        Measure only representative hw context pairs and infer the latencies of the rest from the\n"
+		 "        groups that they reveal (default=" XSTR(DEFAULT_INFER) "). Pairs whose group is ambiguous are\n"
+		 "        still measured. Assumes a symmetric topology. Not compatible with -m1.\n"
+		 "  -C, --checkpoint <file>\n"
+		 "        Periodically (every " XSTR(CKPT_INTERVAL_SECS) " secs) save the partial latency tables to this file\n"
+		 "  -R, --resume\n"
+		 "        Continue the crawl from the checkpoint file (default file=" DEFAULT_CKPT_FILE "). The settings\n"
+		 "        (e.g., -n, -s) must be the same as in the interrupted run.\n"
 		 ">>> AUXILLIARY SETTINGS\n"
 		 "  -h, --help\n"
 		 "        Print this message\n"
@@ -722,6 +1178,21 @@ main(int argc, char **argv)
 	case 'a':
 	  test_mem_augment = 1;
 	  break;
+	case 'p':
+	  test_num_parallel = atoi(optarg);
+	  break;
+	case 'e':
+	  test_adaptive = 1;
+	  break;
+	case 'I':
+	  test_infer = 1;
+	  break;
+	case 'C':
+	  test_ckpt_file = optarg;
+	  break;
+	case 'R':
+	  test_resume = 1;
+	  break;
 	case 'v':
 	  test_verbose = 1;
 	  break;
@@ -734,6 +1205,10 @@ main(int argc, char **argv)
     }
 
   test_mem_bw_size *= DEFAULT_MEM_BW_MULTI;
+  if (test_resume && test_ckpt_file == NULL)
+    {
+      test_ckpt_file = DEFAULT_CKPT_FILE;
+    }
   test_num_warmup_reps = test_num_reps >> 4;
   test_max_stdev_max = 2 * test_max_stdev;
 
@@ -753,6 +1228,20 @@ main(int argc, char **argv)
 	}
     }
 
+  if (test_num_parallel > (test_num_hw_ctx / 2))
+    {
+      test_num_parallel = test_num_hw_ctx / 2;
+    }
+  if (test_num_parallel < 1)
+    {
+      test_num_parallel = 1;
+    }
+  if ((test_num_parallel > 1 || test_infer) && test_do_mem == ON_TIME)
+    {
+      fprintf(stderr, "MCTOP Warning: Parallel crawl cannot measure mem. latencies on time. Using -m%d.\n", ON_TOPO);
+      test_do_mem = ON_TOPO;
+    }
+
   char hostname[50];
   if (gethostname(hostname, 50) != 0)
     {
@@ -765,7 +1254,7 @@ main(int argc, char **argv)
   printf("#   Output         : %s\n", test_format_desc[test_format]);
   if (!test_mem_augment)
     {
-      printf("#   Repetitions    : %zu\n", test_num_reps);
+      printf("#   Repetitions    : %zu%s\n", test_num_reps, test_adaptive ? " (max, early stopping)" : "");
       printf("#   Do-memory      : %s\n", mctop_test_mem_type_desc[test_do_mem]);
       printf("#   Mem. size bw   : %zu MB\n", (size_t) (test_mem_bw_size / DEFAULT_MEM_BW_MULTI));
       printf("#   Cluster-offset : %zu\n", test_cdf_cluster_offset);
@@ -773,6 +1262,9 @@ main(int argc, char **argv)
       printf("#   # Cores        : %d\n", test_num_hw_ctx);
       printf("#   # Sockets      : %d\n", test_num_sockets);
       printf("#   # Hint         : %d clusters\n", test_num_clusters_hint);
+      printf("#   # Parallel     : %u pairs\n", test_num_parallel);
+      printf("#   Infer          : %s\n", test_infer ? "representative pairs" : "no (all pairs)");
+      printf("#   Checkpoint     : %s%s\n", test_ckpt_file ? test_ckpt_file : "no", test_resume ? " (resume)" : "");
       printf("#   CPU DVFS       : %d (Freq. up in %zu ms)\n", test_dvfs, !test_dvfs ? 0 : (size_t) dvfs_up_dur);
       printf("# Progress : %6.1f%%", 0.0); fflush(stdout);
     }
@@ -830,37 +1322,70 @@ main(int argc, char **argv)
     {
       mem_lat_table = (ticks**) table_calloc(test_num_hw_ctx, test_num_sockets, sizeof(ticks));
     }
+  crawl_done = calloc_assert(test_num_hw_ctx * test_num_hw_ctx, sizeof(uint8_t));
+  if (!test_mem_augment && test_resume)
+    {
+      const size_t n_restored = ckpt_read();
+      printf("\r# Checkpoint : restored %zu of %d pairs from %s\n", n_restored,
+	     (test_num_hw_ctx * (test_num_hw_ctx - 1)) / 2, test_ckpt_file);
+    }
+  ckpt_last = time(NULL);
 
   mctop_t* topo = NULL;
 
   if (!test_mem_augment)
     {
-      for(int t = 0; t < test_num_threads; t++)
+      if (test_num_parallel > 1 || test_infer)
 	{
-	  tds[t].id = t;
-	  tds[t].n_threads = test_num_threads;
-	  tds[t].barrier = barrier;
-	  tds[t].barrier2 = barrier2;
-	  int rc = pthread_create(&threads[t], &attr, crawl, tds + t);
-	  if (rc)
+	  crawl_parallel_run(&attr);
+	}
+      else
+	{
+	  for(int t = 0; t < test_num_threads; t++)
 	    {
-	      printf("ERROR; return code from pthread_create() is %d\n", rc);
-	      exit(-1);
+	      tds[t].id = t;
+	      tds[t].n_threads = test_num_threads;
+	      tds[t].barrier = barrier;
+	      tds[t].barrier2 = barrier2;
+	      int rc = pthread_create(&threads[t], &attr, crawl, tds + t);
+	      if (rc)
+		{
+		  printf("ERROR; return code from pthread_create() is %d\n", rc);
+		  exit(-1);
+		}
 	    }
-	}
-    
     
-      for(int t = 0; t < test_num_threads; t++) 
-	{
-	  void* status;
-	  int rc = pthread_join(threads[t], &status);
-	  if (rc) 
+	  for(int t = 0; t < test_num_threads; t++) 
 	    {
-	      printf("ERROR; return code from pthread_join() is %d\n", rc);
-	      exit(-1);
+	      void* status;
+	      int rc = pthread_join(threads[t], &status);
+	      if (rc) 
+		{
+		  printf("ERROR; return code from pthread_join() is %d\n", rc);
+		  exit(-1);
+		}
 	    }
 	}
 
+      if (test_ckpt_file != NULL)
+	{
+	  ckpt_write(test_num_hw_ctx); /* a resumed complete crawl skips all measurements */
+	}
+
+      const size_t n_pairs_all = (test_num_hw_ctx * (test_num_hw_ctx - 1)) / 2;
+      if (test_infer)
+	{
+	  printf("## Inference: measured %zu of the %zu pairs (%.1f%%)\n",
+		 infer_n_measured, n_pairs_all, (100.0 * infer_n_measured) / n_pairs_all);
+	}
+      if (test_adaptive)
+	{
+	  const size_t n_pairs = test_infer ? infer_n_measured : n_pairs_all;
+	  const size_t n_samples_max = test_num_reps * n_pairs;
+	  printf("## Early stopping: %zu samples (%.1f%% of the %zu without early stopping)\n",
+		 adaptive_n_samples, (100.0 * adaptive_n_samples) / n_samples_max, n_samples_max);
+	}
+
       if (test_format != MCT_FILE)
 	{
 	  print_lat_table(lat_table, test_num_hw_ctx, test_num_sockets, test_format, AR_1D, 0, hostname);
@@ -1067,6 +1592,7 @@ main(int argc, char **argv)
   free(tds);
   free(barrier2);
   free(lat_table);
+  free(crawl_done);
 #endif
 }
 
@@ -1,6 +1,7 @@
 #include <mctop_alloc.h>
 #include <mctop_internal.h>
 #include <darray.h>
+#include <limits.h>
 
 #define likely(x)       __builtin_expect(!!(x), 1)
 #define unlikely(x)     __builtin_expect(!!(x), 0)
@@ -620,20 +621,19 @@ mctop_alloc_create_config(mctop_t* topo, const int n_hwcs, const int n_config, m
       alloc->n_cores_per_socket = calloc_assert(topo->n_sockets, sizeof(uint));
       mctop_alloc_details_calc(alloc, &alloc->n_cores, alloc->n_hwcs_per_socket, alloc->n_cores_per_socket);
 
-      alloc->socket_barriers = malloc_assert(topo->n_sockets * sizeof(mctop_barrier_t*));
+      alloc->socket_barriers = malloc_assert(topo->n_sockets * sizeof(mctop_tbarrier_t*));
       alloc->socket_barriers_cores = malloc_assert(topo->n_sockets * sizeof(mctop_barrier_t*));
       
       alloc->node_to_nth_socket = calloc_assert(topo->n_sockets, sizeof(uint));
       for (int i = 0; i < alloc->n_sockets; i++)
 	{
 	  alloc->node_to_nth_socket[i] = alloc->sockets[i]->local_node;
-	  alloc->socket_barriers[i] = numa_alloc_onnode(sizeof(mctop_barrier_t),
-							alloc->sockets[i]->local_node);
-	  mctop_barrier_init(alloc->socket_barriers[i], alloc->n_hwcs_per_socket[i]);
+	  alloc->socket_barriers[i] = mctop_tbarrier_create(alloc, i);
 	  alloc->socket_barriers_cores[i] = numa_alloc_onnode(sizeof(mctop_barrier_t),
 							      alloc->sockets[i]->local_node);
 	  mctop_barrier_init(alloc->socket_barriers_cores[i], alloc->n_cores_per_socket[i]);
 	}
+      alloc->global_tbarrier = mctop_tbarrier_create(alloc, -1);
 
       
       if (topo->pow_info != NULL)
@@ -817,10 +817,14 @@ mctop_alloc_free(mctop_alloc_t* alloc)
     {
       for (int i = 0; i < alloc->n_sockets; i++)
 	{
-	  numa_free(alloc->socket_barriers[i], sizeof(mctop_barrier_t));
+	  mctop_tbarrier_free(alloc->socket_barriers[i]);
 	}
       free(alloc->socket_barriers);
     }
+  if (alloc->global_tbarrier != NULL)
+    {
+      mctop_tbarrier_free(alloc->global_tbarrier);
+    }
   if (alloc->socket_barriers_cores != NULL)
     {
       for (int i = 0; i < alloc->n_sockets; i++)
@@ -1365,10 +1369,184 @@ mctop_alloc_malloc_free(void* mem, const size_t size)
 
 /* barrier ******************************************************************************* */
 
+static mctop_tbarrier_node_t*
+mctop_tbarrier_node_create(mctop_tbarrier_t* b, uint* socket_used, const uint nth,
+			   mctop_tbarrier_node_t* parent)
+{
+  assert(socket_used[nth] < b->socket_n_nodes[nth]);
+  mctop_tbarrier_node_t* node = &b->socket_nodes[nth][socket_used[nth]++];
+  node->arrived = 0;
+  node->n_arrive = 0;
+  node->episode = 0;
+  node->n_sleeping = 0;
+  node->parent = parent;
+  if (parent != NULL)
+    {
+      parent->n_arrive++;
+    }
+  b->nodes[b->n_nodes++] = node;
+  return node;
+}
+
+mctop_tbarrier_t*
+mctop_tbarrier_create(mctop_alloc_t* alloc, const int nth)
+{
+  mctop_tbarrier_t* b = malloc_assert(sizeof(mctop_tbarrier_t));
+  b->n_threads = 0;
+  b->n_nodes = 0;
+  b->nodes = malloc_assert((alloc->n_hwcs + alloc->n_sockets + 1) * sizeof(mctop_tbarrier_node_t*));
+  b->leaves = calloc_assert(alloc->n_hwcs, sizeof(mctop_tbarrier_node_t*));
+
+  /* at most one node per socket, one per core, and the root on the first socket */
+  b->n_sockets = alloc->n_sockets;
+  b->socket_nodes = calloc_assert(alloc->n_sockets, sizeof(mctop_tbarrier_node_t*));
+  b->socket_n_nodes = calloc_assert(alloc->n_sockets, sizeof(uint));
+  uint* socket_used = calloc_assert(alloc->n_sockets, sizeof(uint));
+  for (uint s = 0; s < alloc->n_sockets; s++)
+    {
+      if (nth < 0 || s == nth)
+	{
+	  b->socket_n_nodes[s] = 1 + alloc->n_cores_per_socket[s] + (s == 0 && nth < 0);
+	  b->socket_nodes[s] = mctop_alloc_malloc_on_nth_socket(alloc, s, b->socket_n_nodes[s] *
+								sizeof(mctop_tbarrier_node_t));
+	}
+    }
+
+  uint* sockets = malloc_assert(alloc->n_hwcs * sizeof(uint));
+  uint* core_n = calloc_assert(alloc->n_cores, sizeof(uint));
+  mctop_tbarrier_node_t** cores = calloc_assert(alloc->n_cores, sizeof(mctop_tbarrier_node_t*));
+  mctop_tbarrier_node_t** socks = calloc_assert(alloc->n_sockets, sizeof(mctop_tbarrier_node_t*));
+  for (uint i = 0; i < alloc->n_hwcs; i++)
+    {
+      socket_t* socket = mctop_hwcid_get_socket(alloc->topo, alloc->hwcs[i]);
+      sockets[i] = mctop_alloc_socket_seq_id(alloc, socket->id);
+      if (nth < 0 || sockets[i] == nth)
+	{
+	  core_n[alloc->core_sids[i]]++;
+	}
+    }
+
+  mctop_tbarrier_node_t* root = NULL;
+  if (nth < 0 && alloc->n_sockets > 1)
+    {
+      root = mctop_tbarrier_node_create(b, socket_used, 0, NULL);
+    }
+
+  for (uint i = 0; i < alloc->n_hwcs; i++)
+    {
+      const uint s = sockets[i], c = alloc->core_sids[i];
+      if (nth >= 0 && s != nth)
+	{
+	  continue;
+	}
+      b->n_threads++;
+
+      if (socks[s] == NULL)
+	{
+	  socks[s] = mctop_tbarrier_node_create(b, socket_used, s, root);
+	}
+      if (core_n[c] == 1)	/* no SMT siblings in the barrier: arrive at the socket */
+	{
+	  b->leaves[i] = socks[s];
+	  socks[s]->n_arrive++;
+	}
+      else
+	{
+	  if (cores[c] == NULL)
+	    {
+	      cores[c] = mctop_tbarrier_node_create(b, socket_used, s, socks[s]);
+	    }
+	  b->leaves[i] = cores[c];
+	  cores[c]->n_arrive++;
+	}
+    }
+
+  const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  for (uint i = 0; i < b->n_nodes; i++)
+    {
+      b->nodes[i]->spins = (n_cpus > 0 && n_cpus < b->n_threads) ? 0 : MCTOP_TBARRIER_SPINS;
+    }
+
+  free(socket_used);
+  free(socks);
+  free(cores);
+  free(core_n);
+  free(sockets);
+  return b;
+}
+
+void
+mctop_tbarrier_free(mctop_tbarrier_t* b)
+{
+  for (uint s = 0; s < b->n_sockets; s++)
+    {
+      if (b->socket_nodes[s] != NULL)
+	{
+	  mctop_alloc_malloc_free(b->socket_nodes[s], b->socket_n_nodes[s] * sizeof(mctop_tbarrier_node_t));
+	}
+    }
+  free(b->socket_n_nodes);
+  free(b->socket_nodes);
+  free(b->nodes);
+  free(b->leaves);
+  free(b);
+}
+
+static void
+mctop_tbarrier_arrive(mctop_tbarrier_node_t* node)
+{
+  const uint32_t episode = __atomic_load_n(&node->episode, __ATOMIC_ACQUIRE);
+  if (__atomic_add_fetch(&node->arrived, 1, __ATOMIC_ACQ_REL) == node->n_arrive)
+    {
+      node->arrived = 0;
+      if (node->parent != NULL)
+	{
+	  mctop_tbarrier_arrive(node->parent);
+	}
+      __atomic_store_n(&node->episode, episode + 1, __ATOMIC_SEQ_CST);
+      if (__atomic_load_n(&node->n_sleeping, __ATOMIC_SEQ_CST) > 0)
+	{
+	  mctop_futex_wake(&node->episode, INT_MAX);
+	}
+    }
+  else
+    {
+      uint spins = 0;
+      while (__atomic_load_n(&node->episode, __ATOMIC_ACQUIRE) == episode)
+	{
+	  if (spins++ < node->spins)
+	    {
+	      PAUSE();
+	    }
+	  else
+	    {
+	      __atomic_add_fetch(&node->n_sleeping, 1, __ATOMIC_SEQ_CST);
+	      mctop_futex_wait(&node->episode, episode);
+	      __atomic_sub_fetch(&node->n_sleeping, 1, __ATOMIC_SEQ_CST);
+	    }
+	}
+    }
+}
+
+void
+mctop_tbarrier_wait(mctop_tbarrier_t* b, const uint id)
+{
+  mctop_tbarrier_arrive(b->leaves[id]);
+}
+
 void
 mctop_alloc_barrier_wait_all(mctop_alloc_t* alloc)
 {
-  mctop_barrier_wait(alloc->global_barrier);
+  if (alloc->global_tbarrier != NULL && mctop_alloc_thread_is_pinned())
+    {
+      mctop_tbarrier_wait(alloc->global_tbarrier, mctop_alloc_thread_id());
+    }
+  else
+    {
+      /* the pinned threads would be waiting on the topology barrier */
+      assert(alloc->global_tbarrier == NULL || alloc->n_hwcs_used == 0);
+      mctop_barrier_wait(alloc->global_barrier);
+    }
 }
 
 void
@@ -1377,7 +1555,7 @@ mctop_alloc_barrier_wait_node(mctop_alloc_t* alloc)
   if (mctop_alloc_thread_is_pinned())
     {
       const uint on = mctop_alloc_thread_node_id();
-      mctop_barrier_wait(alloc->socket_barriers[on]);
+      mctop_tbarrier_wait(alloc->socket_barriers[on], mctop_alloc_thread_id());
     }
 }
 
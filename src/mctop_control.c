@@ -1,5 +1,6 @@
 #include <mctop.h>
 #include <darray.h>
+#include <atomics.h>
 #ifdef __x86_64__
 #  include <numa.h>
 #endif
@@ -274,7 +275,7 @@ mctop_hwcid_fix_numa_node(mctop_t* topo, const uint hwcid)
   /* printf("# HWID %-3u, SOCKET %-3u, numa_set_preferred(%u)\n", */
   /* 	     hwcid, hwc->socket->id, hwc->socket->local_node); */
   hw_context_t* hwc = &topo->hwcs[hwcid];
-  const uint correct_node = hwc->socket->local_node;
+  const uint correct_node = topo->flat.node[hwcid];
   if (unlikely(hwc->local_node_wrong || correct_node != numa_preferred()))
     {
       numa_set_preferred(correct_node);
@@ -284,79 +285,42 @@ mctop_hwcid_fix_numa_node(mctop_t* topo, const uint hwcid)
   return 0;
 }
 
+/* served from the flat view (topo->flat) */
+
 inline uint
 mctop_hwcid_get_local_node(mctop_t* topo, uint hwcid)
 {
-  return mctop_hwcid_get_socket(topo, hwcid)->local_node;
+  return topo->flat.node[hwcid];
 }
 
 inline socket_t*
 mctop_hwcid_get_socket(mctop_t* topo, uint hwcid)
 {
-  return topo->hwcs[hwcid].socket;
+  return topo->sockets + topo->flat.socket[hwcid];
 }
 
-hwc_gs_t*
+inline hwc_gs_t*
 mctop_hwcid_get_core(mctop_t* topo, const uint hwcid)
 {
-  hw_context_t* hwc = &topo->hwcs[hwcid];
-  if (hwc->type == CORE)
-    {
-      return (hwc_gs_t*) hwc;
-    }
-  else
-    {
-      return hwc->parent;
-    }
+  return topo->flat.core[hwcid];
 }
 
-uint
+inline uint
 mctop_hwcid_get_nth_hwc_in_socket(mctop_t* topo, const uint hwcid)
 {
-  socket_t* socket = mctop_hwcid_get_socket(topo, hwcid);
-  hw_context_t* hwc_first = mctop_socket_get_first_hwc(socket);
-  uint i = 0;
-  while (hwc_first && hwc_first->id != hwcid)
-    {
-      i++;
-      hwc_first = hwc_first->next;
-    }
-
-  return i;
+  return topo->flat.nth_in_socket[hwcid];
 }
 
-uint
+inline uint
 mctop_hwcid_get_nth_hwc_in_core(mctop_t* topo, const uint hwcid)
 {
-  hw_context_t* hwc = &topo->hwcs[hwcid];
-  if (hwc->type == CORE)
-    {
-      return 0;
-    }
-  hwc_gs_t* core = hwc->parent;
-  for (int i = 0; i < core->n_hwcs; i++)
-    {
-      if (core->hwcs[i]->id == hwc->id)
-	{
-	  return i;
-	}
-    }
-  assert(0);
+  return topo->flat.nth_in_core[hwcid];
 }
 
-uint
+inline uint
 mctop_hwcid_get_nth_core_in_socket(mctop_t* topo, const uint hwcid)
 {
-  hwc_gs_t* core = mctop_hwcid_get_core(topo, hwcid);
-  hwc_gs_t* core_first = mctop_socket_get_first_gs_core(core->socket);
-  uint i = 0;
-  while (core_first && core->id != core_first->id)
-    {
-      i++;
-      core_first = core_first->next;
-    }
-
-  return i;
+  return topo->flat.nth_core_in_socket[hwcid];
 }
 
 
@@ -397,33 +361,18 @@ mctop_id_get_hwc_gs(mctop_t* topo, const uint id)
     {
       gs = (hwc_gs_t*) &topo->sockets[mctop_id_no_lvl(id)];
     }
-  else
+  else if (lvl < topo->socket_level && mctop_id_no_lvl(id) < topo->n_hwcs)
     {
-      hwc_gs_t* _gs = mctop_get_first_gs_at_lvl(topo, lvl);
-      while (_gs != NULL)
-	{
-	  if (unlikely(_gs->id == id))
-	    {
-	      gs = _gs;
-	      break;
-	    }
-	  _gs = _gs->next;
-	}
+      gs = topo->gs_index[(lvl - 1) * topo->n_hwcs + mctop_id_no_lvl(id)];
     }
 
   return gs;
 }
 
+/* latency by walking up the hierarchy; only used to fill in topo->lat_table */
 uint
-mctop_ids_get_latency(mctop_t* topo, const uint id0, const uint id1)
+mctop_gs_get_latency_walk(mctop_t* topo, hwc_gs_t* gs0, hwc_gs_t* gs1)
 {
-  hwc_gs_t* gs0 = mctop_id_get_hwc_gs(topo, id0);
-  hwc_gs_t* gs1 = mctop_id_get_hwc_gs(topo, id1);
-  if (gs0 == NULL || gs1 == NULL)
-    {
-      return 0;
-    }
-
   while (gs0->level < gs1->level)
     {
       gs0 = gs0->parent;
@@ -460,6 +409,122 @@ mctop_ids_get_latency(mctop_t* topo, const uint id0, const uint id1)
   return sibling->latency;
 }
 
+uint
+mctop_ids_get_latency(mctop_t* topo, const uint id0, const uint id1)
+{
+  const uint n_hwcs = topo->n_hwcs;
+  if (likely(id0 < n_hwcs && id1 < n_hwcs))
+    {
+      return topo->lat_table[id0 * n_hwcs + id1];
+    }
+
+  hwc_gs_t* gs0 = mctop_id_get_hwc_gs(topo, id0);
+  hwc_gs_t* gs1 = mctop_id_get_hwc_gs(topo, id1);
+  if (gs0 == NULL || gs1 == NULL)
+    {
+      return 0;
+    }
+
+  while (gs0->level < gs1->level)
+    {
+      gs0 = gs0->parent;
+    }
+  while (gs1->level < gs0->level)
+    {
+      gs1 = gs1->parent;
+    }
+
+  if (gs0 == gs1)
+    {
+      return gs0->latency;
+    }
+
+  /* two different groups of the same lvl: as any pair of their hwcs */
+  return topo->lat_table[gs0->hwcs[0]->id * n_hwcs + gs1->hwcs[0]->id];
+}
+
+/* lowest lvl whose latency covers the latency of the two ids */
+uint
+mctop_ids_get_level(mctop_t* topo, const uint id0, const uint id1)
+{
+  const uint lat = mctop_ids_get_latency(topo, id0, id1);
+  for (uint l = 0; l < topo->n_levels; l++)
+    {
+      if (topo->latencies[l] >= lat)
+	{
+	  return l;
+	}
+    }
+  return topo->n_levels - 1;
+}
+
+/* backoff ************************************************************************ */
+
+/* A waiter should not poll a line faster than the line can travel from the other hwc, thus
+   the quantum is the latency of the lvl, but at least the latency of the cache the transfer
+   is served from: L1 within a hwc, LLC within a socket. The exponential growth stops at one
+   quantum per hwc that can contend at that distance. */
+mctop_backoff_t
+mctop_backoff_get(mctop_t* topo, const uint level)
+{
+  const uint l = (level < topo->n_levels) ? level : (topo->n_levels - 1);
+  uint quantum = topo->latencies[l];
+
+  if (topo->cache != NULL && l <= topo->socket_level)
+    {
+      const uint cl = (l == 0) ? L1D : (topo->cache->n_levels - 1);
+      const uint clat = topo->cache->latencies[cl];
+      if (quantum < clat)
+	{
+	  quantum = clat;
+	}
+    }
+  if (quantum == 0)
+    {
+      quantum = 1;
+    }
+
+  uint n_contenders = topo->n_hwcs;
+  if (l == 0)
+    {
+      n_contenders = 1;
+    }
+  else if (l <= topo->socket_level)
+    {
+      n_contenders = mctop_get_first_gs_at_lvl(topo, l)->n_hwcs;
+    }
+
+  mctop_backoff_t b = { .quantum = quantum, .max = quantum * n_contenders, .cur = quantum };
+  return b;
+}
+
+mctop_backoff_t
+mctop_backoff_get_ids(mctop_t* topo, const uint hwc_waiter, const uint hwc_owner)
+{
+  return mctop_backoff_get(topo, mctop_ids_get_level(topo, hwc_waiter, hwc_owner));
+}
+
+void
+mctop_backoff_reset(mctop_backoff_t* b)
+{
+  b->cur = b->quantum;
+}
+
+void
+mctop_backoff_wait(mctop_backoff_t* b)
+{
+  const mctop_ticks until = mctop_getticks() + b->cur;
+  while (mctop_getticks() < until)
+    {
+      PAUSE();
+    }
+  b->cur <<= 1;
+  if (b->cur > b->max)
+    {
+      b->cur = b->max;
+    }
+}
+
 
 
 /* pining ************************************************************************ */
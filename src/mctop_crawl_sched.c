@@ -0,0 +1,683 @@
+#include <mctop.h>
+#include <mctop_internal.h>
+#include <mctop_crawl_sched.h>
+#include <darray.h>
+
+static uint
+crawl_sched_num_nodes(const uint n_hwcs, const int* hwc_node)
+{
+  int max = 0;
+  for (uint h = 0; h < n_hwcs; h++)
+    {
+      assert(hwc_node[h] >= 0);
+      if (hwc_node[h] > max)
+	{
+	  max = hwc_node[h];
+	}
+    }
+  return max + 1;
+}
+
+static crawl_batch_t*
+crawl_sched_batch_add(crawl_sched_t* cs)
+{
+  cs->batches = realloc_assert(cs->batches, (cs->n_batches + 1) * sizeof(crawl_batch_t));
+  crawl_batch_t* cb = &cs->batches[cs->n_batches++];
+  cb->n_pairs = 0;
+  cb->pairs = malloc_assert(cs->max_pairs * sizeof(crawl_pair_t));
+  return cb;
+}
+
+static crawl_sched_t*
+crawl_sched_new(const uint n_hwcs, const uint max_pairs)
+{
+  crawl_sched_t* cs = calloc_assert(1, sizeof(crawl_sched_t));
+  cs->n_hwcs = n_hwcs;
+  cs->max_pairs = (max_pairs > 0) ? max_pairs : 1;
+  return cs;
+}
+
+/* Packs the pairs first fit into new batches, so that pairs of a batch do not share a node.
+   Only the CRAWL_SCHED_FIT_WINDOW oldest non-full batches are searched, which keeps packing
+   long lists linear. */
+#define CRAWL_SCHED_FIT_WINDOW 64
+
+static void
+crawl_sched_pack(crawl_sched_t* cs, const crawl_pair_t* pairs, const uint n_pairs,
+		 const int* hwc_node, const uint n_nodes)
+{
+  const uint first_batch = cs->n_batches;
+  uint first_open = first_batch;
+  uint8_t* used = NULL;		/* node usage of the new batches */
+
+  for (uint k = 0; k < n_pairs; k++)
+    {
+      crawl_pair_t p = pairs[k];
+      if (p.x > p.y)
+	{
+	  p.x = pairs[k].y;
+	  p.y = pairs[k].x;
+	}
+      const int nx = hwc_node[p.x], ny = hwc_node[p.y];
+
+      while (first_open < cs->n_batches && cs->batches[first_open].n_pairs == cs->max_pairs)
+	{
+	  first_open++;
+	}
+
+      crawl_batch_t* cb = NULL;
+      uint8_t* cb_used = NULL;
+      const uint last = ((cs->n_batches - first_open) > CRAWL_SCHED_FIT_WINDOW) ?
+	(first_open + CRAWL_SCHED_FIT_WINDOW) : cs->n_batches;
+      for (uint i = first_open; i < last; i++)
+	{
+	  uint8_t* u = used + (i - first_batch) * n_nodes;
+	  if (cs->batches[i].n_pairs < cs->max_pairs && !u[nx] && !u[ny])
+	    {
+	      cb = &cs->batches[i];
+	      cb_used = u;
+	      break;
+	    }
+	}
+      if (cb == NULL)
+	{
+	  cb = crawl_sched_batch_add(cs);
+	  used = realloc_assert(used, (cs->n_batches - first_batch) * n_nodes * sizeof(uint8_t));
+	  cb_used = used + (cs->n_batches - 1 - first_batch) * n_nodes;
+	  memset(cb_used, 0, n_nodes * sizeof(uint8_t));
+	}
+
+      cb->pairs[cb->n_pairs++] = p;
+      cb_used[nx] = cb_used[ny] = 1;
+      cs->n_pairs++;
+    }
+
+  free(used);
+}
+
+crawl_sched_t*
+crawl_sched_create(const uint n_hwcs, const int* hwc_node, const uint max_pairs)
+{
+  return crawl_sched_create_masked(n_hwcs, hwc_node, max_pairs, NULL);
+}
+
+crawl_sched_t*
+crawl_sched_create_masked(const uint n_hwcs, const int* hwc_node, const uint max_pairs,
+			  const uint8_t* done)
+{
+  crawl_sched_t* cs = crawl_sched_new(n_hwcs, max_pairs);
+  const uint n_nodes = crawl_sched_num_nodes(n_hwcs, hwc_node);
+  const uint m = n_hwcs + (n_hwcs & 0x1); /* one bye player if odd */
+  if (m < 2)
+    {
+      return cs;
+    }
+
+  crawl_pair_t* round = malloc_assert((m / 2) * sizeof(crawl_pair_t));
+  for (uint r = 0; r < (m - 1); r++)
+    {
+      uint n_round = 0;
+      for (uint k = 0; k < (m / 2); k++)
+	{
+	  uint a, b;
+	  if (k == 0)
+	    {
+	      a = r;
+	      b = m - 1;
+	    }
+	  else
+	    {
+	      a = (r + k) % (m - 1);
+	      b = (r + (m - 1) - k) % (m - 1);
+	    }
+
+	  if (a >= n_hwcs || b >= n_hwcs)
+	    {
+	      continue;		/* bye */
+	    }
+	  if (done != NULL && done[a * n_hwcs + b])
+	    {
+	      continue;
+	    }
+
+	  round[n_round].x = (a < b) ? a : b;
+	  round[n_round].y = (a < b) ? b : a;
+	  n_round++;
+	}
+
+      /* batches never mix pairs of different rounds */
+      crawl_sched_pack(cs, round, n_round, hwc_node, n_nodes);
+    }
+
+  free(round);
+  return cs;
+}
+
+crawl_sched_t*
+crawl_sched_create_pairs(const uint n_hwcs, const int* hwc_node, const uint max_pairs,
+			 const crawl_pair_t* pairs, const uint n_pairs)
+{
+  crawl_sched_t* cs = crawl_sched_new(n_hwcs, max_pairs);
+  const uint n_nodes = crawl_sched_num_nodes(n_hwcs, hwc_node);
+  crawl_sched_pack(cs, pairs, n_pairs, hwc_node, n_nodes);
+  return cs;
+}
+
+void
+crawl_sched_free(crawl_sched_t* cs)
+{
+  for (uint i = 0; i < cs->n_batches; i++)
+    {
+      free(cs->batches[i].pairs);
+    }
+  free(cs->batches);
+  free(cs);
+}
+
+void
+crawl_sched_print(crawl_sched_t* cs)
+{
+  printf("## Crawl schedule: %u pairs in %u batches (max %u pairs / batch)\n",
+	 cs->n_pairs, cs->n_batches, cs->max_pairs);
+  for (uint i = 0; i < cs->n_batches; i++)
+    {
+      crawl_batch_t* cb = &cs->batches[i];
+      printf("#%-5u: ", i);
+      for (uint p = 0; p < cb->n_pairs; p++)
+	{
+	  printf("(%3d,%3d) ", cb->pairs[p].x, cb->pairs[p].y);
+	}
+      printf("\n");
+    }
+}
+
+crawl_batch_t*
+crawl_sched_next(crawl_sched_t* cs)
+{
+  if (cs->next < cs->n_batches)
+    {
+      return &cs->batches[cs->next++];
+    }
+  return NULL;
+}
+
+int
+crawl_sched_validate(crawl_sched_t* cs, const int* hwc_node)
+{
+  const uint n = cs->n_hwcs;
+  const uint n_nodes = crawl_sched_num_nodes(n, hwc_node);
+  uint8_t** seen = (uint8_t**) table_calloc(n, n, sizeof(uint8_t));
+  uint8_t* used = malloc_assert(n_nodes * sizeof(uint8_t));
+  int correct = 1;
+
+  for (uint i = 0; correct && i < cs->n_batches; i++)
+    {
+      crawl_batch_t* cb = &cs->batches[i];
+      memset(used, 0, n_nodes * sizeof(uint8_t));
+      for (uint p = 0; p < cb->n_pairs; p++)
+	{
+	  const int x = cb->pairs[p].x, y = cb->pairs[p].y;
+	  if (x >= y || y >= n || seen[x][y]++)
+	    {
+	      fprintf(stderr, "MCTOP Error: Pair (%d, %d) is invalid or scheduled twice!\n", x, y);
+	      correct = 0;
+	      break;
+	    }
+	  const int nx = hwc_node[x], ny = hwc_node[y];
+	  if (used[nx] || used[ny])
+	    {
+	      fprintf(stderr, "MCTOP Error: Batch %u uses node %d or %d twice!\n", i, nx, ny);
+	      correct = 0;
+	      break;
+	    }
+	  used[nx] = used[ny] = 1;
+	}
+    }
+
+  for (uint x = 0; correct && x < n; x++)
+    {
+      for (uint y = x + 1; y < n; y++)
+	{
+	  if (!seen[x][y])
+	    {
+	      fprintf(stderr, "MCTOP Error: Pair (%u, %u) is not scheduled!\n", x, y);
+	      correct = 0;
+	      break;
+	    }
+	}
+    }
+
+  free(used);
+  table_free((void**) seen, n);
+  return correct;
+}
+
+/* ******************************************************************************** */
+/* incremental inference of the latency table */
+/* ******************************************************************************** */
+
+typedef struct crawl_set
+{
+  uint n_hwcs;
+  uint multi_socket;		/* the set is a union of whole sockets */
+  uint* hwcs;
+} crawl_set_t;
+
+typedef struct crawl_infer
+{
+  uint n_hwcs;
+  uint hwc_per_socket;
+  uint offset;
+  uint64_t* lat_table;
+  uint8_t* known;
+  crawl_measure_t measure;
+  void* measure_arg;
+  size_t n_measured;
+  uint n_pairs;
+  uint size_pairs;
+  crawl_pair_t* pairs;
+  darray_t* sockets;		/* crawl_set_t* of the discovered sockets */
+  uint ambiguous;		/* the socket structure could not be inferred */
+} crawl_infer_t;
+
+typedef struct crawl_lat
+{
+  uint64_t lat;
+  uint hwc;
+} crawl_lat_t;
+
+static crawl_set_t*
+crawl_set_new(const uint* hwcs, const uint n_hwcs, const uint multi_socket)
+{
+  crawl_set_t* s = malloc_assert(sizeof(crawl_set_t));
+  s->n_hwcs = n_hwcs;
+  s->multi_socket = multi_socket;
+  s->hwcs = malloc_assert(n_hwcs * sizeof(uint));
+  memcpy(s->hwcs, hwcs, n_hwcs * sizeof(uint));
+  return s;
+}
+
+static void
+crawl_set_free(crawl_set_t* s)
+{
+  free(s->hwcs);
+  free(s);
+}
+
+static inline uint64_t
+crawl_infer_lat(crawl_infer_t* ci, const uint x, const uint y)
+{
+  return ci->lat_table[x * ci->n_hwcs + y];
+}
+
+static inline void
+crawl_infer_lat_set(crawl_infer_t* ci, const uint x, const uint y, const uint64_t lat)
+{
+  ci->lat_table[x * ci->n_hwcs + y] = ci->lat_table[y * ci->n_hwcs + x] = lat;
+  ci->known[x * ci->n_hwcs + y] = ci->known[y * ci->n_hwcs + x] = 1;
+}
+
+static void
+crawl_infer_pair_add(crawl_infer_t* ci, const uint x, const uint y)
+{
+  if (x == y || ci->known[x * ci->n_hwcs + y])
+    {
+      return;
+    }
+  ci->known[x * ci->n_hwcs + y] = ci->known[y * ci->n_hwcs + x] = 1;
+
+  if (ci->n_pairs == ci->size_pairs)
+    {
+      ci->size_pairs = ci->size_pairs ? 2 * ci->size_pairs : ci->n_hwcs;
+      ci->pairs = realloc_assert(ci->pairs, ci->size_pairs * sizeof(crawl_pair_t));
+    }
+  ci->pairs[ci->n_pairs].x = (x < y) ? x : y;
+  ci->pairs[ci->n_pairs].y = (x < y) ? y : x;
+  ci->n_pairs++;
+}
+
+static void
+crawl_infer_flush(crawl_infer_t* ci)
+{
+  if (ci->n_pairs > 0)
+    {
+      ci->measure(ci->pairs, ci->n_pairs, ci->measure_arg);
+      ci->n_measured += ci->n_pairs;
+      ci->n_pairs = 0;
+    }
+}
+
+static int
+crawl_lat_cmp(const void* a, const void* b)
+{
+  const crawl_lat_t* la = (const crawl_lat_t*) a;
+  const crawl_lat_t* lb = (const crawl_lat_t*) b;
+  return (la->lat > lb->lat) - (la->lat < lb->lat);
+}
+
+/* Groups the hw contexts of s by their (already measured) latency to the pivot s->hwcs[0]. On a
+   hierarchical topology, every group holds whole subtrees of the same level, thus the
+   latencies across groups are known: lat(a, b) = lat(pivot, b) if b is further than a. Across
+   sockets, this only holds for the hw contexts of the socket of the pivot. Groups that could
+   still hide more than one level are added to next. */
+static void
+crawl_infer_split(crawl_infer_t* ci, crawl_set_t* s, darray_t* next)
+{
+  const uint p = s->hwcs[0];
+  const uint n = s->n_hwcs - 1;
+  const uint hps = ci->hwc_per_socket;
+
+  crawl_lat_t* ls = malloc_assert(n * sizeof(crawl_lat_t));
+  for (uint i = 0; i < n; i++)
+    {
+      ls[i].hwc = s->hwcs[i + 1];
+      ls[i].lat = crawl_infer_lat(ci, p, ls[i].hwc);
+    }
+  qsort(ls, n, sizeof(crawl_lat_t), crawl_lat_cmp);
+
+  /* groups g are ls[g_start[g] .. g_start[g + 1]) */
+  uint* g_start = malloc_assert((n + 1) * sizeof(uint));
+  uint n_groups = 0;
+  for (uint i = 0; i < n; i++)
+    {
+      if (i == 0 || ls[i].lat > (ls[i - 1].lat + ci->offset))
+	{
+	  g_start[n_groups++] = i;
+	}
+    }
+  g_start[n_groups] = n;
+
+  /* groups of a symmetric hierarchy are multiples of everything closer to the pivot. Groups
+     before n_local belong to the socket of the pivot */
+  uint n_local = n_groups, cum = 1, ambiguous = 0;
+  for (uint g = 0; g < n_groups; g++)
+    {
+      const uint size = g_start[g + 1] - g_start[g];
+      if (!s->multi_socket || g < n_local)
+	{
+	  ambiguous |= (size % cum) != 0;
+	  cum += size;
+	  if (s->multi_socket)
+	    {
+	      ambiguous |= (cum > hps);
+	      if (cum == hps)
+		{
+		  n_local = g + 1;
+		}
+	    }
+	}
+      else
+	{
+	  ambiguous |= (size % hps) != 0;
+	}
+    }
+  ambiguous |= (s->multi_socket && n_local == n_groups); /* no remote group */
+
+  if (ambiguous)
+    {
+      /* measured pair by pair in the end */
+      ci->ambiguous |= s->multi_socket;
+      free(g_start);
+      free(ls);
+      return;
+    }
+
+  if (n_groups == 1)
+    {
+      /* the pivot has no closer hw context, thus (by symmetry) none of them has */
+      for (uint b = 1; b < n; b++)
+	{
+	  for (uint a = 0; a < b; a++)
+	    {
+	      crawl_infer_lat_set(ci, ls[a].hwc, ls[b].hwc, ls[b].lat);
+	    }
+	}
+      free(g_start);
+      free(ls);
+      return;
+    }
+
+  for (uint gb = 1; gb < n_groups; gb++)
+    {
+      const uint ga_end = (gb < n_local) ? gb : n_local;
+      for (uint b = g_start[gb]; b < g_start[gb + 1]; b++)
+	{
+	  for (uint a = 0; a < g_start[ga_end]; a++)
+	    {
+	      crawl_infer_lat_set(ci, ls[a].hwc, ls[b].hwc, ls[b].lat);
+	    }
+	}
+    }
+
+  uint* hwcs = malloc_assert(s->n_hwcs * sizeof(uint));
+  if (s->multi_socket)
+    {
+      hwcs[0] = p;
+      for (uint a = 0; a < g_start[n_local]; a++)
+	{
+	  hwcs[a + 1] = ls[a].hwc;
+	}
+      darray_add(ci->sockets, (uintptr_t) crawl_set_new(hwcs, g_start[n_local] + 1, 0));
+    }
+
+  for (uint g = 0; g < n_groups; g++)
+    {
+      const uint size = g_start[g + 1] - g_start[g];
+      for (uint i = 0; i < size; i++)
+	{
+	  hwcs[i] = ls[g_start[g] + i].hwc;
+	}
+      const uint remote = s->multi_socket && g >= n_local;
+      if (remote && size == hps)
+	{
+	  darray_add(ci->sockets, (uintptr_t) crawl_set_new(hwcs, size, 0));
+	}
+      if (size > 1)
+	{
+	  darray_add(next, (uintptr_t) crawl_set_new(hwcs, size, remote && size > hps));
+	}
+    }
+
+  free(hwcs);
+  free(g_start);
+  free(ls);
+}
+
+size_t
+crawl_infer(const uint n_hwcs, const uint n_sockets, const uint offset, uint64_t* lat_table,
+	    crawl_measure_t measure, void* measure_arg)
+{
+  crawl_infer_t ci =
+    {
+      .n_hwcs = n_hwcs,
+      .hwc_per_socket = (n_sockets > 0 && (n_hwcs % n_sockets) == 0) ? (n_hwcs / n_sockets) : n_hwcs,
+      .offset = offset,
+      .lat_table = lat_table,
+      .known = calloc_assert(n_hwcs * n_hwcs, sizeof(uint8_t)),
+      .measure = measure,
+      .measure_arg = measure_arg,
+      .sockets = darray_create(),
+    };
+
+  uint* all = malloc_assert(n_hwcs * sizeof(uint));
+  for (uint h = 0; h < n_hwcs; h++)
+    {
+      all[h] = h;
+      ci.known[h * n_hwcs + h] = 1;
+    }
+
+  darray_t* cur = darray_create();
+  const uint multi_socket = ci.hwc_per_socket < n_hwcs;
+  darray_add(cur, (uintptr_t) crawl_set_new(all, n_hwcs, multi_socket));
+  if (!multi_socket)
+    {
+      darray_add(ci.sockets, (uintptr_t) crawl_set_new(all, n_hwcs, 0));
+    }
+
+  /* one round per level of the hierarchy: the pivots of all pending sets are measured together */
+  while (darray_get_num_elems(cur) > 0)
+    {
+      DARRAY_FOR_EACH(cur, i)
+	{
+	  crawl_set_t* s = (crawl_set_t*) darray_get(cur, i);
+	  for (uint h = 1; !ci.ambiguous && h < s->n_hwcs; h++)
+	    {
+	      crawl_infer_pair_add(&ci, s->hwcs[0], s->hwcs[h]);
+	    }
+	}
+      crawl_infer_flush(&ci);
+
+      darray_t* next = darray_create();
+      DARRAY_FOR_EACH(cur, i)
+	{
+	  crawl_set_t* s = (crawl_set_t*) darray_get(cur, i);
+	  if (!ci.ambiguous && s->n_hwcs > 2)
+	    {
+	      crawl_infer_split(&ci, s, next);
+	    }
+	  crawl_set_free(s);
+	}
+      darray_free(cur);
+      cur = next;
+    }
+  darray_free(cur);
+
+  /* one representative pair per pair of sockets that are not yet known */
+  const uint n_sock = darray_get_num_elems(ci.sockets);
+  if (!ci.ambiguous)
+    {
+      for (uint a = 0; a < n_sock; a++)
+	{
+	  crawl_set_t* sa = (crawl_set_t*) darray_get(ci.sockets, a);
+	  for (uint b = a + 1; b < n_sock; b++)
+	    {
+	      crawl_set_t* sb = (crawl_set_t*) darray_get(ci.sockets, b);
+	      crawl_infer_pair_add(&ci, sa->hwcs[0], sb->hwcs[0]);
+	    }
+	}
+      crawl_infer_flush(&ci);
+
+      for (uint a = 0; a < n_sock; a++)
+	{
+	  crawl_set_t* sa = (crawl_set_t*) darray_get(ci.sockets, a);
+	  for (uint b = a + 1; b < n_sock; b++)
+	    {
+	      crawl_set_t* sb = (crawl_set_t*) darray_get(ci.sockets, b);
+	      const uint64_t lat = crawl_infer_lat(&ci, sa->hwcs[0], sb->hwcs[0]);
+	      for (uint x = 0; x < sa->n_hwcs; x++)
+		{
+		  for (uint y = 0; y < sb->n_hwcs; y++)
+		    {
+		      if (!ci.known[sa->hwcs[x] * n_hwcs + sb->hwcs[y]])
+			{
+			  crawl_infer_lat_set(&ci, sa->hwcs[x], sb->hwcs[y], lat);
+			}
+		    }
+		}
+	    }
+	}
+    }
+
+  /* whatever could not be inferred is measured */
+  for (uint x = 0; x < n_hwcs; x++)
+    {
+      for (uint y = x + 1; y < n_hwcs; y++)
+	{
+	  crawl_infer_pair_add(&ci, x, y);
+	}
+    }
+  crawl_infer_flush(&ci);
+
+  for (uint a = 0; a < n_sock; a++)
+    {
+      crawl_set_free((crawl_set_t*) darray_get(ci.sockets, a));
+    }
+  darray_free(ci.sockets);
+  free(ci.pairs);
+  free(ci.known);
+  free(all);
+  return ci.n_measured;
+}
+
+/* checkpoints */
+
+#define CRAWL_CKPT_MAGIC "MCTCKPT"
+
+typedef struct crawl_ckpt_hdr
+{
+  char magic[8];
+  uint32_t n_hwcs;
+  uint32_t n_sockets;
+  uint32_t rows_done;
+  uint32_t has_mem;		/* the mem. latency table follows */
+} crawl_ckpt_hdr_t;
+
+int
+crawl_ckpt_write(const char* ckpt_file, const crawl_ckpt_t* ck)
+{
+  const size_t n = ck->n_hwcs;
+  char tmp_file[strlen(ckpt_file) + 8];
+  snprintf(tmp_file, sizeof(tmp_file), "%s.tmp", ckpt_file);
+
+  FILE* ofile = fopen(tmp_file, "w");
+  if (ofile == NULL)
+    {
+      return 0;
+    }
+
+  crawl_ckpt_hdr_t hdr = { .magic = CRAWL_CKPT_MAGIC, .n_hwcs = ck->n_hwcs, .n_sockets = ck->n_sockets,
+			   .rows_done = ck->rows_done, .has_mem = (ck->mem_lat_table != NULL) };
+  int ok = (fwrite(&hdr, sizeof(hdr), 1, ofile) == 1);
+  ok &= (fwrite(ck->lat_table, sizeof(uint64_t), n * n, ofile) == n * n);
+  ok &= (fwrite(ck->done, sizeof(uint8_t), n * n, ofile) == n * n);
+  for (size_t x = 0; hdr.has_mem && x < n; x++)
+    {
+      ok &= (fwrite(ck->mem_lat_table[x], sizeof(uint64_t), ck->n_sockets, ofile) == ck->n_sockets);
+    }
+  ok &= (fclose(ofile) == 0);
+
+  if (!ok || rename(tmp_file, ckpt_file) != 0)
+    {
+      unlink(tmp_file);
+      return 0;
+    }
+  return 1;
+}
+
+crawl_ckpt_status_t
+crawl_ckpt_read(const char* ckpt_file, crawl_ckpt_t* ck)
+{
+  const size_t n = ck->n_hwcs;
+  FILE* ifile = fopen(ckpt_file, "r");
+  if (ifile == NULL)
+    {
+      return CRAWL_CKPT_NONE;
+    }
+
+  crawl_ckpt_hdr_t hdr;
+  if (fread(&hdr, sizeof(hdr), 1, ifile) != 1 || strncmp(hdr.magic, CRAWL_CKPT_MAGIC, sizeof(hdr.magic)) ||
+      hdr.n_hwcs != ck->n_hwcs || hdr.n_sockets != ck->n_sockets || hdr.rows_done > ck->n_hwcs)
+    {
+      fclose(ifile);
+      return CRAWL_CKPT_INVALID;
+    }
+
+  int ok = (fread(ck->lat_table, sizeof(uint64_t), n * n, ifile) == n * n);
+  ok &= (fread(ck->done, sizeof(uint8_t), n * n, ifile) == n * n);
+  if (hdr.has_mem && ck->mem_lat_table != NULL)
+    {
+      for (size_t x = 0; x < n; x++)
+	{
+	  ok &= (fread(ck->mem_lat_table[x], sizeof(uint64_t), ck->n_sockets, ifile) == ck->n_sockets);
+	}
+    }
+  fclose(ifile);
+  if (!ok)
+    {
+      return CRAWL_CKPT_TRUNCATED;
+    }
+
+  ck->rows_done = hdr.rows_done;
+  ck->has_mem = hdr.has_mem;
+  return CRAWL_CKPT_OK;
+}
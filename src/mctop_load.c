@@ -2,6 +2,7 @@
 #include <mctop_internal.h>
 #include <helper.h>
 #include <time.h>
+#include <sys/stat.h>
 
 double*** mctop_power_measurements_create(const uint n_sockets);
 void mctop_power_measurements_free(double*** m, const uint n_sockets);
@@ -133,24 +134,64 @@ mctop_load(const char* mct_file)
   lgrp_cookie_initialize();
 #endif
 
-  char file_open[100], hostname[100];
+  char file_open[256], hostname[100] = "";
   if (mct_file != NULL)
     {
-      sprintf(file_open, "%s", mct_file);
+      const size_t len = strlen(mct_file);
+      if (len > 5 && strcmp(mct_file + len - 5, ".mctb") == 0)
+	{
+	  mctop_t* topo = mctop_load_bin(mct_file);
+	  if (topo != NULL || len >= sizeof(file_open))
+	    {
+	      return topo;
+	    }
+	  /* fall back to the text file of the same name, w/o the "b" */
+	  snprintf(file_open, len, "%s", mct_file);
+	  fprintf(stderr, "MCTOP Warning: Cannot load MCT file %s! Trying %s\n", mct_file, file_open);
+	}
+      else if (snprintf(file_open, sizeof(file_open), "%s", mct_file) >= sizeof(file_open))
+	{
+	  fprintf(stderr, "MCTOP Error: MCT file name %s is too long!\n", mct_file);
+	  return NULL;
+	}
     }
   else
     {
-      if (gethostname(hostname, 100) != 0)
+      if (gethostname(hostname, sizeof(hostname)) != 0)
 	{
 	  perror("MCTOP Error: Could not get hostname!");
 	}
-      sprintf(file_open, "./desc/%s.mct", hostname);
+      hostname[sizeof(hostname) - 1] = '\0';
+
+      /* prefer a topology published on this host, then the binary file */
+      mctop_t* topo = mctop_attach_local(MCTOP_SHM_NAME);
+      if (topo != NULL)
+	{
+	  return topo;
+	}
+      /* the names cannot be truncated: the buffer is larger than hostname */
+      char file_bin[256];
+      struct stat st_bin, st_mct;
+      snprintf(file_bin, sizeof(file_bin), "./desc/%s.mctb", hostname);
+      snprintf(file_open, sizeof(file_open), "./desc/%s.mct", hostname);
+      if (stat(file_bin, &st_bin) == 0)
+	{
+	  /* a re-crawled .mct makes the binary out of date */
+	  if (stat(file_open, &st_mct) == 0 && st_mct.st_mtime > st_bin.st_mtime)
+	    {
+	      fprintf(stderr, "MCTOP Warning: %s is older than %s! Ignoring it\n", file_bin, file_open);
+	    }
+	  else if ((topo = mctop_load_bin(file_bin)) != NULL)
+	    {
+	      return topo;
+	    }
+	}
     }
 
   FILE* ifile = fopen(file_open, "r");
-  if (ifile == NULL)
+  if (ifile == NULL && mct_file == NULL)
     {
-      sprintf(file_open, "/usr/share/mctop/%s.mct", hostname);
+      snprintf(file_open, sizeof(file_open), "/usr/share/mctop/%s.mct", hostname);
       ifile = fopen(file_open, "r");
       if (ifile == NULL)
 	{
@@ -162,6 +203,11 @@ mctop_load(const char* mct_file)
 	  fprintf(stdout, "MCTOP Info: Opened %s!\n", file_open);
 	}
     }
+  else if (ifile == NULL)
+    {
+      fprintf(stderr, "MCTOP Error: Cannot open MCT file %s!\n", file_open);
+      return NULL;
+    }
 
   mctop_dtype_t type = MCTOP_DTYPE_N;
 
@@ -0,0 +1,732 @@
+#include <mctop.h>
+#include <mctop_internal.h>
+#include <helper.h>
+#include <time.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Binary MCT (.mctb) files contain the constructed mctop_t graph as it is in memory: every
+   allocation of the graph is a block in the file and pointers are stored as file offsets. The
+   relocation table lists the offsets of all non-NULL pointers, so that loading is an mmap
+   plus adding the base address to each pointer. The format depends on the ABI of the machine
+   (pointer size, struct layouts), which the header records.
+
+   The same image is published in a named shm segment (mctop_publish), with the pointers
+   already relocated to the address of the publisher's mapping. Processes that can map the
+   segment at the same address (mctop_attach) share it read-only w/o any fix-ups. */
+
+#define MCTB_MAGIC   "MCTB"
+#define MCTB_VERSION 3
+#define MCTB_HOST_LEN 64
+#define MCTB_ALIGN   16
+
+typedef struct mctb_hdr
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t ptr_size;
+  uint32_t struct_sizes[4];	/* mctop_t, hwc_gs_t, hw_context_t, sibling_t */
+  uint64_t size;		/* of the whole file */
+  uint64_t topo_off;
+  uint64_t n_relocs;
+  uint64_t relocs_off;
+  uint64_t base;		/* address the pointers are relative to (0 in files) */
+  char host[MCTB_HOST_LEN];	/* host that published the segment (empty in files) */
+} mctb_hdr_t;
+
+static void
+mctb_hdr_init(mctb_hdr_t* hdr)
+{
+  memset(hdr, 0, sizeof(mctb_hdr_t));
+  strcpy(hdr->magic, MCTB_MAGIC);
+  hdr->version = MCTB_VERSION;
+  hdr->ptr_size = sizeof(void*);
+  hdr->struct_sizes[0] = sizeof(mctop_t);
+  hdr->struct_sizes[1] = sizeof(hwc_gs_t);
+  hdr->struct_sizes[2] = sizeof(hw_context_t);
+  hdr->struct_sizes[3] = sizeof(sibling_t);
+}
+
+static int
+mctb_hdr_valid(const mctb_hdr_t* hdr, const size_t size)
+{
+  mctb_hdr_t ref;
+  mctb_hdr_init(&ref);
+  if (size < sizeof(mctb_hdr_t) || memcmp(hdr->magic, ref.magic, sizeof(ref.magic)) ||
+      hdr->version != ref.version || hdr->ptr_size != ref.ptr_size ||
+      memcmp(hdr->struct_sizes, ref.struct_sizes, sizeof(ref.struct_sizes)) || hdr->size != size)
+    {
+      return 0;
+    }
+
+  /* the blocks lie between the header and the relocation table, which ends the file. Checked
+     w/o overflows, as the values come from the file. */
+  return (hdr->relocs_off >= sizeof(mctb_hdr_t) && hdr->relocs_off <= size &&
+	  (hdr->relocs_off % sizeof(uint64_t)) == 0 &&
+	  hdr->n_relocs == (size - hdr->relocs_off) / sizeof(uint64_t) &&
+	  ((size - hdr->relocs_off) % sizeof(uint64_t)) == 0 &&
+	  hdr->topo_off >= sizeof(mctb_hdr_t) && hdr->topo_off <= hdr->relocs_off &&
+	  hdr->relocs_off - hdr->topo_off >= sizeof(mctop_t));
+}
+
+/* Returns 0 if a relocation or its target is outside of the blocks of the image, in which case
+   the image is corrupt */
+static int
+mctb_relocs_valid(const char* image)
+{
+  const mctb_hdr_t* hdr = (const mctb_hdr_t*) image;
+  const uint64_t* relocs = (const uint64_t*) (image + hdr->relocs_off);
+  for (uint64_t r = 0; r < hdr->n_relocs; r++)
+    {
+      if (relocs[r] < sizeof(mctb_hdr_t) || relocs[r] > hdr->relocs_off - sizeof(uintptr_t) ||
+	  (relocs[r] % sizeof(uintptr_t)) != 0)
+	{
+	  return 0;
+	}
+      const uintptr_t* field = (const uintptr_t*) (image + relocs[r]);
+      const uintptr_t target_off = *field - (uintptr_t) hdr->base;
+      if (target_off < sizeof(mctb_hdr_t) || target_off >= hdr->relocs_off)
+	{
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+/* makes the pointers of the image relative to base. Returns 0 (and leaves the image untouched)
+   if the relocations are not valid. */
+static int
+mctb_relocate(char* image, const uintptr_t base)
+{
+  if (!mctb_relocs_valid(image))
+    {
+      return 0;
+    }
+
+  mctb_hdr_t* hdr = (mctb_hdr_t*) image;
+  const uintptr_t delta = base - (uintptr_t) hdr->base;
+  const uint64_t* relocs = (const uint64_t*) (image + hdr->relocs_off);
+  for (uint64_t r = 0; r < hdr->n_relocs; r++)
+    {
+      *(uintptr_t*) (image + relocs[r]) += delta;
+    }
+  hdr->base = base;
+  return 1;
+}
+
+/* ******************************************************************************** */
+/* writing */
+/* ******************************************************************************** */
+
+typedef struct mctb_block
+{
+  const char* ptr;
+  size_t size;
+  size_t off;			/* in the file */
+} mctb_block_t;
+
+typedef struct mctb_writer
+{
+  size_t n_blocks;
+  size_t size_blocks;
+  mctb_block_t* blocks;
+  char* buf;
+  size_t n_relocs;
+  size_t size_relocs;
+  uint64_t* relocs;
+  uint correct;
+} mctb_writer_t;
+
+static void
+mctb_block_add(mctb_writer_t* w, const void* ptr, const size_t size)
+{
+  if (ptr == NULL || size == 0)
+    {
+      return;
+    }
+  if (w->n_blocks == w->size_blocks)
+    {
+      w->size_blocks = w->size_blocks ? 2 * w->size_blocks : 64;
+      w->blocks = realloc_assert(w->blocks, w->size_blocks * sizeof(mctb_block_t));
+    }
+  w->blocks[w->n_blocks].ptr = (const char*) ptr;
+  w->blocks[w->n_blocks].size = size;
+  w->n_blocks++;
+}
+
+static int
+mctb_block_cmp(const void* a, const void* b)
+{
+  const char* pa = ((const mctb_block_t*) a)->ptr;
+  const char* pb = ((const mctb_block_t*) b)->ptr;
+  return (pa > pb) - (pa < pb);
+}
+
+static mctb_block_t*
+mctb_block_find(mctb_writer_t* w, const void* ptr)
+{
+  const char* p = (const char*) ptr;
+  size_t lo = 0, hi = w->n_blocks;
+  while (lo < hi)
+    {
+      const size_t mid = (lo + hi) / 2;
+      mctb_block_t* b = &w->blocks[mid];
+      if (p < b->ptr)
+	{
+	  hi = mid;
+	}
+      else if (p >= b->ptr + b->size)
+	{
+	  lo = mid + 1;
+	}
+      else
+	{
+	  return b;
+	}
+    }
+  return NULL;
+}
+
+/* translates the pointer stored at field (an address within a block) to a file offset */
+static void
+mctb_ptr(mctb_writer_t* w, const void* field)
+{
+  mctb_block_t* bf = mctb_block_find(w, field);
+  assert(bf != NULL);
+  const size_t field_off = bf->off + ((const char*) field - bf->ptr);
+  const char* target = *(char* const*) field;
+  uintptr_t target_off = 0;
+  if (target != NULL)
+    {
+      mctb_block_t* bt = mctb_block_find(w, target);
+      if (bt == NULL)
+	{
+	  w->correct = 0;	/* points outside of the graph */
+	  return;
+	}
+      target_off = bt->off + (target - bt->ptr);
+
+      if (w->n_relocs == w->size_relocs)
+	{
+	  w->size_relocs = w->size_relocs ? 2 * w->size_relocs : 256;
+	  w->relocs = realloc_assert(w->relocs, w->size_relocs * sizeof(uint64_t));
+	}
+      w->relocs[w->n_relocs++] = field_off;
+    }
+  memcpy(w->buf + field_off, &target_off, sizeof(uintptr_t));
+}
+
+/* arrays of zero elements (e.g., malloc(0)) are not in the file and become NULL */
+static void
+mctb_ptr_n(mctb_writer_t* w, void* const* field, const uint n)
+{
+  if (n == 0)
+    {
+      mctb_block_t* bf = mctb_block_find(w, field);
+      memset(w->buf + bf->off + ((const char*) field - bf->ptr), 0, sizeof(uintptr_t));
+      return;
+    }
+  mctb_ptr(w, field);
+}
+
+static void
+mctb_ptr_array(mctb_writer_t* w, void* const* array, const uint n)
+{
+  for (uint i = 0; array != NULL && i < n; i++)
+    {
+      mctb_ptr(w, &array[i]);
+    }
+}
+
+static void
+mctb_gs_blocks_add(mctb_writer_t* w, mctop_t* topo, hwc_gs_t* gs)
+{
+  mctb_block_add(w, gs->hwcs, gs->n_hwcs * sizeof(hw_context_t*));
+  mctb_block_add(w, gs->children, gs->n_children * sizeof(hwc_gs_t*));
+  mctb_block_add(w, gs->siblings, gs->n_siblings * sizeof(sibling_t*));
+  mctb_block_add(w, gs->siblings_in, gs->n_siblings * sizeof(sibling_t*));
+  mctb_block_add(w, gs->mem_latencies, topo->n_sockets * sizeof(uint));
+  mctb_block_add(w, gs->mem_bandwidths_r, topo->n_sockets * sizeof(double));
+  mctb_block_add(w, gs->mem_bandwidths1_r, topo->n_sockets * sizeof(double));
+  mctb_block_add(w, gs->mem_bandwidths_w, topo->n_sockets * sizeof(double));
+  mctb_block_add(w, gs->mem_bandwidths1_w, topo->n_sockets * sizeof(double));
+  mctb_block_add(w, gs->pow_info, sizeof(mctop_pow_info_t));
+}
+
+static void
+mctb_gs_ptrs(mctb_writer_t* w, hwc_gs_t* gs)
+{
+  mctb_ptr(w, &gs->socket);
+  mctb_ptr(w, &gs->parent);
+  mctb_ptr(w, &gs->next);
+  mctb_ptr_n(w, (void* const*) &gs->hwcs, gs->n_hwcs);
+  mctb_ptr_n(w, (void* const*) &gs->children, gs->n_children);
+  mctb_ptr(w, &gs->topo);
+  mctb_ptr_n(w, (void* const*) &gs->siblings, gs->n_siblings);
+  mctb_ptr_n(w, (void* const*) &gs->siblings_in, gs->n_siblings);
+  mctb_ptr(w, &gs->mem_latencies);
+  mctb_ptr(w, &gs->mem_bandwidths_r);
+  mctb_ptr(w, &gs->mem_bandwidths1_r);
+  mctb_ptr(w, &gs->mem_bandwidths_w);
+  mctb_ptr(w, &gs->mem_bandwidths1_w);
+  mctb_ptr(w, &gs->pow_info);
+  mctb_ptr_array(w, (void* const*) gs->hwcs, gs->n_hwcs);
+  mctb_ptr_array(w, (void* const*) gs->children, gs->n_children);
+  mctb_ptr_array(w, (void* const*) gs->siblings, gs->n_siblings);
+  mctb_ptr_array(w, (void* const*) gs->siblings_in, gs->n_siblings);
+}
+
+/* the hwc groups below the sockets */
+#define MCTB_FOR_EACH_GROUP(topo, gs)					\
+  for (uint __l = 1; __l < (topo)->socket_level; __l++)			\
+    for (hwc_gs_t* gs = mctop_get_first_gs_at_lvl((topo), __l); gs != NULL; gs = gs->next)
+
+/* Returns the image of topo with pointers relative to 0 (i.e., file offsets), or NULL */
+static char*
+mctb_image_create(mctop_t* topo, size_t* size)
+{
+  mctb_writer_t w = { .correct = 1 };
+
+  /* 1. collect all allocations of the graph */
+  mctb_block_add(&w, topo, sizeof(mctop_t));
+  mctb_block_add(&w, topo->latencies, topo->n_levels * sizeof(uint));
+  mctb_block_add(&w, topo->sockets, topo->n_sockets * sizeof(socket_t));
+  mctb_block_add(&w, topo->node_to_socket, topo->n_sockets * sizeof(uint));
+  mctb_block_add(&w, topo->hwcs, topo->n_hwcs * sizeof(hw_context_t));
+  mctb_block_add(&w, topo->siblings, topo->n_siblings * sizeof(sibling_t*));
+  for (uint i = 0; i < topo->n_siblings; i++)
+    {
+      mctb_block_add(&w, topo->siblings[i], sizeof(sibling_t));
+    }
+  if (topo->cache != NULL)
+    {
+      mctb_block_add(&w, topo->cache, sizeof(mctop_cache_info_t));
+      mctb_block_add(&w, topo->cache->latencies, topo->cache->n_levels * sizeof(uint64_t));
+      mctb_block_add(&w, topo->cache->sizes_OS, topo->cache->n_levels * sizeof(uint64_t));
+      mctb_block_add(&w, topo->cache->sizes_estimated, topo->cache->n_levels * sizeof(uint64_t));
+    }
+  mctb_block_add(&w, topo->mem_bandwidths_r, topo->n_sockets * sizeof(double));
+  mctb_block_add(&w, topo->mem_bandwidths1_r, topo->n_sockets * sizeof(double));
+  mctb_block_add(&w, topo->mem_bandwidths_w, topo->n_sockets * sizeof(double));
+  mctb_block_add(&w, topo->mem_bandwidths1_w, topo->n_sockets * sizeof(double));
+  mctb_block_add(&w, topo->pow_info, sizeof(mctop_pow_info_t));
+  const uint n_gs_index = (topo->socket_level > 1) ? (topo->socket_level - 1) * topo->n_hwcs : 0;
+  mctb_block_add(&w, topo->lat_table, topo->n_hwcs * topo->n_hwcs * sizeof(uint));
+  mctb_block_add(&w, topo->gs_index, n_gs_index * sizeof(hwc_gs_t*));
+  mctop_flat_t* flat = &topo->flat;
+  const uint n_flat_uints = (flat->lvl_off - flat->socket) + (topo->socket_level > 1 ? topo->socket_level : 1);
+  const uint n_flat_ptrs = topo->n_hwcs + flat->n_gs;
+  mctb_block_add(&w, flat->socket, n_flat_uints * sizeof(uint));
+  mctb_block_add(&w, flat->core, n_flat_ptrs * sizeof(hwc_gs_t*));
+  for (uint s = 0; s < topo->n_sockets; s++)
+    {
+      mctb_gs_blocks_add(&w, topo, &topo->sockets[s]);
+    }
+  MCTB_FOR_EACH_GROUP(topo, gs)
+    {
+      mctb_block_add(&w, gs, sizeof(hwc_gs_t));
+      mctb_gs_blocks_add(&w, topo, gs);
+    }
+
+  /* 2. lay them out after the header */
+  qsort(w.blocks, w.n_blocks, sizeof(mctb_block_t), mctb_block_cmp);
+  size_t off = sizeof(mctb_hdr_t);
+  for (size_t b = 0; b < w.n_blocks; b++)
+    {
+      off = (off + MCTB_ALIGN - 1) & ~((size_t) MCTB_ALIGN - 1);
+      w.blocks[b].off = off;
+      off += w.blocks[b].size;
+    }
+  const size_t blocks_end = (off + MCTB_ALIGN - 1) & ~((size_t) MCTB_ALIGN - 1);
+
+  w.buf = calloc_assert(blocks_end, sizeof(char));
+  for (size_t b = 0; b < w.n_blocks; b++)
+    {
+      memcpy(w.buf + w.blocks[b].off, w.blocks[b].ptr, w.blocks[b].size);
+    }
+
+  /* 3. translate pointers */
+  mctb_block_t* btopo = mctb_block_find(&w, topo);
+  mctop_t* topo_out = (mctop_t*) (w.buf + btopo->off);
+  topo_out->mmap_base = NULL;
+  topo_out->mmap_size = 0;
+
+  mctb_ptr(&w, &topo->latencies);
+  mctb_ptr(&w, &topo->sockets);
+  mctb_ptr(&w, &topo->node_to_socket);
+  mctb_ptr(&w, &topo->hwcs);
+  mctb_ptr_n(&w, (void* const*) &topo->siblings, topo->n_siblings);
+  mctb_ptr(&w, &topo->cache);
+  mctb_ptr(&w, &topo->mem_bandwidths_r);
+  mctb_ptr(&w, &topo->mem_bandwidths1_r);
+  mctb_ptr(&w, &topo->mem_bandwidths_w);
+  mctb_ptr(&w, &topo->mem_bandwidths1_w);
+  mctb_ptr(&w, &topo->pow_info);
+  mctb_ptr(&w, &topo->lat_table);
+  mctb_ptr_n(&w, (void* const*) &topo->gs_index, n_gs_index);
+  mctb_ptr_array(&w, (void* const*) topo->gs_index, n_gs_index);
+  mctb_ptr(&w, &flat->socket);
+  mctb_ptr(&w, &flat->node);
+  mctb_ptr(&w, &flat->nth_in_socket);
+  mctb_ptr(&w, &flat->nth_in_core);
+  mctb_ptr(&w, &flat->nth_core_in_socket);
+  mctb_ptr(&w, &flat->core);
+  mctb_ptr(&w, &flat->lvl_off);
+  mctb_ptr_n(&w, (void* const*) &flat->gs, flat->n_gs);
+  mctb_ptr_array(&w, (void* const*) flat->core, n_flat_ptrs);
+  for (uint h = 0; h < topo->n_hwcs; h++)
+    {
+      hw_context_t* hwc = &topo->hwcs[h];
+      mctb_ptr(&w, &hwc->socket);
+      mctb_ptr(&w, &hwc->parent);
+      mctb_ptr(&w, &hwc->next);
+    }
+  mctb_ptr_array(&w, (void* const*) topo->siblings, topo->n_siblings);
+  for (uint i = 0; i < topo->n_siblings; i++)
+    {
+      sibling_t* sibling = topo->siblings[i];
+      mctb_ptr(&w, &sibling->left);
+      mctb_ptr(&w, &sibling->right);
+      mctb_ptr(&w, &sibling->next);
+    }
+  if (topo->cache != NULL)
+    {
+      mctb_ptr(&w, &topo->cache->latencies);
+      mctb_ptr(&w, &topo->cache->sizes_OS);
+      mctb_ptr(&w, &topo->cache->sizes_estimated);
+    }
+  for (uint s = 0; s < topo->n_sockets; s++)
+    {
+      mctb_gs_ptrs(&w, &topo->sockets[s]);
+    }
+  MCTB_FOR_EACH_GROUP(topo, gs)
+    {
+      mctb_gs_ptrs(&w, gs);
+    }
+
+  /* 4. header and relocation table */
+  mctb_hdr_t hdr;
+  mctb_hdr_init(&hdr);
+  hdr.topo_off = btopo->off;
+  hdr.n_relocs = w.n_relocs;
+  hdr.relocs_off = blocks_end;
+  hdr.size = blocks_end + w.n_relocs * sizeof(uint64_t);
+
+  char* image = NULL;
+  if (w.correct)
+    {
+      image = realloc_assert(w.buf, hdr.size);
+      memcpy(image, &hdr, sizeof(mctb_hdr_t));
+      memcpy(image + blocks_end, w.relocs, w.n_relocs * sizeof(uint64_t));
+      *size = hdr.size;
+    }
+  else
+    {
+      fprintf(stderr, "MCTOP Error: Topology has pointers outside of its graph!\n");
+      free(w.buf);
+    }
+
+  free(w.relocs);
+  free(w.blocks);
+  return image;
+}
+
+int
+mctop_save_bin(mctop_t* topo, const char* mctb_file)
+{
+  size_t size;
+  char* image = mctb_image_create(topo, &size);
+  if (image == NULL)
+    {
+      return 0;
+    }
+
+  int ret = 0;
+  FILE* ofile = fopen(mctb_file, "w");
+  if (ofile == NULL)
+    {
+      fprintf(stderr, "MCTOP Error: Cannot open %s for writing!\n", mctb_file);
+    }
+  else
+    {
+      ret = (fwrite(image, 1, size, ofile) == size);
+      ret &= (fclose(ofile) == 0);
+      if (!ret)
+	{
+	  fprintf(stderr, "MCTOP Error: Writing %s failed!\n", mctb_file);
+	}
+    }
+
+  free(image);
+  return ret;
+}
+
+/* ******************************************************************************** */
+/* loading */
+/* ******************************************************************************** */
+
+mctop_t*
+mctop_load_bin(const char* mctb_file)
+{
+  clock_t cstart = clock();
+
+  int fd = open(mctb_file, O_RDONLY);
+  if (fd < 0)
+    {
+      return NULL;
+    }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(mctb_hdr_t))
+    {
+      fprintf(stderr, "MCTOP Error: Incorrect MCT file %s! Reason: Header\n", mctb_file);
+      close(fd);
+      return NULL;
+    }
+
+  /* private mapping: pointers are fixed up in copy-on-write pages, the file is never written */
+  char* base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    {
+      perror("MCTOP Error: Cannot mmap MCT file");
+      return NULL;
+    }
+
+  mctb_hdr_t* hdr = (mctb_hdr_t*) base;
+  if (!mctb_hdr_valid(hdr, st.st_size))
+    {
+      fprintf(stderr, "MCTOP Error: Incorrect MCT file %s! Reason: Header (version or ABI)\n", mctb_file);
+      munmap(base, st.st_size);
+      return NULL;
+    }
+
+  if (!mctb_relocate(base, (uintptr_t) base))
+    {
+      fprintf(stderr, "MCTOP Error: Incorrect MCT file %s! Reason: Relocations\n", mctb_file);
+      munmap(base, st.st_size);
+      return NULL;
+    }
+  mctop_t* topo = (mctop_t*) (base + hdr->topo_off);
+  topo->mmap_base = base;
+  topo->mmap_size = st.st_size;
+
+#ifdef __x86_64__
+  if (topo->has_mem)		/* the file might come from a different OS setting */
+    {
+      for (uint s = 0; s < topo->n_sockets; s++)
+	{
+	  topo->sockets[s].local_node_wrong = 0;
+	}
+      for (uint i = 0; i < topo->n_hwcs; i++)
+	{
+	  hw_context_t* hwc = &topo->hwcs[i];
+	  socket_t* socket = hwc->socket;
+	  hwc->local_node_wrong = 0;
+	  if (unlikely(socket->local_node != numa_node_of_cpu(hwc->id)))
+	    {
+	      hwc->local_node_wrong = 1;
+	      socket->local_node_wrong = 1;
+	    }
+	}
+    }
+#endif
+
+  double dur = (clock() - cstart) / (double) CLOCKS_PER_SEC;
+  printf("MCTOP Info: Topology loaded in %.3f ms\n", 1000 * dur);
+  return topo;
+}
+
+/* ******************************************************************************** */
+/* process-shared topology */
+/* ******************************************************************************** */
+
+int
+mctop_publish(mctop_t* topo, const char* shm_name)
+{
+  size_t size;
+  char* image = mctb_image_create(topo, &size);
+  if (image == NULL)
+    {
+      return 0;
+    }
+
+  /* a new segment: processes attached to an older one keep their mapping */
+  shm_unlink(shm_name);
+  int fd = shm_open(shm_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0 || ftruncate(fd, size) != 0)
+    {
+      perror("MCTOP Error: Cannot create shm segment");
+      if (fd >= 0)
+	{
+	  close(fd);
+	  shm_unlink(shm_name);
+	}
+      free(image);
+      return 0;
+    }
+
+  char* seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (seg == MAP_FAILED)
+    {
+      perror("MCTOP Error: Cannot mmap shm segment");
+      shm_unlink(shm_name);
+      free(image);
+      return 0;
+    }
+
+  /* the magic goes last, thus attach never sees a partial segment */
+  mctb_hdr_t* hdr = (mctb_hdr_t*) seg;
+  memcpy(seg, image, size);
+  memset(hdr->magic, 0, sizeof(hdr->magic));
+  if (gethostname(hdr->host, MCTB_HOST_LEN) != 0)
+    {
+      hdr->host[0] = '\0';
+    }
+  hdr->host[MCTB_HOST_LEN - 1] = '\0';
+  mctb_relocate(seg, (uintptr_t) seg);
+  mctop_t* topo_seg = (mctop_t*) (seg + hdr->topo_off);
+  topo_seg->mmap_base = seg;
+  topo_seg->mmap_size = size;
+  __sync_synchronize();
+  memcpy(hdr->magic, image, sizeof(hdr->magic));
+
+  munmap(seg, size);
+  free(image);
+  return 1;
+}
+
+/* was the segment published on this host? */
+static int
+mctb_hdr_this_host(const mctb_hdr_t* hdr)
+{
+  char host[MCTB_HOST_LEN];
+  if (gethostname(host, MCTB_HOST_LEN) != 0)
+    {
+      return 0;
+    }
+  host[MCTB_HOST_LEN - 1] = '\0';
+  return (strncmp(hdr->host, host, MCTB_HOST_LEN) == 0);
+}
+
+/* the pointers of a segment are used as they are: only trust segments that no other user can
+   have written */
+static int
+mctb_owner_trusted(const struct stat* st)
+{
+  return ((st->st_uid == geteuid() || st->st_uid == 0) && (st->st_mode & (S_IWGRP | S_IWOTH)) == 0);
+}
+
+static mctop_t*
+mctb_attach(const char* shm_name, const int this_host_only)
+{
+  clock_t cstart = clock();
+
+  int fd = shm_open(shm_name, O_RDONLY, 0);
+  if (fd < 0)
+    {
+      return NULL;
+    }
+
+  struct stat st;
+  mctb_hdr_t hdr;
+  if (fstat(fd, &st) != 0 || pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr) || !mctb_hdr_valid(&hdr, st.st_size))
+    {
+      close(fd);		/* not (yet) published */
+      return NULL;
+    }
+  if (!mctb_owner_trusted(&st))
+    {
+      fprintf(stderr, "MCTOP Warning: Ignoring shm segment %s, owned by user %u or writable by others.\n",
+	      shm_name, (uint) st.st_uid);
+      close(fd);
+      return NULL;
+    }
+  if (this_host_only && !mctb_hdr_this_host(&hdr))
+    {
+      fprintf(stderr, "MCTOP Warning: Ignoring shm segment %s, published on host '%.*s'.\n",
+	      shm_name, MCTB_HOST_LEN, hdr.host);
+      close(fd);
+      return NULL;
+    }
+
+  /* shared and read-only at the address of the publisher, if that is free here */
+  int flags = MAP_SHARED;
+#ifdef MAP_FIXED_NOREPLACE
+  flags |= MAP_FIXED_NOREPLACE;
+#endif
+  char* base = mmap((void*) (uintptr_t) hdr.base, st.st_size, PROT_READ, flags, fd, 0);
+  if (base != MAP_FAILED && base != (char*) (uintptr_t) hdr.base)
+    {
+      munmap(base, st.st_size);
+      base = MAP_FAILED;
+    }
+
+  if (base != MAP_FAILED && !mctb_relocs_valid(base))
+    {
+      fprintf(stderr, "MCTOP Error: Incorrect shm segment %s! Reason: Relocations\n", shm_name);
+      munmap(base, st.st_size);
+      close(fd);
+      return NULL;
+    }
+
+  mctop_t* topo;
+  if (base != MAP_FAILED)
+    {
+      topo = (mctop_t*) (base + hdr.topo_off);
+    }
+  else
+    {
+      /* private copy-on-write mapping with relocated pointers */
+      base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if (base == MAP_FAILED)
+	{
+	  perror("MCTOP Error: Cannot mmap shm segment");
+	  close(fd);
+	  return NULL;
+	}
+      if (!mctb_relocate(base, (uintptr_t) base))
+	{
+	  fprintf(stderr, "MCTOP Error: Incorrect shm segment %s! Reason: Relocations\n", shm_name);
+	  munmap(base, st.st_size);
+	  close(fd);
+	  return NULL;
+	}
+      topo = (mctop_t*) (base + hdr.topo_off);
+      topo->mmap_base = base;
+      topo->mmap_size = st.st_size;
+    }
+  close(fd);
+
+  if (this_host_only && topo->n_hwcs != sysconf(_SC_NPROCESSORS_CONF))
+    {
+      fprintf(stderr, "MCTOP Warning: Ignoring shm segment %s, its topology has %u hw contexts.\n",
+	      shm_name, topo->n_hwcs);
+      munmap(base, st.st_size);
+      return NULL;
+    }
+
+  double dur = (clock() - cstart) / (double) CLOCKS_PER_SEC;
+  printf("MCTOP Info: Topology attached in %.3f ms\n", 1000 * dur);
+  return topo;
+}
+
+mctop_t*
+mctop_attach(const char* shm_name)
+{
+  return mctb_attach(shm_name, 0);
+}
+
+mctop_t*
+mctop_attach_local(const char* shm_name)
+{
+  return mctb_attach(shm_name, 1);
+}
+
+int
+mctop_unpublish(const char* shm_name)
+{
+  return (shm_unlink(shm_name) == 0);
+}
@@ -0,0 +1,322 @@
+#include <mctop_alloc.h>
+#include <mctop_internal.h>
+#include <helper.h>
+
+/* Cohort lock ("Lock Cohorting: A General Technique for Designing NUMA Locks", Dice et al.,
+   PPoPP'12), C-TKT-MCS flavor: the local locks are MCS queues, so that waiters spin on their
+   own qnode, and the global lock is a ticket lock, so that the sockets are served in FIFO. */
+
+/* MCTOP_ALLOC_NONE has no sockets: a single cohort in plain memory */
+static void*
+mctop_lock_malloc(mctop_alloc_t* alloc, const uint nth, const size_t size)
+{
+  if (alloc->policy == MCTOP_ALLOC_NONE)
+    {
+      return malloc_assert(size);
+    }
+  return mctop_alloc_malloc_on_nth_socket(alloc, nth, size);
+}
+
+static void
+mctop_lock_mfree(mctop_alloc_t* alloc, void* mem, const size_t size)
+{
+  if (alloc->policy == MCTOP_ALLOC_NONE)
+    {
+      free(mem);
+    }
+  else
+    {
+      mctop_alloc_malloc_free(mem, size);
+    }
+}
+
+static size_t
+mctop_lock_local_size(const uint n_qnodes)
+{
+  return sizeof(mctop_lock_local_t) + n_qnodes * sizeof(mctop_lock_qnode_t);
+}
+
+static uint
+mctop_lock_nth_socket(mctop_alloc_t* alloc, const uint id)
+{
+  if (alloc->policy == MCTOP_ALLOC_NONE)
+    {
+      return 0;
+    }
+  socket_t* socket = mctop_hwcid_get_socket(alloc->topo, alloc->hwcs[id]);
+  return mctop_alloc_socket_seq_id(alloc, socket->id);
+}
+
+mctop_lock_t*
+mctop_lock_create(mctop_alloc_t* alloc)
+{
+  mctop_lock_t* lock = malloc_assert(sizeof(mctop_lock_t));
+  lock->next = 0;
+  lock->now = 0;
+  lock->alloc = alloc;
+  lock->n_locals = (alloc->policy == MCTOP_ALLOC_NONE) ? 1 : alloc->n_sockets;
+  lock->handoff_max = MCTOP_LOCK_HANDOFF_MAX;
+
+  mctop_t* topo = alloc->topo;
+  const uint level = (lock->n_locals > 1 || alloc->policy == MCTOP_ALLOC_NONE) ? (topo->n_levels - 1) : topo->socket_level;
+  lock->backoff = mctop_backoff_get(topo, level).quantum;
+  const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  lock->yield = (n_cpus > 0 && n_cpus < alloc->n_hwcs);
+
+  uint* sockets = malloc_assert(alloc->n_hwcs * sizeof(uint));
+  uint* n_qnodes = calloc_assert(lock->n_locals, sizeof(uint));
+  for (uint i = 0; i < alloc->n_hwcs; i++)
+    {
+      sockets[i] = mctop_lock_nth_socket(alloc, i);
+      n_qnodes[sockets[i]]++;
+    }
+
+  lock->locals = malloc_assert(lock->n_locals * sizeof(mctop_lock_local_t*));
+  for (uint s = 0; s < lock->n_locals; s++)
+    {
+      mctop_lock_local_t* local = mctop_lock_malloc(alloc, s, mctop_lock_local_size(n_qnodes[s]));
+      local->tail = NULL;
+      local->n_handoffs = 0;
+      local->n_qnodes = 0;
+      lock->locals[s] = local;
+    }
+
+  lock->qnodes = malloc_assert(alloc->n_hwcs * sizeof(mctop_lock_qnode_t*));
+  for (uint i = 0; i < alloc->n_hwcs; i++)
+    {
+      mctop_lock_local_t* local = lock->locals[sockets[i]];
+      mctop_lock_qnode_t* qnode = &local->qnodes[local->n_qnodes++];
+      qnode->next = NULL;
+      qnode->state = MCTOP_LOCK_WAIT;
+      qnode->local = local;
+      lock->qnodes[i] = qnode;
+    }
+
+  free(n_qnodes);
+  free(sockets);
+  return lock;
+}
+
+void
+mctop_lock_free(mctop_lock_t* lock)
+{
+  for (uint s = 0; s < lock->n_locals; s++)
+    {
+      mctop_lock_local_t* local = lock->locals[s];
+      mctop_lock_mfree(lock->alloc, local, mctop_lock_local_size(local->n_qnodes));
+    }
+  free(lock->locals);
+  free(lock->qnodes);
+  free(lock);
+}
+
+void
+mctop_lock_print(mctop_lock_t* lock)
+{
+  printf("## MCTOP Cohort Lock -- %u cohorts / handoff max %u / backoff %u cycles%s\n",
+	 lock->n_locals, lock->handoff_max, lock->backoff, lock->yield ? " / yielding" : "");
+  for (uint s = 0; s < lock->n_locals; s++)
+    {
+      const uint node = (lock->alloc->policy == MCTOP_ALLOC_NONE) ? 0 : mctop_alloc_get_nth_node(lock->alloc, s);
+      printf("# Cohort#%-2u - Node %-2u : %u threads\n", s, node, lock->locals[s]->n_qnodes);
+    }
+}
+
+/* ******************************************************************************** */
+/* acquire / release */
+/* ******************************************************************************** */
+
+static inline void
+mctop_lock_relax(mctop_lock_t* lock)
+{
+  if (unlikely(lock->yield))
+    {
+      sched_yield();
+    }
+  else
+    {
+      PAUSE();
+    }
+}
+
+static inline void
+mctop_lock_global_acquire(mctop_lock_t* lock)
+{
+  const uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+  while (1)
+    {
+      const uint32_t distance = ticket - __atomic_load_n(&lock->now, __ATOMIC_ACQUIRE);
+      if (distance == 0)
+	{
+	  break;
+	}
+
+      if (lock->backoff == 0 || lock->yield)
+	{
+	  mctop_lock_relax(lock);
+	}
+      else
+	{
+	  const ticks until = getticks() + (ticks) distance * lock->backoff;
+	  while (getticks() < until)
+	    {
+	      PAUSE();
+	    }
+	}
+    }
+}
+
+static inline void
+mctop_lock_global_release(mctop_lock_t* lock)
+{
+  __atomic_store_n(&lock->now, lock->now + 1, __ATOMIC_RELEASE);
+}
+
+void
+mctop_lock_acquire(mctop_lock_t* lock)
+{
+  mctop_lock_qnode_t* qnode = lock->qnodes[mctop_alloc_thread_id()];
+  mctop_lock_local_t* local = qnode->local;
+  qnode->next = NULL;
+  __atomic_store_n(&qnode->state, MCTOP_LOCK_WAIT, __ATOMIC_RELAXED);
+
+  mctop_lock_qnode_t* pred = __atomic_exchange_n(&local->tail, qnode, __ATOMIC_ACQ_REL);
+  if (pred != NULL)
+    {
+      __atomic_store_n(&pred->next, qnode, __ATOMIC_RELEASE);
+      uint32_t state;
+      while ((state = __atomic_load_n(&qnode->state, __ATOMIC_ACQUIRE)) == MCTOP_LOCK_WAIT)
+	{
+	  mctop_lock_relax(lock);
+	}
+      if (state == MCTOP_LOCK_GLOBAL_PASSED)
+	{
+	  return;
+	}
+    }
+
+  mctop_lock_global_acquire(lock);
+}
+
+void
+mctop_lock_release(mctop_lock_t* lock)
+{
+  mctop_lock_qnode_t* qnode = lock->qnodes[mctop_alloc_thread_id()];
+  mctop_lock_local_t* local = qnode->local;
+
+  mctop_lock_qnode_t* succ = __atomic_load_n(&qnode->next, __ATOMIC_ACQUIRE);
+  if (succ == NULL)
+    {
+      mctop_lock_qnode_t* expected = qnode;
+      if (__atomic_compare_exchange_n(&local->tail, &expected, NULL, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	{
+	  /* the next local head reads n_handoffs only after it gets the global lock */
+	  local->n_handoffs = 0;
+	  mctop_lock_global_release(lock);
+	  return;
+	}
+      while ((succ = __atomic_load_n(&qnode->next, __ATOMIC_ACQUIRE)) == NULL) /* enqueueing */
+	{
+	  mctop_lock_relax(lock);
+	}
+    }
+
+  if (local->n_handoffs < lock->handoff_max)
+    {
+      local->n_handoffs++;
+      __atomic_store_n(&succ->state, MCTOP_LOCK_GLOBAL_PASSED, __ATOMIC_RELEASE);
+    }
+  else
+    {
+      local->n_handoffs = 0;
+      mctop_lock_global_release(lock);
+      __atomic_store_n(&succ->state, MCTOP_LOCK_GLOBAL_ACQUIRE, __ATOMIC_RELEASE);
+    }
+}
+
+/* ******************************************************************************** */
+/* reader-writer lock */
+/* ******************************************************************************** */
+
+mctop_rwlock_t*
+mctop_rwlock_create(mctop_alloc_t* alloc)
+{
+  mctop_rwlock_t* rwl = malloc_assert(sizeof(mctop_rwlock_t));
+  rwl->writer = 0;
+  rwl->wlock = mctop_lock_create(alloc);
+  rwl->n_indicators = rwl->wlock->n_locals;
+  rwl->indicators = malloc_assert(rwl->n_indicators * sizeof(mctop_rwlock_indicator_t*));
+  for (uint s = 0; s < rwl->n_indicators; s++)
+    {
+      rwl->indicators[s] = mctop_lock_malloc(alloc, s, sizeof(mctop_rwlock_indicator_t));
+      rwl->indicators[s]->n_readers = 0;
+    }
+  return rwl;
+}
+
+void
+mctop_rwlock_free(mctop_rwlock_t* rwl)
+{
+  for (uint s = 0; s < rwl->n_indicators; s++)
+    {
+      mctop_lock_mfree(rwl->wlock->alloc, rwl->indicators[s], sizeof(mctop_rwlock_indicator_t));
+    }
+  free(rwl->indicators);
+  mctop_lock_free(rwl->wlock);
+  free(rwl);
+}
+
+static inline mctop_rwlock_indicator_t*
+mctop_rwlock_indicator(mctop_rwlock_t* rwl)
+{
+  return rwl->indicators[(rwl->n_indicators > 1) ? mctop_alloc_thread_node_id() : 0];
+}
+
+/* the increment of the indicator and the load of the writer flag, and the store of the flag
+   and the loads of the indicators, are SEQ_CST: a reader and a writer cannot both miss
+   each other */
+void
+mctop_rwlock_read_acquire(mctop_rwlock_t* rwl)
+{
+  mctop_rwlock_indicator_t* ind = mctop_rwlock_indicator(rwl);
+  while (1)
+    {
+      __atomic_add_fetch(&ind->n_readers, 1, __ATOMIC_SEQ_CST);
+      if (likely(__atomic_load_n(&rwl->writer, __ATOMIC_SEQ_CST) == 0))
+	{
+	  return;
+	}
+      __atomic_sub_fetch(&ind->n_readers, 1, __ATOMIC_RELEASE);
+      while (__atomic_load_n(&rwl->writer, __ATOMIC_ACQUIRE))
+	{
+	  mctop_lock_relax(rwl->wlock);
+	}
+    }
+}
+
+void
+mctop_rwlock_read_release(mctop_rwlock_t* rwl)
+{
+  __atomic_sub_fetch(&mctop_rwlock_indicator(rwl)->n_readers, 1, __ATOMIC_RELEASE);
+}
+
+void
+mctop_rwlock_write_acquire(mctop_rwlock_t* rwl)
+{
+  mctop_lock_acquire(rwl->wlock);
+  __atomic_store_n(&rwl->writer, 1, __ATOMIC_SEQ_CST);
+  for (uint s = 0; s < rwl->n_indicators; s++)
+    {
+      while (__atomic_load_n(&rwl->indicators[s]->n_readers, __ATOMIC_SEQ_CST) > 0)
+	{
+	  mctop_lock_relax(rwl->wlock);
+	}
+    }
+}
+
+void
+mctop_rwlock_write_release(mctop_rwlock_t* rwl)
+{
+  __atomic_store_n(&rwl->writer, 0, __ATOMIC_RELEASE);
+  mctop_lock_release(rwl->wlock);
+}
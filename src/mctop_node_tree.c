@@ -1,35 +1,54 @@
 #include <mctop_alloc.h>
 #include <mctop_internal.h>
 #include <darray.h>
+#include <helper.h>
+#include <atomics.h>
 
-static int
-floor_log_2(uint n)
+static uint
+ceil_log_2(uint n)
 {
-  int pos = 0;
-  if (n >= 1<<16) { n >>= 16; pos += 16; }
-  if (n >= 1<< 8) { n >>=  8; pos +=  8; }
-  if (n >= 1<< 4) { n >>=  4; pos +=  4; }
-  if (n >= 1<< 2) { n >>=  2; pos +=  2; }
-  if (n >= 1<< 1) {           pos +=  1; }
-  return ((n == 0) ? (-1) : pos);
+  uint pos = 0;
+  while ((1U << pos) < n)
+    {
+      pos++;
+    }
+  return pos;
+}
+
+static uint
+bit_reverse(uint x, const uint n_bits)
+{
+  uint r = 0;
+  for (uint b = 0; b < n_bits; b++, x >>= 1)
+    {
+      r = (r << 1) | (x & 1);
+    }
+  return r;
 }
 
+static size_t
+mctop_nt_coll_size(const uint n_slots)
+{
+  return sizeof(mctop_nt_coll_t) + n_slots * sizeof(mctop_nt_slot_t);
+}
+
+/* with n_sockets not a power of 2, the last level only pairs n_sockets - 2^(n_lvls - 1) nodes */
 mctop_node_tree_t*
-mctop_node_tree_alloc(const uint n_lvls)
+mctop_node_tree_alloc(const uint n_lvls, const uint n_sockets)
 {
   mctop_node_tree_t* nt = malloc_assert(sizeof(mctop_node_tree_t));
   nt->levels = malloc_assert(n_lvls * sizeof(mctop_nt_lvl_t));
   nt->n_levels = n_lvls;
-  nt->n_nodes = 2 << n_lvls;
+  nt->n_nodes = n_sockets;
 
   uint n_nodes = 1;
   for (int l = 0; l < n_lvls; l++)
     {
-      const uint n_pairs = n_nodes;
-      n_nodes <<= 1;
+      const uint n_pairs = (n_sockets - n_nodes < n_nodes) ? (n_sockets - n_nodes) : n_nodes;
       nt->levels[l].n_pairs = n_pairs;
-      nt->levels[l].n_nodes = n_nodes;
+      nt->levels[l].n_nodes = n_nodes + n_pairs;
       nt->levels[l].pairs = calloc_assert(n_pairs, sizeof(mctop_nt_pair_t));
+      n_nodes <<= 1;
     }
 
   return nt;
@@ -51,6 +70,13 @@ mctop_node_tree_free(mctop_node_tree_t* nt)
       mctop_barrier_destroy(nt->levels[l].barrier);
     }
     free(nt->levels);
+    for (uint n = 0; n < nt->n_nodes; n++)
+      {
+	mctop_nt_coll_t* coll = nt->colls[n];
+	free(coll->children);
+	mctop_alloc_malloc_free(coll, mctop_nt_coll_size(coll->n_slots));
+      }
+    free(nt->colls);
     mctop_barrier_destroy(nt->barrier);
     free(nt->barrier);
     free(nt->scratchpad);
@@ -131,6 +157,74 @@ mctop_node_tree_add_barriers(mctop_node_tree_t* nt, mctop_type_t barrier_for)
 }
 
 
+static mctop_nt_pair_t*
+mctop_nt_get_pair_for_node(mctop_node_tree_t* nt, const uint lvl, const uint node)
+{
+  if (lvl >= nt->n_levels)
+    {
+      return NULL;
+    }
+  mctop_nt_lvl_t* level = &nt->levels[lvl];
+  for (int p = 0; p < level->n_pairs; p++)
+    {
+      mctop_nt_pair_t* pair = &level->pairs[p];
+      if (pair->nodes[0] == node || pair->nodes[1] == node)
+	{
+	  return pair;
+	}
+    }
+  return NULL;
+}
+
+/* the destination of a pair is the parent of its source. Children are combined from the
+   lowest level up */
+static void
+mctop_node_tree_add_colls(mctop_node_tree_t* nt)
+{
+  mctop_alloc_t* alloc = nt->alloc;
+  const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  nt->yield = (n_cpus > 0 && n_cpus < alloc->n_hwcs);
+
+  uint* parents = malloc_assert(nt->n_nodes * sizeof(uint));
+  for (uint n = 0; n < nt->n_nodes; n++)
+    {
+      parents[n] = n;
+    }
+
+  for (int l = nt->n_levels - 1; l >= 0; l--)
+    {
+      mctop_nt_lvl_t* level = &nt->levels[l];
+      for (uint p = 0; p < level->n_pairs; p++)
+	{
+	  parents[level->pairs[p].nodes[1]] = level->pairs[p].nodes[0];
+	}
+    }
+
+  nt->colls = malloc_assert(nt->n_nodes * sizeof(mctop_nt_coll_t*));
+  for (uint n = 0; n < nt->n_nodes; n++)
+    {
+      const uint n_slots = alloc->n_hwcs_per_socket[n];
+      mctop_nt_coll_t* coll = mctop_alloc_malloc_on_nth_socket(alloc, n, mctop_nt_coll_size(n_slots));
+      memset(coll, 0, mctop_nt_coll_size(n_slots));
+      coll->parent = parents[n];
+      coll->n_slots = n_slots;
+      coll->children = malloc_assert(nt->n_nodes * sizeof(uint));
+      nt->colls[n] = coll;
+    }
+
+  for (int l = nt->n_levels - 1; l >= 0; l--)
+    {
+      mctop_nt_lvl_t* level = &nt->levels[l];
+      for (uint p = 0; p < level->n_pairs; p++)
+	{
+	  mctop_nt_coll_t* coll = nt->colls[level->pairs[p].nodes[0]];
+	  coll->children[coll->n_children++] = level->pairs[p].nodes[1];
+	}
+    }
+
+  free(parents);
+}
+
 static size_t
 mctop_nt_get_n_participants(mctop_node_tree_t* nt, const uint sid, mctop_type_t barrier_for)
 {
@@ -245,17 +339,13 @@ mctop_node_tree_t*
 mctop_alloc_node_tree_create(mctop_alloc_t* alloc, mctop_type_t barrier_for)
 {
   const uint n_sockets = alloc->n_sockets;
-  if ((n_sockets) & (n_sockets - 1))
-    {
-      fprintf(stderr, "MCTOP Warning: %u nodes, not power of 2. The tree will be inbalanced!\n", n_sockets);
-    }
-  int n_lvls = floor_log_2(n_sockets);
+  const int n_lvls = ceil_log_2(n_sockets);
 
-  mctop_node_tree_t* nt = mctop_node_tree_alloc(n_lvls);
+  mctop_node_tree_t* nt = mctop_node_tree_alloc(n_lvls, n_sockets);
   nt->alloc = alloc;
-  nt->n_nodes = alloc->n_sockets;
 
   darray_t* socket_ids = darray_create(), * sids_avail = darray_create(), * sids_to_match = darray_create();
+  darray_t* sids_bye = darray_create();
 
   for (int s = 0; s < n_sockets; s++)
     {
@@ -265,6 +355,7 @@ mctop_alloc_node_tree_create(mctop_alloc_t* alloc, mctop_type_t barrier_for)
   for (int lvl = 0; lvl < n_lvls; lvl++)
     {
       uint n_part = 2 << lvl;
+      mctop_nt_lvl_t* level = mctop_nt_get_level(nt, lvl);
 
       darray_empty(sids_avail);
       darray_copy(sids_avail, socket_ids);
@@ -286,7 +377,29 @@ mctop_alloc_node_tree_create(mctop_alloc_t* alloc, mctop_type_t barrier_for)
       darray_remove_all(sids_avail, sids_to_match);
 #endif
 
-      for (int i = 0; i < n_part; i += 2)
+      /* last level of a non power of 2 # of nodes: the nodes that get a pair are spread over the
+	 tree (bit-reversed order), so that the pairs of the upper levels merge the same amount
+	 of data. The others (byes) are available to help, once the pairs are formed. */
+      if (level->n_pairs < (n_part / 2))
+	{
+	  darray_t* sids_all = darray_create_copy(sids_to_match);
+	  darray_empty(sids_to_match);
+	  for (uint p = 0; p < level->n_pairs; p++)
+	    {
+	      darray_add(sids_to_match, darray_get(sids_all, bit_reverse(p, lvl)));
+	    }
+	  DARRAY_FOR_EACH(sids_all, n)
+	    {
+	      const uint sid = DARRAY_GET_N(sids_all, n);
+	      if (!darray_exists(sids_to_match, sid))
+		{
+		  darray_add(sids_bye, sid);
+		}
+	    }
+	  darray_free(sids_all);
+	}
+
+      for (int i = 0; i < (level->n_pairs << 1); i += 2)
 	{
 	  uintptr_t sid;
 	  darray_pop(sids_to_match, &sid); 
@@ -319,8 +432,13 @@ mctop_alloc_node_tree_create(mctop_alloc_t* alloc, mctop_type_t barrier_for)
 		  }
 	    }
 	}
+      DARRAY_FOR_EACH(sids_bye, n)
+	{
+	  darray_add(sids_avail, DARRAY_GET_N(sids_bye, n));
+	}
+      darray_empty(sids_bye);
+
       uint n_avail = darray_get_num_elems(sids_avail);
-      mctop_nt_lvl_t* level = mctop_nt_get_level(nt, lvl);
       uint n_avail_per_pair = n_avail / level->n_pairs;
       if (n_avail_per_pair > MCTOP_NODE_TREE_MAX_HELP) 
 	{
@@ -364,7 +482,9 @@ mctop_alloc_node_tree_create(mctop_alloc_t* alloc, mctop_type_t barrier_for)
   mctop_node_tree_add_id_offsets(nt, barrier_for);
 
   nt->scratchpad = calloc_assert(nt->n_nodes, sizeof(void*));
+  mctop_node_tree_add_colls(nt);
 
+  darray_free(sids_bye);
   darray_free(sids_to_match);
   darray_free(sids_avail);
   darray_free(socket_ids);
@@ -373,25 +493,6 @@ mctop_alloc_node_tree_create(mctop_alloc_t* alloc, mctop_type_t barrier_for)
 }
 
 
-static mctop_nt_pair_t*
-mctop_nt_get_pair_for_node(mctop_node_tree_t* nt, const uint lvl, const uint node)
-{
-  if (lvl >= nt->n_levels)
-    {
-      return NULL;
-    }
-  mctop_nt_lvl_t* level = &nt->levels[lvl];
-  for (int p = 0; p < level->n_pairs; p++)
-    {
-      mctop_nt_pair_t* pair = &level->pairs[p];
-      if (pair->nodes[0] == node || pair->nodes[1] == node)
-	{
-	  return pair;
-	}
-    }
-  return NULL;
-}
-
 static mctop_nt_pair_t*
 mctop_nt_get_pair_for_node_all(mctop_node_tree_t* nt, const uint lvl, const uint node, uint* spot)
 {
@@ -529,3 +630,128 @@ mctop_node_tree_scratchpad_get(mctop_node_tree_t* nt, const uint node)
   return nt->scratchpad[node];
 }
 
+/* ******************************************************************************** */
+/* Collectives */
+/* ******************************************************************************** */
+
+static inline void
+mctop_nt_relax(mctop_node_tree_t* nt)
+{
+  if (unlikely(nt->yield))
+    {
+      sched_yield();
+    }
+  else
+    {
+      PAUSE();
+    }
+}
+
+static inline void
+mctop_nt_wait_epoch(mctop_node_tree_t* nt, volatile uint32_t* flag, const uint32_t epoch)
+{
+  while (__atomic_load_n(flag, __ATOMIC_ACQUIRE) != epoch)
+    {
+      mctop_nt_relax(nt);
+    }
+}
+
+static inline uint32_t
+mctop_nt_enter(mctop_node_tree_t* nt, void* data, mctop_nt_coll_t** coll)
+{
+  *coll = nt->colls[mctop_alloc_thread_node_id()];
+  mctop_nt_slot_t* slot = &(*coll)->slots[mctop_alloc_thread_insocket_id()];
+  const uint32_t epoch = slot->epoch + 1;
+  slot->data = data;
+  __atomic_store_n(&slot->epoch, epoch, __ATOMIC_RELEASE);
+  return epoch;
+}
+
+uint
+mctop_node_tree_is_root(mctop_node_tree_t* nt)
+{
+  return mctop_alloc_thread_is_node_leader() &&
+    mctop_alloc_thread_node_id() == mctop_node_tree_get_final_dest_node(nt);
+}
+
+uint
+mctop_nt_reduce(mctop_node_tree_t* nt, void* data, mctop_nt_combine_fun combine)
+{
+  mctop_nt_coll_t* coll;
+  const uint32_t epoch = mctop_nt_enter(nt, data, &coll);
+  if (!mctop_alloc_thread_is_node_leader())
+    {
+      /* data must stay untouched until the leader has combined it */
+      mctop_nt_wait_epoch(nt, &coll->combined, epoch);
+      return 0;
+    }
+
+  /* within the node: the slots are on the node, the data in the caches of the node */
+  for (uint s = 1; s < coll->n_slots; s++)
+    {
+      mctop_nt_slot_t* slot = &coll->slots[s];
+      mctop_nt_wait_epoch(nt, &slot->epoch, epoch);
+      combine(data, slot->data);
+    }
+  __atomic_store_n(&coll->combined, epoch, __ATOMIC_RELEASE);
+
+  /* across nodes: one cross-socket transfer per child */
+  for (uint c = 0; c < coll->n_children; c++)
+    {
+      mctop_nt_coll_t* child = nt->colls[coll->children[c]];
+      mctop_nt_wait_epoch(nt, &child->ready, epoch);
+      combine(data, child->data);
+      __atomic_store_n(&child->consumed, epoch, __ATOMIC_RELEASE);
+    }
+
+  const uint my_node = mctop_alloc_thread_node_id();
+  if (coll->parent == my_node)
+    {
+      return 1;
+    }
+
+  coll->data = data;
+  __atomic_store_n(&coll->ready, epoch, __ATOMIC_RELEASE);
+  mctop_nt_wait_epoch(nt, &coll->consumed, epoch);
+  return 0;
+}
+
+void
+mctop_nt_broadcast(mctop_node_tree_t* nt, void* data, const size_t size)
+{
+  mctop_nt_coll_t* coll;
+  const uint32_t epoch = mctop_nt_enter(nt, data, &coll);
+  if (!mctop_alloc_thread_is_node_leader())
+    {
+      mctop_nt_wait_epoch(nt, &coll->bcast, epoch);
+      memcpy(data, coll->data, size);
+      __atomic_fetch_add(&coll->n_copied, 1, __ATOMIC_RELEASE);
+      return;
+    }
+
+  const uint my_node = mctop_alloc_thread_node_id();
+  if (coll->parent != my_node)
+    {
+      mctop_nt_coll_t* parent = nt->colls[coll->parent];
+      mctop_nt_wait_epoch(nt, &parent->bcast, epoch);
+      memcpy(data, parent->data, size);
+      __atomic_fetch_add(&parent->n_copied, 1, __ATOMIC_RELEASE);
+    }
+
+  coll->data = data;
+  __atomic_store_n(&coll->bcast, epoch, __ATOMIC_RELEASE);
+
+  /* data must stay untouched until the threads of the node and the children have copied it */
+  coll->n_copied_expected += (coll->n_slots - 1) + coll->n_children;
+  while (__atomic_load_n(&coll->n_copied, __ATOMIC_ACQUIRE) != coll->n_copied_expected)
+    {
+      mctop_nt_relax(nt);
+    }
+}
+
+void
+mctop_nt_allreduce(mctop_node_tree_t* nt, void* data, const size_t size, mctop_nt_combine_fun combine)
+{
+  mctop_nt_reduce(nt, data, combine);
+  mctop_nt_broadcast(nt, data, size);
+}
@@ -69,10 +69,20 @@ mctop_prof_abs_diff(ticks a, ticks b)
 void
 mctop_prof_stats_calc(mctop_prof_t* prof, mctop_prof_stats_t* stats)
 {
-  qsort(prof->latencies, prof->size, sizeof(ticks), mctop_prof_comp_ticks);
-  stats->num_vals = prof->size;
+  mctop_prof_stats_calc_n(prof, prof->size, stats);
+}
+
+/* distribution-free CI: the ranks n/2 -+ z*sqrt(n)/2 of the sorted values */
+#define MCTOP_PROF_CI_Z 1.96
+
+void
+mctop_prof_stats_calc_n(mctop_prof_t* prof, const size_t n, mctop_prof_stats_t* stats)
+{
+  assert(n > 0 && n <= prof->size);
+  qsort(prof->latencies, n, sizeof(ticks), mctop_prof_comp_ticks);
+  stats->num_vals = n;
   
-  stats->median = prof->latencies[prof->size >> 1];
+  stats->median = prof->latencies[n >> 1];
   const size_t median2x = 2 * stats->median;
   size_t n_elems = 0;
   ticks sum = 0;
@@ -99,6 +109,12 @@ mctop_prof_stats_calc(mctop_prof_t* prof, mctop_prof_stats_t* stats)
     }
   stats->std_dev = sqrt(sum_diff_sqr / n_elems);
   stats->std_dev_perc = 100 * (1 - (avg - stats->std_dev) / avg);
+
+  const double ci_half = MCTOP_PROF_CI_Z * sqrt(n) / 2;
+  const double ci_low = floor((n / 2.0) - ci_half);
+  const double ci_high = ceil((n / 2.0) + ci_half);
+  stats->median_ci_low = prof->latencies[(ci_low < 0) ? 0 : (size_t) ci_low];
+  stats->median_ci_high = prof->latencies[(ci_high > (n - 1)) ? (n - 1) : (size_t) ci_high];
 }
 
 void
@@ -110,5 +126,6 @@ mctop_prof_stats_print(mctop_prof_stats_t* stats)
   printf("# Median        = %zu\n", stats->median);
   printf("# Std dev       = %.2f\n", stats->std_dev);
   printf("# Std dev%%      = %.2f%%\n", stats->std_dev_perc);
+  printf("# Median 95%% CI = [%zu, %zu]\n", stats->median_ci_low, stats->median_ci_high);
   printf("###########################\n");
 }
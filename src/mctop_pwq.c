@@ -0,0 +1,107 @@
+#include <mctop_alloc.h>
+#include <mctop_internal.h>
+
+/* Priority work queues: every priority level is a complete mctop_wq_t, i.e., a queue per
+   socket with the latency-ordered stealing. A dequeue drains the levels in order, thus urgent
+   work, local or remote, is never stuck behind less urgent work. */
+
+mctop_pwq_t*
+mctop_pwq_create(mctop_alloc_t* alloc, const mctop_wq_type_t type)
+{
+  mctop_pwq_t* pwq = malloc_assert(sizeof(mctop_pwq_t));
+  pwq->alloc = alloc;
+  pwq->n_prios = MCTOP_PWQ_N_PRIOS;
+  for (uint p = 0; p < pwq->n_prios; p++)
+    {
+      pwq->prios[p] = mctop_wq_create_type(alloc, type);
+    }
+  return pwq;
+}
+
+void
+mctop_pwq_free(mctop_pwq_t* pwq)
+{
+  for (uint p = 0; p < pwq->n_prios; p++)
+    {
+      mctop_wq_free(pwq->prios[p]);
+    }
+  free(pwq);
+}
+
+void
+mctop_pwq_print(mctop_pwq_t* pwq)
+{
+  printf("## MCTOP Priority Work Queue -- %u levels\n", pwq->n_prios);
+  mctop_wq_print(pwq->prios[0]);
+}
+
+static inline mctop_wq_t*
+mctop_pwq_level(mctop_pwq_t* pwq, const uint prio)
+{
+  return pwq->prios[(prio < pwq->n_prios) ? prio : (pwq->n_prios - 1)];
+}
+
+void
+mctop_pwq_enqueue(mctop_pwq_t* pwq, const uint prio, const void* data)
+{
+  mctop_wq_enqueue(mctop_pwq_level(pwq, prio), data);
+}
+
+void
+mctop_pwq_enqueue_nth_socket(mctop_pwq_t* pwq, const uint nth, const uint prio, const void* data)
+{
+  mctop_wq_enqueue_nth_socket(mctop_pwq_level(pwq, prio), nth, data);
+}
+
+void
+mctop_pwq_enqueue_node(mctop_pwq_t* pwq, const uint node, const uint prio, const void* data)
+{
+  mctop_wq_enqueue_node(mctop_pwq_level(pwq, prio), node, data);
+}
+
+void*
+mctop_pwq_dequeue(mctop_pwq_t* pwq, uint* prio)
+{
+  for (uint p = 0; p < pwq->n_prios; p++)
+    {
+      void* data = mctop_wq_dequeue(pwq->prios[p]);
+      if (data != NULL)
+	{
+	  if (prio != NULL)
+	    {
+	      *prio = p;
+	    }
+	  return data;
+	}
+    }
+  return NULL;
+}
+
+void*
+mctop_pwq_dequeue_local(mctop_pwq_t* pwq, uint* prio)
+{
+  for (uint p = 0; p < pwq->n_prios; p++)
+    {
+      void* data = mctop_wq_dequeue_local(pwq->prios[p]);
+      if (data != NULL)
+	{
+	  if (prio != NULL)
+	    {
+	      *prio = p;
+	    }
+	  return data;
+	}
+    }
+  return NULL;
+}
+
+size_t
+mctop_pwq_get_size_atomic(mctop_pwq_t* pwq)
+{
+  size_t s = 0;
+  for (uint p = 0; p < pwq->n_prios; p++)
+    {
+      s += mctop_wq_get_size_atomic(pwq->prios[p]);
+    }
+  return s;
+}
@@ -1,6 +1,7 @@
 #include <mctop.h>
 #include <mctop_internal.h>
 #include <darray.h>
+#include <sys/mman.h>
 
 cdf_cluster_t* mctop_infer_clustering(uint64_t** lat_table_norm, const size_t N);
 
@@ -14,6 +15,9 @@ void mctop_fix_horizontal_links(mctop_t* topo);
 static void mctop_fix_siblings_by_bandwidth(mctop_t* topo);
 void mctop_fix_n_hwcs_per_core_smt(mctop_t* topo);
 void mctop_mem_latencies_add(mctop_t* topo, uint64_t** mem_lat_table);
+void mctop_fix_lookup_tables(mctop_t* topo);
+void mctop_fix_flat_view(mctop_t* topo);
+extern uint mctop_gs_get_latency_walk(mctop_t* topo, hwc_gs_t* gs0, hwc_gs_t* gs1);
 
 extern void cdf_cluster_free(cdf_cluster_t* cc);
 extern cdf_cluster_t* cdf_cluster_create_empty(const int n_clusters);
@@ -152,6 +156,8 @@ mctop_construct(uint64_t** lat_table_norm, const size_t N,
   mctop_fix_horizontal_links(topo);
   mctop_fix_n_hwcs_per_core_smt(topo);
   mctop_mem_latencies_add(topo, mem_lat_table);
+  mctop_fix_lookup_tables(topo);
+  mctop_fix_flat_view(topo);
 
   if (free_cc)
     {
@@ -164,17 +170,16 @@ mctop_construct(uint64_t** lat_table_norm, const size_t N,
 void
 mctop_free(mctop_t* topo)
 {
-  /* free siblings */
-  for (int l = topo->socket_level + 1; l < topo->n_levels; l++)
+  if (topo->mmap_base != NULL)	/* the whole graph is in the mapping */
     {
-      sibling_t* sibling = mctop_get_first_sibling_lvl(topo, l);
-      do
-	{
-	  sibling_t* next = sibling->next;
-	  free(sibling);
-	  sibling = next;
-	}
-      while (sibling != NULL);
+      munmap(topo->mmap_base, topo->mmap_size);
+      return;
+    }
+
+  /* free siblings (all of them are in topo->siblings) */
+  for (int i = 0; i < topo->n_siblings; i++)
+    {
+      free(topo->siblings[i]);
     }
 
   /* free groups */
@@ -222,6 +227,10 @@ mctop_free(mctop_t* topo)
     }
 
   /* free topo */
+  free(topo->lat_table);
+  free(topo->flat.socket);
+  free(topo->flat.core);
+  free(topo->gs_index);
   free(topo->latencies);
   free(topo->sockets);
   free(topo->hwcs);
@@ -283,6 +292,13 @@ mctop_print(mctop_t* topo)
       printf("%-u ", topo->latencies[i]);
     }
   printf("\n");
+  printf(PD_0" Backoff quantum/max : ");
+  for (int i = 0; i < topo->n_levels; i++)
+    {
+      mctop_backoff_t b = mctop_backoff_get(topo, i);
+      printf("%u/%u ", b.quantum, b.max);
+    }
+  printf("\n");
 
   /* hwc level */
   int l = 0;
@@ -838,7 +854,124 @@ mctop_mem_latencies_add(mctop_t* topo, uint64_t** mem_lat_table)
 	    }
 	  socket->local_node = local_node;
 	  topo->node_to_socket[socket->local_node] = s;
+
+	  /* the crawler adds the mem. latencies after the flat view is built */
+	  if (topo->flat.node != NULL)
+	    {
+	      for (int i = 0; i < socket->n_hwcs; i++)
+		{
+		  topo->flat.node[socket->hwcs[i]->id] = local_node;
+		}
+	    }
+	}
+    }
+}
+
+/* precomputes the lookups of mctop_id_get_hwc_gs and mctop_ids_get_latency, which otherwise
+   walk the lists of groups and siblings */
+void
+mctop_fix_lookup_tables(mctop_t* topo)
+{
+  const uint n_hwcs = topo->n_hwcs;
+  const uint n_gs_lvls = (topo->socket_level > 1) ? (topo->socket_level - 1) : 0;
+  topo->gs_index = NULL;
+  if (n_gs_lvls > 0)
+    {
+      topo->gs_index = calloc_assert(n_gs_lvls * n_hwcs, sizeof(hwc_gs_t*));
+      for (uint l = 1; l < topo->socket_level; l++)
+	{
+	  for (hwc_gs_t* gs = mctop_get_first_gs_at_lvl(topo, l); gs != NULL; gs = gs->next)
+	    {
+	      const uint seq_id = mctop_id_no_lvl(gs->id);
+	      assert(seq_id < n_hwcs);
+	      topo->gs_index[(l - 1) * n_hwcs + seq_id] = gs;
+	    }
+	}
+    }
+
+  topo->lat_table = malloc_assert(n_hwcs * n_hwcs * sizeof(uint));
+  for (uint x = 0; x < n_hwcs; x++)
+    {
+      topo->lat_table[x * n_hwcs + x] = 0;
+      for (uint y = x + 1; y < n_hwcs; y++)
+	{
+	  const uint lat = mctop_gs_get_latency_walk(topo, (hwc_gs_t*) &topo->hwcs[x], (hwc_gs_t*) &topo->hwcs[y]);
+	  topo->lat_table[x * n_hwcs + y] = topo->lat_table[y * n_hwcs + x] = lat;
+	}
+    }
+}
+
+/* the per-hwc arrays are in one allocation, and so are the group pointers */
+void
+mctop_fix_flat_view(mctop_t* topo)
+{
+  mctop_flat_t* flat = &topo->flat;
+  const uint n_hwcs = topo->n_hwcs;
+  const uint n_gs_lvls = (topo->socket_level > 1) ? (topo->socket_level - 1) : 0;
+
+  flat->n_gs = 0;
+  for (uint l = 1; l < topo->socket_level; l++)
+    {
+      for (hwc_gs_t* gs = mctop_get_first_gs_at_lvl(topo, l); gs != NULL; gs = gs->next)
+	{
+	  flat->n_gs++;
+	}
+    }
+
+  uint* uints = malloc_assert(((5 * n_hwcs) + n_gs_lvls + 1) * sizeof(uint));
+  flat->socket = uints;
+  flat->node = uints + n_hwcs;
+  flat->nth_in_socket = uints + (2 * n_hwcs);
+  flat->nth_in_core = uints + (3 * n_hwcs);
+  flat->nth_core_in_socket = uints + (4 * n_hwcs);
+  flat->lvl_off = uints + (5 * n_hwcs);
+
+  hwc_gs_t** ptrs = malloc_assert((n_hwcs + flat->n_gs) * sizeof(hwc_gs_t*));
+  flat->core = ptrs;
+  flat->gs = ptrs + n_hwcs;
+
+  uint n = 0;
+  for (uint l = 1; l < topo->socket_level; l++)
+    {
+      flat->lvl_off[l - 1] = n;
+      for (hwc_gs_t* gs = mctop_get_first_gs_at_lvl(topo, l); gs != NULL; gs = gs->next)
+	{
+	  flat->gs[n++] = gs;
+	}
+    }
+  flat->lvl_off[n_gs_lvls] = n;
+
+  for (uint s = 0; s < topo->n_sockets; s++)
+    {
+      socket_t* socket = &topo->sockets[s];
+      uint i = 0;
+      for (hw_context_t* hwc = socket->hwcs[0]; hwc != NULL && i < socket->n_hwcs; hwc = hwc->next)
+	{
+	  flat->nth_in_socket[hwc->id] = i++;
+	}
+    }
+
+  for (uint h = 0; h < n_hwcs; h++)
+    {
+      hw_context_t* hwc = &topo->hwcs[h];
+      flat->socket[h] = hwc->socket - topo->sockets;
+      flat->node[h] = hwc->socket->local_node;
+      hwc_gs_t* core = (hwc->type == CORE) ? (hwc_gs_t*) hwc : hwc->parent;
+      flat->core[h] = core;
+      flat->nth_in_core[h] = 0;
+      for (uint i = 0; hwc->type != CORE && i < core->n_hwcs; i++)
+	{
+	  if (core->hwcs[i] == hwc)
+	    {
+	      flat->nth_in_core[h] = i;
+	    }
+	}
+      uint nth_core = 0;
+      for (hwc_gs_t* c = mctop_socket_get_first_gs_core(hwc->socket); c != NULL && c != core; c = c->next)
+	{
+	  nth_core++;
 	}
+      flat->nth_core_in_socket[h] = nth_core;
     }
 }
 
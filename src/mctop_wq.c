@@ -1,7 +1,8 @@
 #include <mctop_alloc.h>
 #include <mctop_internal.h>
+#include <helper.h>
 
-static mctop_queue_t* mctop_queue_create_on_seq(mctop_alloc_t* alloc, const uint sid);
+static mctop_queue_t* mctop_queue_create_on_seq(mctop_alloc_t* alloc, const uint sid, const mctop_wq_type_t type);
 
 
 /* sort an array of uint, but do not modify the actual array. Instead, return
@@ -31,17 +32,27 @@ mctop_sort_uint_index(const uint* arr, const uint n)
 
 mctop_wq_t*
 mctop_wq_create(mctop_alloc_t* alloc)
+{
+  return mctop_wq_create_type(alloc, MCTOP_WQ_LOCKED);
+}
+
+mctop_wq_t*
+mctop_wq_create_type(mctop_alloc_t* alloc, const mctop_wq_type_t type)
 {
   uint n_sockets = mctop_alloc_get_num_sockets(alloc);
   mctop_wq_t* wq = malloc_assert(sizeof(mctop_wq_t) +
 				 n_sockets * sizeof(mctop_queue_t*));
   wq->alloc = alloc;
+  wq->type = type;
   wq->n_queues = n_sockets;
   wq->n_entered = wq->n_exited = 0;
+  wq->park = wq->park_done = 0;
+  wq->park_idle = 0;
+  wq->stats = NULL;
 
   for (int i = 0; i < wq->n_queues; i++)
     {
-      wq->queues[i] = mctop_queue_create_on_seq(alloc, i);
+      wq->queues[i] = mctop_queue_create_on_seq(alloc, i, type);
     }
 
   for (int i = 0; i < wq->n_queues; i++)
@@ -74,7 +85,8 @@ mctop_wq_print(mctop_wq_t* wq)
 {
   mctop_alloc_t* alloc = wq->alloc;
 
-  printf("## MCTOP Work Queue -- %u per-node queues\n", wq->n_queues);
+  printf("## MCTOP Work Queue -- %u per-node %s queues\n", wq->n_queues,
+	 (wq->type == MCTOP_WQ_LOCK_FREE) ? "lock-free" : "locked");
   for (int i = 0; i < wq->n_queues; i++)
     {
       socket_t* s = mctop_alloc_get_nth_socket(alloc, i);
@@ -92,6 +104,7 @@ mctop_wq_print(mctop_wq_t* wq)
 
 
 static void mctop_queue_free(mctop_queue_t* q, const uint n_sockets);
+static void mctop_wq_stats_free(mctop_wq_t* wq);
 
 void
 mctop_wq_free(mctop_wq_t* wq)
@@ -100,11 +113,70 @@ mctop_wq_free(mctop_wq_t* wq)
     {
       mctop_queue_free(wq->queues[i], wq->n_queues);
     }
+  mctop_wq_stats_free(wq);
   free(wq);
 }
 
+/* ******************************************************************************** */
+/* list node pool */
+/* ******************************************************************************** */
+
+/* Every queue keeps a free list of list nodes, carved from slabs allocated on the queue's
+   node. Nodes are taken and returned while holding the queue lock, thus a (remote) dequeuer
+   returns the node to the pool of its queue and the list never touches the global heap. The
+   first node of each slab links the slabs. */
+
+static void
+mctop_queue_pool_refill(mctop_queue_t* qu)
+{
+  mctop_qnode_t* slab = mctop_alloc_malloc_on_nth_socket(qu->alloc, qu->nth_socket,
+							  MCTOP_WQ_SLAB_SIZE * sizeof(mctop_qnode_t));
+  slab->next = qu->slabs;
+  qu->slabs = slab;
+
+  for (uint i = 1; i < MCTOP_WQ_SLAB_SIZE; i++)
+    {
+      slab[i].next = (i + 1 < MCTOP_WQ_SLAB_SIZE) ? &slab[i + 1] : qu->free;
+    }
+  qu->free = &slab[1];
+}
+
+static inline mctop_qnode_t*
+mctop_queue_node_get(mctop_queue_t* qu)
+{
+  if (unlikely(qu->free == NULL))
+    {
+      mctop_queue_pool_refill(qu);
+    }
+  mctop_qnode_t* node = qu->free;
+  qu->free = node->next;
+  node->next = NULL;
+  return node;
+}
+
+/* returns the chain first -> ... -> last to the pool */
+static inline void
+mctop_queue_node_put(mctop_queue_t* qu, mctop_qnode_t* first, mctop_qnode_t* last)
+{
+  last->next = qu->free;
+  qu->free = first;
+}
+
+static void
+mctop_queue_pool_free(mctop_queue_t* qu)
+{
+  mctop_qnode_t* slab = qu->slabs;
+  while (slab != NULL)
+    {
+      mctop_qnode_t* next = slab->next;
+      mctop_alloc_malloc_free(slab, MCTOP_WQ_SLAB_SIZE * sizeof(mctop_qnode_t));
+      slab = next;
+    }
+  qu->free = qu->slabs = NULL;
+}
+
 static mctop_queue_t*
-mctop_queue_create_on_seq(mctop_alloc_t* alloc, const uint sid)
+mctop_queue_create_on_seq(mctop_alloc_t* alloc, const uint sid, const mctop_wq_type_t type)
 {
   size_t qsize = sizeof(mctop_queue_t) + (alloc->n_sockets * sizeof(uint));
   mctop_queue_t* q = mctop_alloc_malloc_on_nth_socket(alloc,
@@ -112,17 +184,40 @@ mctop_queue_create_on_seq(mctop_alloc_t* alloc, const uint sid)
 						      qsize);
   q->lock = 0;
   q->size = 0;
-  mctop_qnode_t* n = malloc_assert(sizeof(mctop_qnode_t));
+  q->alloc = alloc;
+  q->nth_socket = sid;
+  q->free = q->slabs = NULL;
+  mctop_qnode_t* n = mctop_queue_node_get(q);
   n->data = NULL;
   n->next = NULL;
   q->head = q->tail = n;
+
+  q->type = type;
+  q->ring = NULL;
+  q->ring_mask = 0;
+  q->enq_pos = q->deq_pos = 0;
+  q->park_seq = q->n_parked = 0;
+  if (type == MCTOP_WQ_LOCK_FREE)
+    {
+      q->ring = mctop_alloc_malloc_on_nth_socket(alloc, sid, MCTOP_WQ_RING_SIZE * sizeof(mctop_qslot_t));
+      q->ring_mask = MCTOP_WQ_RING_SIZE - 1;
+      for (size_t i = 0; i < MCTOP_WQ_RING_SIZE; i++)
+	{
+	  q->ring[i].seq = i;
+	  q->ring[i].data = NULL;
+	}
+    }
   return q;
 }
 
 static void
 mctop_queue_free(mctop_queue_t* q, const uint n_sockets)
 {
-  free(q->head);
+  if (q->ring != NULL)
+    {
+      mctop_alloc_malloc_free(q->ring, MCTOP_WQ_RING_SIZE * sizeof(mctop_qslot_t));
+    }
+  mctop_queue_pool_free(q);
   size_t qsize = sizeof(mctop_queue_t) + (n_sockets * sizeof(uint));
   mctop_alloc_malloc_free(q, qsize);
 }
@@ -221,19 +316,249 @@ mctop_queue_unlock(mctop_queue_t* qu)
 
 #endif	/* __TSX__ */
 
+/* deq_pos never passes enq_pos and is loaded first, so concurrent operations can only make the
+   ring look larger. The difference is still clamped to 0, in case the loads are reordered. */
 static inline size_t
 mctop_queue_size(mctop_queue_t* qu)
 {
-  return qu->size;
+  const size_t deq_pos = __atomic_load_n(&qu->deq_pos, __ATOMIC_ACQUIRE);
+  const size_t enq_pos = __atomic_load_n(&qu->enq_pos, __ATOMIC_ACQUIRE);
+  const intptr_t n_ring = (intptr_t) (enq_pos - deq_pos);
+  return qu->size + ((n_ring > 0) ? n_ring : 0);
+}
+
+/* Lock-free bounded MPMC ring (D. Vyukov): the sequence number of each slot tells whether
+   the slot is free for the enqueue at position pos (seq == pos) or holds the data for the
+   dequeue at pos (seq == pos + 1). A ring that is full makes the enqueue fall back to the
+   locked list. A dequeue waits for an enqueue that has claimed its slot but not yet filled
+   it, so that NULL always means empty. */
+
+static inline int
+mctop_queue_ring_enqueue(mctop_queue_t* qu, const void* data)
+{
+  size_t pos = qu->enq_pos;
+  mctop_qslot_t* slot;
+  while (1)
+    {
+      slot = &qu->ring[pos & qu->ring_mask];
+      const size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+      const intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+      if (diff == 0)
+	{
+	  const size_t pos_old = CAS_U64(&qu->enq_pos, pos, pos + 1);
+	  if (pos_old == pos)
+	    {
+	      break;
+	    }
+	  pos = pos_old;
+	}
+      else if (diff < 0)
+	{
+	  return 0;		/* full */
+	}
+      else
+	{
+	  pos = qu->enq_pos;
+	}
+    }
+
+  slot->data = data;
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static inline void*
+mctop_queue_ring_dequeue(mctop_queue_t* qu)
+{
+  size_t pos = qu->deq_pos;
+  mctop_qslot_t* slot;
+  while (1)
+    {
+      slot = &qu->ring[pos & qu->ring_mask];
+      const size_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+      const intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+      if (diff == 0)
+	{
+	  const size_t pos_old = CAS_U64(&qu->deq_pos, pos, pos + 1);
+	  if (pos_old == pos)
+	    {
+	      break;
+	    }
+	  pos = pos_old;
+	}
+      else if (diff < 0)
+	{
+	  if (qu->enq_pos == pos)
+	    {
+	      return NULL;	/* empty */
+	    }
+	  PAUSE();		/* the enqueue of pos is not complete yet */
+	  pos = qu->deq_pos;
+	}
+      else
+	{
+	  pos = qu->deq_pos;
+	}
+    }
+
+  void* data = (void*) slot->data;
+  __atomic_store_n(&slot->seq, pos + qu->ring_mask + 1, __ATOMIC_RELEASE);
+  return data;
+}
+
+/* Batches claim their slots with a single CAS. They only claim slots that are ready (free for
+   an enqueue, filled for a dequeue), thus never wait for a stalled thread. */
+
+static inline int
+mctop_queue_ring_enqueue_batch(mctop_queue_t* qu, const void** data, const uint n)
+{
+  size_t pos = qu->enq_pos;
+  while (1)
+    {
+      uint i;
+      for (i = 0; i < n; i++)
+	{
+	  const mctop_qslot_t* slot = &qu->ring[(pos + i) & qu->ring_mask];
+	  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (pos + i))
+	    {
+	      break;
+	    }
+	}
+      if (i < n)
+	{
+	  const size_t pos_cur = qu->enq_pos;
+	  if (pos_cur == pos)
+	    {
+	      return 0;		/* full (or not yet released by a dequeue) */
+	    }
+	  pos = pos_cur;
+	  continue;
+	}
+
+      const size_t pos_old = CAS_U64(&qu->enq_pos, pos, pos + n);
+      if (pos_old == pos)
+	{
+	  break;
+	}
+      pos = pos_old;
+    }
+
+  for (uint i = 0; i < n; i++)
+    {
+      mctop_qslot_t* slot = &qu->ring[(pos + i) & qu->ring_mask];
+      slot->data = data[i];
+      __atomic_store_n(&slot->seq, pos + i + 1, __ATOMIC_RELEASE);
+    }
+  return 1;
+}
+
+/* dequeues at most max elements; with half set, at most half of the elements in the ring */
+static inline uint
+mctop_queue_ring_dequeue_batch(mctop_queue_t* qu, void** data, const uint max, const uint half)
+{
+  size_t pos = qu->deq_pos;
+  size_t n;
+  while (1)
+    {
+      const size_t avail = qu->enq_pos - pos;
+      size_t n_max = half ? ((avail + 1) / 2) : avail;
+      n_max = (n_max < max) ? n_max : max;
+      for (n = 0; n < n_max; n++)
+	{
+	  const mctop_qslot_t* slot = &qu->ring[(pos + n) & qu->ring_mask];
+	  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != (pos + n + 1))
+	    {
+	      break;
+	    }
+	}
+      if (n == 0)
+	{
+	  const size_t pos_cur = qu->deq_pos;
+	  if (pos_cur == pos)
+	    {
+	      return 0;
+	    }
+	  pos = pos_cur;
+	  continue;
+	}
+
+      const size_t pos_old = CAS_U64(&qu->deq_pos, pos, pos + n);
+      if (pos_old == pos)
+	{
+	  break;
+	}
+      pos = pos_old;
+    }
+
+  for (size_t i = 0; i < n; i++)
+    {
+      mctop_qslot_t* slot = &qu->ring[(pos + i) & qu->ring_mask];
+      data[i] = (void*) slot->data;
+      __atomic_store_n(&slot->seq, pos + i + qu->ring_mask + 1, __ATOMIC_RELEASE);
+    }
+  return n;
 }
 
+static void mctop_queue_list_enqueue(mctop_queue_t* qu, const void* data);
+static void* mctop_queue_list_dequeue(mctop_queue_t* qu);
+static void mctop_queue_list_enqueue_batch(mctop_queue_t* qu, const void** data, const uint n);
+static uint mctop_queue_list_dequeue_batch(mctop_queue_t* qu, void** data, const uint max, const uint half);
+
 void
 mctop_queue_enqueue(mctop_queue_t* qu, const void* data)
 {
-  mctop_qnode_t* node = malloc_assert(sizeof(mctop_qnode_t));
-  node->data = data;
+  if (qu->type == MCTOP_WQ_LOCK_FREE && likely(mctop_queue_ring_enqueue(qu, data)))
+    {
+      return;
+    }
+  mctop_queue_list_enqueue(qu, data);
+}
 
+void*
+mctop_queue_dequeue(mctop_queue_t* qu)
+{
+  if (qu->type == MCTOP_WQ_LOCK_FREE)
+    {
+      void* data = mctop_queue_ring_dequeue(qu);
+      if (data != NULL)
+	{
+	  return data;
+	}
+    }
+  return mctop_queue_list_dequeue(qu);
+}
+
+void
+mctop_queue_enqueue_batch(mctop_queue_t* qu, const void** data, const uint n)
+{
+  if (n == 0 || (qu->type == MCTOP_WQ_LOCK_FREE && likely(mctop_queue_ring_enqueue_batch(qu, data, n))))
+    {
+      return;
+    }
+  mctop_queue_list_enqueue_batch(qu, data, n);
+}
+
+uint
+mctop_queue_dequeue_batch(mctop_queue_t* qu, void** data, const uint max, const uint half)
+{
+  uint n = 0;
+  if (qu->type == MCTOP_WQ_LOCK_FREE)
+    {
+      n = mctop_queue_ring_dequeue_batch(qu, data, max, half);
+    }
+  if (n < max && qu->size > 0)
+    {
+      n += mctop_queue_list_dequeue_batch(qu, data + n, max - n, half);
+    }
+  return n;
+}
+
+static void
+mctop_queue_list_enqueue(mctop_queue_t* qu, const void* data)
+{
   mctop_queue_lock(qu);
+  mctop_qnode_t* node = mctop_queue_node_get(qu);
+  node->data = data;
   qu->tail->next = node;
   qu->tail = node;
 
@@ -241,8 +566,8 @@ mctop_queue_enqueue(mctop_queue_t* qu, const void* data)
   mctop_queue_unlock(qu);
 }
 
-void*
-mctop_queue_dequeue(mctop_queue_t* qu)
+static void*
+mctop_queue_list_dequeue(mctop_queue_t* qu)
 {
   if (qu->size == 0)
     {
@@ -261,49 +586,213 @@ mctop_queue_dequeue(mctop_queue_t* qu)
   void* data = (void*) head_new->data;
 
   qu->head = head_new;
+  mctop_queue_node_put(qu, node, node);
 
   qu->size--;
   mctop_queue_unlock(qu);
 
-  free(node);
-
   return data;
 }
 
+/* the whole batch is appended within a single critical section */
+static void
+mctop_queue_list_enqueue_batch(mctop_queue_t* qu, const void** data, const uint n)
+{
+  mctop_queue_lock(qu);
+  mctop_qnode_t* last = qu->tail;
+  for (uint i = 0; i < n; i++)
+    {
+      mctop_qnode_t* node = mctop_queue_node_get(qu);
+      node->data = data[i];
+      last->next = node;
+      last = node;
+    }
+  qu->tail = last;
+
+  qu->size += n;
+  mctop_queue_unlock(qu);
+}
+
+static uint
+mctop_queue_list_dequeue_batch(mctop_queue_t* qu, void** data, const uint max, const uint half)
+{
+  if (qu->size == 0)
+    {
+      return 0;
+    }
+
+  mctop_queue_lock(qu);
+  size_t n = half ? ((qu->size + 1) / 2) : qu->size;
+  n = (n < max) ? n : max;
+  if (n == 0)
+    {
+      mctop_queue_unlock(qu);
+      return 0;
+    }
+
+  mctop_qnode_t* head = qu->head;
+  mctop_qnode_t* prev = head, * cur = head->next;
+  for (size_t i = 0; i < n; i++)
+    {
+      data[i] = (void*) cur->data;
+      if (i + 1 < n)
+	{
+	  prev = cur;
+	  cur = cur->next;
+	}
+    }
+  qu->head = cur;
+  mctop_queue_node_put(qu, head, prev); /* the old head and all but the last dequeued */
+
+  qu->size -= n;
+  mctop_queue_unlock(qu);
+
+  return n;
+}
+
 /* ******************************************************************************** */
-/* high-level enqueue / dequeue */
+/* parking */
 /* ******************************************************************************** */
 
-#define MCTOP_WQ_PROF 0
-#if MCTOP_WQ_PROF == 1
-#  include <helper.h>
-#  define GETTICKS_IN(s) ticks s = getticks();
-#  define GETTICKS_SUM(sum, add) sum += add;
-#  define INC(x) x++
-__thread ticks __mctop_wq_prof_enqueue_n = 1,
-  __mctop_wq_prof_enqueue_t = 0,
-  __mctop_wq_prof_dequeue_local_n = 1,
-  __mctop_wq_prof_dequeue_local_t = 0,
-  __mctop_wq_prof_dequeue_n[8] = { 1, 1, 1, 1, 1, 1, 1, 1 },
-  __mctop_wq_prof_dequeue_t[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+#include <limits.h>
 
-#else
-#  define GETTICKS_IN(s) 
-#  define GETTICKS_SUM(sum, add)
-#  define INC(x)
-#endif
+/* park_idle: the low 32 bits count the idle threads. Becoming idle also increments the
+   generation (high bits), thus the word changes whenever a thread becomes or stops being
+   idle. The termination CAS succeeds only if nobody did, while all the queues were empty. */
+#define MCTOP_WQ_IDLE_ENTER ((1ULL << 32) + 1)
+#define MCTOP_WQ_IDLE_N(w)  ((uint32_t) (w))
 
 void
-mctop_wq_enqueue(mctop_wq_t* wq, const void* data)
+mctop_wq_set_park(mctop_wq_t* wq, const uint park)
+{
+  wq->park = park;
+}
+
+static inline int
+mctop_wq_has_work(mctop_wq_t* wq)
+{
+  for (int i = 0; i < wq->n_queues; i++)
+    {
+      if (mctop_queue_size(wq->queues[i]) > 0)
+	{
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+/* after an enqueue on queue nth: wake a thread parked on that socket, else on the closest
+   socket that has parked threads */
+static inline void
+mctop_wq_unpark(mctop_wq_t* wq, const uint nth)
 {
-  INC(__mctop_wq_prof_enqueue_n);
-  GETTICKS_IN(__s);
+  if (likely(!wq->park))
+    {
+      return;
+    }
 
+  __atomic_thread_fence(__ATOMIC_SEQ_CST); /* the enqueue before reading n_parked */
+  mctop_queue_t* qu = wq->queues[nth];
+  if (qu->n_parked == 0)
+    {
+      mctop_queue_t* qun = NULL;
+      for (int q = 0; q < (wq->n_queues - 1); q++)
+	{
+	  if (wq->queues[qu->next_q[q]]->n_parked > 0)
+	    {
+	      qun = wq->queues[qu->next_q[q]];
+	      break;
+	    }
+	}
+      if (qun == NULL)
+	{
+	  return;
+	}
+      qu = qun;
+    }
+
+  __atomic_add_fetch(&qu->park_seq, 1, __ATOMIC_SEQ_CST);
+  mctop_futex_wake(&qu->park_seq, 1);
+}
+
+static void
+mctop_wq_unpark_all(mctop_wq_t* wq)
+{
+  for (int i = 0; i < wq->n_queues; i++)
+    {
+      mctop_queue_t* qu = wq->queues[i];
+      __atomic_add_fetch(&qu->park_seq, 1, __ATOMIC_SEQ_CST);
+      mctop_futex_wake(&qu->park_seq, INT_MAX);
+    }
+}
+
+/* the last idle thread never parks: it keeps checking for termination */
+static void
+mctop_wq_park(mctop_wq_t* wq)
+{
+  const uint n_hwcs = wq->alloc->n_hwcs;
   mctop_queue_t* qu = wq->queues[mctop_alloc_thread_node_id()];
-  mctop_queue_enqueue(qu, data);
+  const uint32_t seq = __atomic_load_n(&qu->park_seq, __ATOMIC_ACQUIRE);
+  __atomic_add_fetch(&qu->n_parked, 1, __ATOMIC_SEQ_CST);
+  if (!wq->park_done && !mctop_wq_has_work(wq) && MCTOP_WQ_IDLE_N(wq->park_idle) < n_hwcs)
+    {
+      mctop_futex_wait(&qu->park_seq, seq);
+    }
+  __atomic_sub_fetch(&qu->n_parked, 1, __ATOMIC_SEQ_CST);
+}
 
-  GETTICKS_IN(__e);
-  GETTICKS_SUM(__mctop_wq_prof_enqueue_t, __e - __s);
+/* ******************************************************************************** */
+/* high-level enqueue / dequeue */
+/* ******************************************************************************** */
+
+/* statistics of the calling thread, NULL if disabled */
+static inline mctop_wq_stats_t*
+mctop_wq_stats_thread(mctop_wq_t* wq)
+{
+  if (likely(wq->stats == NULL))
+    {
+      return NULL;
+    }
+  const int id = mctop_alloc_thread_id();
+  return (id >= 0) ? wq->stats[id] : NULL;
+}
+
+/* the steals are always timed, local dequeues only 1 in MCTOP_WQ_STATS_SAMPLE */
+#define MCTOP_WQ_STATS_TICKS(st) (((st) != NULL) ? getticks() : 0)
+
+static inline ticks
+mctop_wq_stats_ticks_local(mctop_wq_stats_t* st)
+{
+  if (st != NULL && ((st->n_dequeue_local + st->n_empty) & (MCTOP_WQ_STATS_SAMPLE - 1)) == 0)
+    {
+      return getticks();
+    }
+  return 0;
+}
+
+static inline void
+mctop_wq_stats_local(mctop_wq_stats_t* st, const size_t n, const ticks s)
+{
+  st->n_dequeue_local += n;
+  if (s != 0)
+    {
+      st->n_dequeue_local_timed += n;
+      st->cycles_local += getticks() - s;
+    }
+}
+
+void
+mctop_wq_enqueue(mctop_wq_t* wq, const void* data)
+{
+  const uint nth = mctop_alloc_thread_node_id();
+  mctop_queue_enqueue(wq->queues[nth], data);
+  mctop_wq_unpark(wq, nth);
+
+  mctop_wq_stats_t* st = mctop_wq_stats_thread(wq);
+  if (st != NULL)
+    {
+      st->n_enqueue++;
+    }
 }
 
 inline void
@@ -311,6 +800,13 @@ mctop_wq_enqueue_nth_socket(mctop_wq_t* wq, const uint nth, const void* data)
 {
   mctop_queue_t* qu = wq->queues[nth];
   mctop_queue_enqueue(qu, data);
+  mctop_wq_unpark(wq, nth);
+
+  mctop_wq_stats_t* st = mctop_wq_stats_thread(wq);
+  if (st != NULL)
+    {
+      st->n_enqueue++;
+    }
 }
 
 inline void
@@ -321,52 +817,157 @@ mctop_wq_enqueue_node(mctop_wq_t* wq, const uint node, const void* data)
 }
 
 
-void*
-mctop_wq_dequeue(mctop_wq_t* wq)
+void
+mctop_wq_enqueue_batch(mctop_wq_t* wq, const void** data, const uint n)
 {
-  GETTICKS_IN(__s);
+  mctop_wq_enqueue_batch_nth_socket(wq, mctop_alloc_thread_node_id(), data, n);
+}
+
+inline void
+mctop_wq_enqueue_batch_nth_socket(mctop_wq_t* wq, const uint nth, const void** data, const uint n)
+{
+  mctop_queue_enqueue_batch(wq->queues[nth], data, n);
+  mctop_wq_unpark(wq, nth);
+
+  mctop_wq_stats_t* st = mctop_wq_stats_thread(wq);
+  if (st != NULL)
+    {
+      st->n_enqueue += n;
+    }
+}
+
+inline void
+mctop_wq_enqueue_batch_node(mctop_wq_t* wq, const uint node, const void** data, const uint n)
+{
+  const uint nth = mctop_alloc_node_to_nth_socket(wq->alloc, node);
+  mctop_wq_enqueue_batch_nth_socket(wq, nth, data, n);
+}
+
+uint
+mctop_wq_dequeue_batch(mctop_wq_t* wq, void** data, const uint max)
+{
+  mctop_wq_stats_t* st = mctop_wq_stats_thread(wq);
+  const ticks sl = mctop_wq_stats_ticks_local(st);
 
   mctop_queue_t* qu = wq->queues[mctop_alloc_thread_node_id()];
-  void* data = mctop_queue_dequeue(qu);
-  if (data != NULL)
+  uint n = mctop_queue_dequeue_batch(qu, data, max, 0);
+  if (n > 0)
     {
-      GETTICKS_IN(__e);
-      GETTICKS_SUM(__mctop_wq_prof_dequeue_local_t, __e - __s);
-      INC(__mctop_wq_prof_dequeue_local_n);
+      if (st != NULL)
+	{
+	  mctop_wq_stats_local(st, n, sl);
+	}
+      return n;
+    }
 
-      return data;
+  for (int q = 0; q < (wq->n_queues - 1); q++)
+    {
+      const ticks s = MCTOP_WQ_STATS_TICKS(st);
+      mctop_queue_t* qun = wq->queues[qu->next_q[q]];
+      n = mctop_queue_dequeue_batch(qun, data, max, 1);
+      if (n > 0)
+	{
+	  if (st != NULL)
+	    {
+	      st->steal[q].n += n;
+	      st->steal[q].cycles += getticks() - s;
+	    }
+	  return n;
+	}
+      else if (st != NULL)
+	{
+	  st->steal[q].n_empty++;
+	}
     }
 
+  if (st != NULL)
+    {
+      st->n_empty++;
+    }
+  return 0;
+}
+
+/* the last queue in next_q is the local one */
+static inline void*
+mctop_wq_dequeue_steal(mctop_wq_t* wq, const mctop_queue_t* qu, mctop_wq_stats_t* st)
+{
   for (int q = 0; q < wq->n_queues; q++)
     {
-      GETTICKS_IN(__s);
+      ticks s = MCTOP_WQ_STATS_TICKS(st);
       const uint next = qu->next_q[q];
       mctop_queue_t* qun = wq->queues[next];
       void* data = mctop_queue_dequeue(qun);
+      if (st != NULL)
+	{
+	  if (q == (wq->n_queues - 1))
+	    {
+	      if (data != NULL)
+		{
+		  mctop_wq_stats_local(st, 1, s);
+		}
+	    }
+	  else if (data != NULL)
+	    {
+	      st->steal[q].n++;
+	      st->steal[q].cycles += getticks() - s;
+	    }
+	  else
+	    {
+	      st->steal[q].n_empty++;
+	    }
+	}
       if (data != NULL)
 	{
-	  GETTICKS_IN(__e);
-	  GETTICKS_SUM(__mctop_wq_prof_dequeue_t[q], __e - __s);
-	  INC(__mctop_wq_prof_dequeue_n[q]);
-
 	  return data;
 	}
     }
 
+  if (st != NULL)
+    {
+      st->n_empty++;
+    }
   return NULL;
 }
 
 void*
-mctop_wq_dequeue_local(mctop_wq_t* wq)
+mctop_wq_dequeue(mctop_wq_t* wq)
 {
-  GETTICKS_IN(__s);
+  mctop_wq_stats_t* st = mctop_wq_stats_thread(wq);
+  const ticks s = mctop_wq_stats_ticks_local(st);
+
   mctop_queue_t* qu = wq->queues[mctop_alloc_thread_node_id()];
   void* data = mctop_queue_dequeue(qu);
+  if (data != NULL)
+    {
+      if (st != NULL)
+	{
+	  mctop_wq_stats_local(st, 1, s);
+	}
+      return data;
+    }
 
-  GETTICKS_IN(__e);
-  GETTICKS_SUM(__mctop_wq_prof_dequeue_local_t, __e - __s);
-  INC(__mctop_wq_prof_dequeue_local_n);
+  return mctop_wq_dequeue_steal(wq, qu, st);
+}
 
+void*
+mctop_wq_dequeue_local(mctop_wq_t* wq)
+{
+  mctop_wq_stats_t* st = mctop_wq_stats_thread(wq);
+  const ticks s = mctop_wq_stats_ticks_local(st);
+
+  mctop_queue_t* qu = wq->queues[mctop_alloc_thread_node_id()];
+  void* data = mctop_queue_dequeue(qu);
+  if (st != NULL)
+    {
+      if (data != NULL)
+	{
+	  mctop_wq_stats_local(st, 1, s);
+	}
+      else
+	{
+	  st->n_empty++;
+	}
+    }
   return data;
 }
 
@@ -374,25 +975,56 @@ void*
 mctop_wq_dequeue_remote(mctop_wq_t* wq)
 {
   const mctop_queue_t* qu = wq->queues[mctop_alloc_thread_node_id()];
-  for (int q = 0; q < wq->n_queues; q++)
+  return mctop_wq_dequeue_steal(wq, qu, mctop_wq_stats_thread(wq));
+}
+
+void*
+mctop_wq_dequeue_wait(mctop_wq_t* wq)
+{
+  const uint n_hwcs = wq->alloc->n_hwcs;
+  while (1)
     {
-      GETTICKS_IN(__s);
-      const uint next = qu->next_q[q];
-      mctop_queue_t* qun = wq->queues[next];
-      void* data = mctop_queue_dequeue(qun);
+      void* data = mctop_wq_dequeue(wq);
       if (data != NULL)
 	{
-	  GETTICKS_IN(__e);
-	  GETTICKS_SUM(__mctop_wq_prof_dequeue_t[q], __e - __s);
-	  INC(__mctop_wq_prof_dequeue_n[q]);
-
 	  return data;
 	}
-    }
 
-  return NULL;
-}
+      __atomic_add_fetch(&wq->park_idle, MCTOP_WQ_IDLE_ENTER, __ATOMIC_SEQ_CST);
+      uint spins = 0;
+      while (1)
+	{
+	  if (wq->park_done)
+	    {
+	      return NULL;
+	    }
+	  if (mctop_wq_has_work(wq))
+	    {
+	      break;
+	    }
 
+	  uint64_t idle = __atomic_load_n(&wq->park_idle, __ATOMIC_SEQ_CST);
+	  if (MCTOP_WQ_IDLE_N(idle) == n_hwcs)
+	    {
+	      if (!mctop_wq_has_work(wq) &&
+		  __atomic_compare_exchange_n(&wq->park_idle, &idle, idle, 0,
+					      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+		{
+		  wq->park_done = 1;
+		  mctop_wq_unpark_all(wq);
+		  return NULL;
+		}
+	    }
+	  else if (++spins >= MCTOP_WQ_PARK_SPINS)
+	    {
+	      mctop_wq_park(wq);
+	      spins = 0;
+	    }
+	  PAUSE();
+	}
+      __atomic_sub_fetch(&wq->park_idle, 1, __ATOMIC_SEQ_CST);
+    }
+}
 
 size_t
 mctop_wq_get_size_atomic(mctop_wq_t* wq)
@@ -447,71 +1079,173 @@ mctop_wq_is_last_thread(mctop_wq_t* wq)
   return wq->n_entered == wq->alloc->n_hwcs && wq->n_exited == (wq->alloc->n_hwcs - 1);
 }
 
-void
-mctop_wq_stats_print(mctop_wq_t* wq)
+/* ******************************************************************************** */
+/* statistics */
+/* ******************************************************************************** */
+
+static size_t
+mctop_wq_stats_size(mctop_wq_t* wq)
 {
-#if MCTOP_WQ_PROF == 1
-  for (int i = 0; i < 8; i++)
+  const size_t size = sizeof(mctop_wq_stats_t) + (wq->n_queues - 1) * sizeof(mctop_wq_steal_stats_t);
+  return (size + 63) & ~((size_t) 63);
+}
+
+static uint
+mctop_wq_hwc_nth_socket(mctop_alloc_t* alloc, const uint id)
+{
+  socket_t* socket = mctop_hwcid_get_socket(alloc->topo, alloc->hwcs[id]);
+  for (uint s = 0; s < alloc->n_sockets; s++)
     {
-      if (__mctop_wq_prof_dequeue_n[i] > 1)
+      if (alloc->sockets[s] == socket)
 	{
-	  __mctop_wq_prof_dequeue_n[i]--;
+	  return s;
 	}
     }
+  return 0;
+}
+
+void
+mctop_wq_stats_enable(mctop_wq_t* wq)
+{
+  if (wq->stats != NULL)
+    {
+      return;
+    }
+
+  mctop_alloc_t* alloc = wq->alloc;
+  const size_t size = mctop_wq_stats_size(wq);
+  mctop_wq_stats_t** stats = malloc_assert(alloc->n_hwcs * sizeof(mctop_wq_stats_t*));
+  for (uint i = 0; i < alloc->n_hwcs; i++)
+    {
+      const uint nth = mctop_wq_hwc_nth_socket(alloc, i);
+      mctop_wq_stats_t* st = mctop_alloc_malloc_on_nth_socket(alloc, nth, size);
+      memset(st, 0, size);
+      st->nth_socket = nth;
+      st->n_dists = wq->n_queues - 1;
+      stats[i] = st;
+    }
+  wq->stats = stats;
+}
+
+static void
+mctop_wq_stats_free(mctop_wq_t* wq)
+{
+  if (wq->stats == NULL)
+    {
+      return;
+    }
+  const size_t size = mctop_wq_stats_size(wq);
+  for (uint i = 0; i < wq->alloc->n_hwcs; i++)
+    {
+      mctop_alloc_malloc_free(wq->stats[i], size);
+    }
+  free(wq->stats);
+  wq->stats = NULL;
+}
 
-  if (__mctop_wq_prof_enqueue_n > 1)
+mctop_wq_stats_t*
+mctop_wq_stats_get(mctop_wq_t* wq, const uint nth)
+{
+  if (wq->stats == NULL)
     {
-      __mctop_wq_prof_enqueue_n--;
+      return NULL;
     }
 
-  if (__mctop_wq_prof_dequeue_local_n > 1)
+  mctop_wq_stats_t* sum = calloc_assert(1, mctop_wq_stats_size(wq));
+  sum->nth_socket = nth;
+  sum->n_dists = wq->n_queues - 1;
+  for (uint i = 0; i < wq->alloc->n_hwcs; i++)
     {
-      __mctop_wq_prof_dequeue_local_n--;
+      const mctop_wq_stats_t* st = wq->stats[i];
+      if (nth < wq->n_queues && st->nth_socket != nth)
+	{
+	  continue;
+	}
+      sum->n_enqueue += st->n_enqueue;
+      sum->n_dequeue_local += st->n_dequeue_local;
+      sum->n_dequeue_local_timed += st->n_dequeue_local_timed;
+      sum->cycles_local += st->cycles_local;
+      sum->n_empty += st->n_empty;
+      for (uint d = 0; d < sum->n_dists; d++)
+	{
+	  sum->steal[d].n += st->steal[d].n;
+	  sum->steal[d].n_empty += st->steal[d].n_empty;
+	  sum->steal[d].cycles += st->steal[d].cycles;
+	}
     }
+  return sum;
+}
+
+static inline size_t
+mctop_wq_stats_avg(const uint64_t cycles, const size_t n)
+{
+  return n ? (cycles / n) : 0;
+}
 
-  if (wq->n_queues == 1)
+void
+mctop_wq_stats_print(mctop_wq_t* wq)
+{
+  mctop_wq_stats_t* st = mctop_wq_stats_thread(wq);
+  if (st == NULL)
     {
-      printf("WQ@%u #Enq: %-6zu = %4zu cy | #Deq: %-6zu = %4zu cy\n",
-	     mctop_alloc_get_local_node(),
-	     __mctop_wq_prof_enqueue_n, __mctop_wq_prof_enqueue_t / __mctop_wq_prof_enqueue_n,
-	     __mctop_wq_prof_dequeue_local_n, __mctop_wq_prof_dequeue_local_t / __mctop_wq_prof_dequeue_local_n);
+      return;
     }
-  else if (wq->n_queues <= 2)
+
+  printf("WQ@%u #Enq: %-6zu | #Deq: %-6zu = %4zu cy | #Empty: %-6zu [",
+	 mctop_alloc_thread_local_node(), st->n_enqueue,
+	 st->n_dequeue_local, mctop_wq_stats_avg(st->cycles_local, st->n_dequeue_local_timed), st->n_empty);
+  for (uint d = 0; d < st->n_dists; d++)
     {
-      printf("WQ@%u #Enq: %-6zu = %4zu cy | #Deq: %-6zu = %4zu cy"
-	     " [ %-4zu = %4zu ]\n",
-	     mctop_alloc_get_local_node(),
-	     __mctop_wq_prof_enqueue_n, __mctop_wq_prof_enqueue_t / __mctop_wq_prof_enqueue_n,
-	     __mctop_wq_prof_dequeue_local_n, __mctop_wq_prof_dequeue_local_t / __mctop_wq_prof_dequeue_local_n,
-	     __mctop_wq_prof_dequeue_n[0], __mctop_wq_prof_dequeue_t[0] / __mctop_wq_prof_dequeue_n[0]);
+      printf(" %-4zu = %4zu cy |", st->steal[d].n, mctop_wq_stats_avg(st->steal[d].cycles, st->steal[d].n));
     }
-  else if (wq->n_queues <= 4)
+  printf(" ]\n");
+}
+
+void
+mctop_wq_stats_print_sockets(mctop_wq_t* wq)
+{
+  if (wq->stats == NULL)
     {
-      printf("WQ@%u #Enq: %-6zu = %4zu cy | #Deq: %-6zu = %4zu cy"
-	     " [ %-4zu = %4zu cy | %-4zu = %4zu cy | %-4zu = %4zu cy ]\n",
-	     mctop_alloc_get_local_node(),
-	     __mctop_wq_prof_enqueue_n, __mctop_wq_prof_enqueue_t / __mctop_wq_prof_enqueue_n,
-	     __mctop_wq_prof_dequeue_local_n, __mctop_wq_prof_dequeue_local_t / __mctop_wq_prof_dequeue_local_n,
-	     __mctop_wq_prof_dequeue_n[0], __mctop_wq_prof_dequeue_t[0] / __mctop_wq_prof_dequeue_n[0],
-	     __mctop_wq_prof_dequeue_n[1], __mctop_wq_prof_dequeue_t[1] / __mctop_wq_prof_dequeue_n[1],
-	     __mctop_wq_prof_dequeue_n[2], __mctop_wq_prof_dequeue_t[2] / __mctop_wq_prof_dequeue_n[2]);
+      printf("## MCTOP Work Queue statistics are disabled\n");
+      return;
     }
-  else
+
+  mctop_alloc_t* alloc = wq->alloc;
+  printf("## MCTOP Work Queue statistics -- %u sockets\n", wq->n_queues);
+  for (uint nth = 0; nth <= wq->n_queues; nth++)
     {
-      printf("WQ@%u #Enq: %-6zu = %4zu cy | #Deq: %-6zu = %4zu cy"
-	     " [ %-4zu = %4zu cy | %-4zu = %4zu cy | %-4zu = %4zu cy | %-4zu = %4zu cy | \n"
-	     "                                                       %-4zu = %4zu cy | %-4zu = %4zu cy | %-4zu = %4zu cy ]\n",
-	     mctop_alloc_get_local_node(),
-	     __mctop_wq_prof_enqueue_n, __mctop_wq_prof_enqueue_t / __mctop_wq_prof_enqueue_n,
-	     __mctop_wq_prof_dequeue_local_n, __mctop_wq_prof_dequeue_local_t / __mctop_wq_prof_dequeue_local_n,
-	     __mctop_wq_prof_dequeue_n[0], __mctop_wq_prof_dequeue_t[0] / __mctop_wq_prof_dequeue_n[0],
-	     __mctop_wq_prof_dequeue_n[1], __mctop_wq_prof_dequeue_t[1] / __mctop_wq_prof_dequeue_n[1],
-	     __mctop_wq_prof_dequeue_n[2], __mctop_wq_prof_dequeue_t[2] / __mctop_wq_prof_dequeue_n[2],
-	     __mctop_wq_prof_dequeue_n[3], __mctop_wq_prof_dequeue_t[3] / __mctop_wq_prof_dequeue_n[3],
-	     __mctop_wq_prof_dequeue_n[4], __mctop_wq_prof_dequeue_t[4] / __mctop_wq_prof_dequeue_n[4],
-	     __mctop_wq_prof_dequeue_n[5], __mctop_wq_prof_dequeue_t[5] / __mctop_wq_prof_dequeue_n[5],
-	     __mctop_wq_prof_dequeue_n[6], __mctop_wq_prof_dequeue_t[6] / __mctop_wq_prof_dequeue_n[6]);
+      mctop_wq_stats_t* st = mctop_wq_stats_get(wq, nth);
+      size_t n_steals = 0;
+      for (uint d = 0; d < st->n_dists; d++)
+	{
+	  n_steals += st->steal[d].n;
+	}
+      const size_t n_deq = st->n_dequeue_local + n_steals;
+      const double local = n_deq ? (100.0 * st->n_dequeue_local / n_deq) : 100.0;
+
+      if (nth < wq->n_queues)
+	{
+	  printf("# Socket #%-5u", mctop_alloc_get_nth_socket(alloc, nth)->id);
+	}
+      else
+	{
+	  printf("# Total        ");
+	}
+      printf(" : #Enq %-8zu | #Deq %-8zu (%5.1f%% local) = %4zu cy | #Empty %-6zu\n",
+	     st->n_enqueue, n_deq, local, mctop_wq_stats_avg(st->cycles_local, st->n_dequeue_local_timed),
+	     st->n_empty);
+
+      if (nth < wq->n_queues)
+	{
+	  for (uint d = 0; d < st->n_dists; d++)
+	    {
+	      socket_t* victim = mctop_alloc_get_nth_socket(alloc, wq->queues[nth]->next_q[d]);
+	      const mctop_wq_steal_stats_t* ss = &st->steal[d];
+	      printf("#    steal #%u from socket #%-5u : %-8zu = %4zu cy | #Empty probes %-6zu\n",
+		     d, victim->id, ss->n, mctop_wq_stats_avg(ss->cycles, ss->n), ss->n_empty);
+	    }
+	}
+      free(st);
     }
-#endif
 }
 
@@ -0,0 +1,259 @@
+#include <mctop_alloc.h>
+#include <mctop_internal.h>
+#include <atomics.h>
+
+/* Work stealing: every hw context of the allocator owns a Chase-Lev deque. The owner pushes
+   and pops at the bottom, thieves steal from the top. The deque follows "Correct and
+   Efficient Work-Stealing for Weak Memory Models" (Le et al., PPoPP'13). */
+
+static mctop_ws_array_t*
+mctop_ws_array_create(const size_t size)
+{
+  mctop_ws_array_t* a = malloc_assert(sizeof(mctop_ws_array_t) + size * sizeof(void*));
+  a->size = size;
+  a->prev = NULL;
+  return a;
+}
+
+static inline void*
+mctop_ws_array_get(mctop_ws_array_t* a, const int64_t i)
+{
+  return __atomic_load_n(&a->data[i & (a->size - 1)], __ATOMIC_RELAXED);
+}
+
+static inline void
+mctop_ws_array_put(mctop_ws_array_t* a, const int64_t i, const void* data)
+{
+  __atomic_store_n(&a->data[i & (a->size - 1)], (void*) data, __ATOMIC_RELAXED);
+}
+
+/* the old array stays around (a->prev), since thieves might still be reading it */
+static mctop_ws_array_t*
+mctop_ws_array_grow(mctop_ws_array_t* a, const int64_t top, const int64_t bottom)
+{
+  mctop_ws_array_t* n = mctop_ws_array_create(2 * a->size);
+  for (int64_t i = top; i < bottom; i++)
+    {
+      mctop_ws_array_put(n, i, mctop_ws_array_get(a, i));
+    }
+  n->prev = a;
+  return n;
+}
+
+/* victims ordered by their latency to hwc #id of the allocator, closest first: SMT siblings,
+   then the socket, then the other sockets. Ties are broken by distance in the allocator. */
+static uint*
+mctop_ws_victims_create(mctop_alloc_t* alloc, const uint id)
+{
+  const uint n = alloc->n_hwcs;
+  uint* victims = malloc_assert(n * sizeof(uint));
+  uint* lats = malloc_assert(n * sizeof(uint));
+  for (uint j = 0; j < n; j++)
+    {
+      victims[j] = (id + j) % n;
+      lats[j] = mctop_ids_get_latency(alloc->topo, alloc->hwcs[id], alloc->hwcs[victims[j]]);
+    }
+
+  /* insertion sort: stable, thus keeps the tie breaking */
+  for (uint j = 1; j < n; j++)
+    {
+      const uint v = victims[j], l = lats[j];
+      int k = j - 1;
+      while (k >= 0 && lats[k] > l)
+	{
+	  victims[k + 1] = victims[k];
+	  lats[k + 1] = lats[k];
+	  k--;
+	}
+      victims[k + 1] = v;
+      lats[k + 1] = l;
+    }
+  free(lats);
+
+  assert(victims[0] == id);
+  return victims;
+}
+
+mctop_ws_t*
+mctop_ws_create(mctop_alloc_t* alloc)
+{
+  mctop_ws_t* ws = malloc_assert(sizeof(mctop_ws_t) + alloc->n_hwcs * sizeof(mctop_ws_deque_t*));
+  ws->alloc = alloc;
+  ws->n_deques = alloc->n_hwcs;
+  for (uint i = 0; i < ws->n_deques; i++)
+    {
+      const int nth = mctop_alloc_socket_seq_id(alloc, mctop_hwcid_get_socket(alloc->topo, alloc->hwcs[i])->id);
+      assert(nth >= 0);
+      mctop_ws_deque_t* d = mctop_alloc_malloc_on_nth_socket(alloc, nth, sizeof(mctop_ws_deque_t));
+      d->top = d->bottom = 0;
+      d->array = NULL;		/* created by the owner, i.e., on its node */
+      d->victims = mctop_ws_victims_create(alloc, i);
+      ws->deques[i] = d;
+    }
+  return ws;
+}
+
+void
+mctop_ws_free(mctop_ws_t* ws)
+{
+  for (uint i = 0; i < ws->n_deques; i++)
+    {
+      mctop_ws_deque_t* d = ws->deques[i];
+      mctop_ws_array_t* a = d->array;
+      while (a != NULL)
+	{
+	  mctop_ws_array_t* prev = a->prev;
+	  free(a);
+	  a = prev;
+	}
+      free(d->victims);
+      mctop_alloc_malloc_free(d, sizeof(mctop_ws_deque_t));
+    }
+  free(ws);
+}
+
+void
+mctop_ws_print(mctop_ws_t* ws)
+{
+  mctop_alloc_t* alloc = ws->alloc;
+  printf("## MCTOP Work Stealing -- %u deques\n", ws->n_deques);
+  for (uint i = 0; i < ws->n_deques; i++)
+    {
+      mctop_ws_deque_t* d = ws->deques[i];
+      printf("# Deque#%-3u - HWC #%-3u : Steal: ", i, alloc->hwcs[i]);
+      for (uint j = 1; j < ws->n_deques; j++)
+	{
+	  printf("%u ", alloc->hwcs[d->victims[j]]);
+	}
+      printf("\n");
+    }
+}
+
+/* ******************************************************************************** */
+/* deque operations */
+/* ******************************************************************************** */
+
+static inline void
+mctop_ws_deque_push(mctop_ws_deque_t* d, const void* data)
+{
+  const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  const int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  mctop_ws_array_t* a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+  if (unlikely(a == NULL || (b - t) > (int64_t) (a->size - 1)))
+    {
+      a = (a == NULL) ? mctop_ws_array_create(MCTOP_WS_DEQUE_SIZE) : mctop_ws_array_grow(a, t, b);
+      __atomic_store_n(&d->array, a, __ATOMIC_RELEASE);
+    }
+  mctop_ws_array_put(a, b, data);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+}
+
+static inline void*
+mctop_ws_deque_pop(mctop_ws_deque_t* d)
+{
+  const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  mctop_ws_array_t* a = __atomic_load_n(&d->array, __ATOMIC_RELAXED);
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+
+  void* data = NULL;
+  if (t <= b)
+    {
+      data = mctop_ws_array_get(a, b);
+      if (t == b)		/* last element: race with the thieves */
+	{
+	  if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	    {
+	      data = NULL;
+	    }
+	  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+	}
+    }
+  else
+    {
+      __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  return data;
+}
+
+/* returns 0 if the steal lost a race on the top element and should be retried */
+static inline int
+mctop_ws_deque_steal(mctop_ws_deque_t* d, void** data)
+{
+  *data = NULL;
+  int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  const int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+  if (t < b)
+    {
+      mctop_ws_array_t* a = __atomic_load_n(&d->array, __ATOMIC_ACQUIRE);
+      void* elem = mctop_ws_array_get(a, t);
+      if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	{
+	  return 0;
+	}
+      *data = elem;
+    }
+  return 1;
+}
+
+/* ******************************************************************************** */
+/* high-level interface: the calling thread must be pinned with mctop_alloc_pin */
+/* ******************************************************************************** */
+
+void
+mctop_ws_push(mctop_ws_t* ws, const void* data)
+{
+  mctop_ws_deque_push(ws->deques[mctop_alloc_thread_id()], data);
+}
+
+void*
+mctop_ws_pop(mctop_ws_t* ws)
+{
+  return mctop_ws_deque_pop(ws->deques[mctop_alloc_thread_id()]);
+}
+
+void*
+mctop_ws_steal(mctop_ws_t* ws)
+{
+  const mctop_ws_deque_t* d = ws->deques[mctop_alloc_thread_id()];
+  for (uint v = 1; v < ws->n_deques; v++)
+    {
+      mctop_ws_deque_t* victim = ws->deques[d->victims[v]];
+      void* data;
+      while (!mctop_ws_deque_steal(victim, &data)) /* lost a race: the victim had work */
+	{
+	  PAUSE();
+	}
+      if (data != NULL)
+	{
+	  return data;
+	}
+    }
+  return NULL;
+}
+
+void*
+mctop_ws_get(mctop_ws_t* ws)
+{
+  void* data = mctop_ws_pop(ws);
+  if (data != NULL)
+    {
+      return data;
+    }
+  return mctop_ws_steal(ws);
+}
+
+size_t
+mctop_ws_get_size(mctop_ws_t* ws)
+{
+  size_t s = 0;
+  for (uint i = 0; i < ws->n_deques; i++)
+    {
+      const int64_t n = ws->deques[i]->bottom - ws->deques[i]->top;
+      s += (n > 0) ? n : 0;
+    }
+  return s;
+}
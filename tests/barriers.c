@@ -0,0 +1,169 @@
+#include <mctop_alloc.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <atomics.h>
+
+/* Crossing cost of the pthread barrier against the topology barrier of the allocator. Every
+   thread counts its arrival before crossing, thus after crossing round r the count must be
+   at least (r + 1) * n (nobody was released early) and at most (r + 2) * n. */
+
+void* test_barriers(void* params);
+
+size_t test_reps = 100000;
+volatile size_t __arrivals[2] = { 0, 0 };
+volatile uint32_t __errors = 0;
+double __dur_s[2];
+
+int
+main(int argc, char **argv)
+{
+  char mct_file[100];
+  uint manual_file = 0;
+  int test_num_threads = 2;
+  int test_num_hwcs_per_socket = MCTOP_ALLOC_ALL;
+  mctop_alloc_policy test_policy = MCTOP_ALLOC_MIN_LAT_HWCS;
+
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help",                      no_argument,             NULL, 'h'},
+      {"mct",                       required_argument,       NULL, 'm'},
+      {"reps",                      required_argument,       NULL, 'r'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int i;
+  char c;
+  while(1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hm:n:p:c:r:", long_options, &i);
+
+      if(c == -1)
+	break;
+
+      if(c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch(c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'm':
+	  sprintf(mct_file, "%s", optarg);
+	  manual_file = 1;
+	  break;
+	case 'n':
+	  test_num_threads = atoi(optarg);
+	  break;
+	case 'c':
+	  test_num_hwcs_per_socket = atoi(optarg);
+	  break;
+	case 'p':
+	  test_policy = atoi(optarg);
+	  break;
+	case 'r':
+	  test_reps = atol(optarg);
+	  break;
+	case 'h':
+	  mctop_alloc_help();
+	  printf("  -r <int>    number of barrier crossings (default: %zu)\n", test_reps);
+	  exit(0);
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  mctop_t* topo;
+  if (manual_file)
+    {
+      topo = mctop_load(mct_file);
+    }
+  else
+    {
+      topo = mctop_load(NULL);
+    }
+
+  if (topo)
+    {
+      mctop_alloc_t* alloc = mctop_alloc_create(topo, test_num_threads, test_num_hwcs_per_socket, test_policy);
+      mctop_alloc_print_short(alloc);
+      printf("## Topology barrier: %u tree nodes\n", alloc->global_tbarrier->n_nodes);
+
+      const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+      pthread_t threads[n_hwcs];
+      for (int t = 0; t < n_hwcs; t++)
+	{
+	  pthread_create(&threads[t], NULL, test_barriers, alloc);
+	}
+      for (int t = 0; t < n_hwcs; t++)
+	{
+	  pthread_join(threads[t], NULL);
+	}
+
+      const char* desc[2] = { "pthread", "topology" };
+      for (int b = 0; b < 2; b++)
+	{
+	  printf("## %-9s barrier : %zu crossings in %f seconds = %8.1f ns/crossing\n",
+		 desc[b], test_reps, __dur_s[b], 1e9 * __dur_s[b] / test_reps);
+	}
+      printf("## Early releases: %u : %s\n", __errors, __errors ? "FAILED" : "OK");
+
+      mctop_alloc_free(alloc);
+      mctop_free(topo);
+      return __errors != 0;
+    }
+  return 0;
+}
+
+static double
+time_diff_s(struct timespec start, struct timespec stop)
+{
+  return (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void*
+test_barriers(void* params)
+{
+  mctop_alloc_t* alloc = (mctop_alloc_t*) params;
+  mctop_alloc_pin(alloc);
+  const size_t n = alloc->n_hwcs;
+  const uint leader = (mctop_alloc_thread_id() == 0);
+
+  for (int b = 0; b < 2; b++)
+    {
+      mctop_barrier_wait(alloc->global_barrier);
+      struct timespec start, stop;
+      clock_gettime(CLOCK_REALTIME, &start);
+
+      uint n_errors = 0;
+      for (size_t r = 0; r < test_reps; r++)
+	{
+	  __sync_fetch_and_add(&__arrivals[b], 1);
+	  if (b == 0)
+	    {
+	      mctop_barrier_wait(alloc->global_barrier);
+	    }
+	  else
+	    {
+	      mctop_alloc_barrier_wait_all(alloc);
+	    }
+	  const size_t a = __arrivals[b];
+	  n_errors += (a < (r + 1) * n) || (a > (r + 2) * n);
+	}
+
+      clock_gettime(CLOCK_REALTIME, &stop);
+      if (leader)
+	{
+	  __dur_s[b] = time_diff_s(start, stop);
+	}
+      __sync_fetch_and_add(&__errors, n_errors);
+    }
+
+  mctop_alloc_unpin();
+  return NULL;
+}
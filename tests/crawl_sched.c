@@ -0,0 +1,532 @@
+#include <mctop.h>
+#include <mctop_internal.h>
+#include <mctop_crawl_sched.h>
+#include <cdf.h>
+#include <getopt.h>
+#include <glob.h>
+#include <sys/stat.h>
+
+/* Checks the parallel crawl schedule on MCT files: every pair is measured exactly once and pairs
+   of a batch never share a socket. The latencies of the file are then "measured" twice, by a
+   serial and by a parallel crawl, with independent noise. The parallel measurements also suffer
+   the interference of the other pairs of their batch, heavy if they share a node. Both crawls
+   must result in the same clustering and topology. Also checks that the incremental inference
+   (crawl_infer) results in the same topology, and that a crawl that is stopped after a
+   checkpoint and resumed results in the same latencies as an uninterrupted one. */
+
+static uint64_t**
+mct_lat_table_read(const char* mct_file, uint* n_hwcs_out)
+{
+  FILE* ifile = fopen(mct_file, "r");
+  if (ifile == NULL)
+    {
+      fprintf(stderr, "MCTOP Error: Cannot open %s!\n", mct_file);
+      return NULL;
+    }
+
+  uint n_hwcs, n_sockets, is_smt;
+  char discard[4][30];
+  if (fscanf(ifile, "%s %s %u %s %u %s %u",
+	     discard[0], discard[1], &n_hwcs, discard[2], &n_sockets, discard[3], &is_smt) != 7)
+    {
+      fclose(ifile);
+      return NULL;
+    }
+
+  uint64_t** lat_table = (uint64_t**) table_calloc(n_hwcs, n_hwcs, sizeof(uint64_t));
+  for (uint x = 0; x < (n_hwcs * n_hwcs); x++)
+    {
+      uint xc, yc, lat;
+      if (fscanf(ifile, "%u %u %u", &xc, &yc, &lat) != 3)
+	{
+	  table_free((void**) lat_table, n_hwcs);
+	  fclose(ifile);
+	  return NULL;
+	}
+      lat_table[xc][yc] = lat;
+    }
+
+  fclose(ifile);
+  *n_hwcs_out = n_hwcs;
+  return lat_table;
+}
+
+#define INFER_CLUSTER_OFFS 20	/* default cluster offset of mctop */
+
+/* the medians of the two crawls must be closer than the clusters can be */
+static int
+cc_equal(cdf_cluster_t* a, cdf_cluster_t* b)
+{
+  if (a->n_clusters != b->n_clusters)
+    {
+      return 0;
+    }
+  for (int c = 0; c < a->n_clusters; c++)
+    {
+      const uint64_t ma = a->clusters[c].median, mb = b->clusters[c].median;
+      if ((ma > mb ? ma - mb : mb - ma) > INFER_CLUSTER_OFFS / 2)
+	{
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+/* measurement model of the simulated crawls */
+#define CRAWL_NOISE        2	/* +/- cycles on every measurement */
+#define CRAWL_CONTENTION   1	/* cycles per other pair of the batch ... */
+#define CRAWL_CONTENTION_MAX 2	/* ... up to */
+
+static uint64_t
+crawl_noise(const uint64_t lat, unsigned int* seed)
+{
+  if (lat == 0)
+    {
+      return 0;
+    }
+  return lat + (rand_r(seed) % (2 * CRAWL_NOISE + 1)) - CRAWL_NOISE;
+}
+
+/* the serial crawl measures every pair alone */
+static void
+crawl_serial_measure(uint64_t** lat_true, const uint n_hwcs, uint64_t* lat, unsigned int* seed)
+{
+  for (uint x = 0; x < n_hwcs; x++)
+    {
+      lat[x * n_hwcs + x] = 0;
+      for (uint y = x + 1; y < n_hwcs; y++)
+	{
+	  lat[x * n_hwcs + y] = lat[y * n_hwcs + x] = crawl_noise(lat_true[x][y], seed);
+	}
+    }
+}
+
+/* the parallel crawl measures the pairs of a batch together: a pair that shares a node with
+   another pair of the batch sees the cache lines of the other pair bounce on its node */
+static void
+crawl_parallel_measure(uint64_t** lat_true, const uint n_hwcs, const int* hwc_node, crawl_sched_t* cs,
+		       uint64_t* lat, unsigned int* seed)
+{
+  crawl_batch_t* cb;
+  while ((cb = crawl_sched_next(cs)) != NULL)
+    {
+      for (uint p = 0; p < cb->n_pairs; p++)
+	{
+	  const int x = cb->pairs[p].x, y = cb->pairs[p].y;
+	  uint64_t l = crawl_noise(lat_true[x][y], seed);
+	  uint64_t contention = 0;
+	  for (uint o = 0; o < cb->n_pairs; o++)
+	    {
+	      if (o == p)
+		{
+		  continue;
+		}
+	      const int ox = cb->pairs[o].x, oy = cb->pairs[o].y;
+	      if (hwc_node[ox] == hwc_node[x] || hwc_node[ox] == hwc_node[y] ||
+		  hwc_node[oy] == hwc_node[x] || hwc_node[oy] == hwc_node[y])
+		{
+		  l += lat_true[x][y] / 2;
+		}
+	      contention += CRAWL_CONTENTION;
+	    }
+	  l += (contention < CRAWL_CONTENTION_MAX) ? contention : CRAWL_CONTENTION_MAX;
+	  lat[x * n_hwcs + y] = lat[y * n_hwcs + x] = l;
+	}
+    }
+  for (uint x = 0; x < n_hwcs; x++)
+    {
+      lat[x * n_hwcs + x] = 0;
+    }
+}
+
+/* clusters and normalizes the measured latencies, as mctop does */
+static uint64_t**
+crawl_normalize(uint64_t* lat, const uint n_hwcs, cdf_cluster_t** cc_out)
+{
+  cdf_t* cdf = cdf_calc(lat, n_hwcs * n_hwcs);
+  cdf_cluster_t* cc = cdf_cluster(cdf, INFER_CLUSTER_OFFS, 0);
+  cdf_free(cdf);
+  if (cc == NULL)
+    {
+      return NULL;
+    }
+
+  uint64_t** lat_norm = (uint64_t**) table_calloc(n_hwcs, n_hwcs, sizeof(uint64_t));
+  for (uint x = 0; x < n_hwcs; x++)
+    {
+      for (uint y = 0; y < n_hwcs; y++)
+	{
+	  lat_norm[x][y] = cdf_cluster_value_to_cluster_median(cc, lat[x * n_hwcs + y]);
+	}
+    }
+  *cc_out = cc;
+  return lat_norm;
+}
+
+static int
+topo_equal(mctop_t* a, mctop_t* b)
+{
+  if (a->n_levels != b->n_levels || a->socket_level != b->socket_level ||
+      a->n_sockets != b->n_sockets || a->n_hwcs != b->n_hwcs)
+    {
+      return 0;
+    }
+  for (uint h = 0; h < a->n_hwcs; h++)
+    {
+      if (a->hwcs[h].socket->id != b->hwcs[h].socket->id ||
+	  mctop_hwcid_get_core(a, h)->id != mctop_hwcid_get_core(b, h)->id)
+	{
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+/* checkpoint / resume of a parallel crawl. The measurement of a pair only depends on the pair,
+   so that a resumed crawl must end up with the latencies of an uninterrupted one. */
+static void
+crawl_ckpt_measure(uint64_t** lat_true, const uint n_hwcs, crawl_sched_t* cs, const uint max_batches,
+		   uint64_t* lat, uint8_t* done)
+{
+  crawl_batch_t* cb;
+  for (uint b = 0; b < max_batches && (cb = crawl_sched_next(cs)) != NULL; b++)
+    {
+      for (uint p = 0; p < cb->n_pairs; p++)
+	{
+	  const int x = cb->pairs[p].x, y = cb->pairs[p].y;
+	  unsigned int seed = x * n_hwcs + y + 1;
+	  lat[x * n_hwcs + y] = lat[y * n_hwcs + x] = crawl_noise(lat_true[x][y], &seed);
+	  done[x * n_hwcs + y] = done[y * n_hwcs + x] = 1;
+	}
+    }
+}
+
+static int
+crawl_ckpt_check(const char* mct_file, uint64_t** lat_true, const uint n_hwcs, const uint n_sockets,
+		 const int* hwc_node, const uint max_pairs)
+{
+  char ckpt_file[] = "/tmp/mctop_ckpt_XXXXXX";
+  const int fd = mkstemp(ckpt_file);
+  if (fd < 0)
+    {
+      fprintf(stderr, "MCTOP Error: Cannot create a checkpoint file!\n");
+      return 0;
+    }
+  close(fd);
+
+  const size_t n2 = n_hwcs * n_hwcs;
+  uint64_t* lat_full = calloc_assert(n2, sizeof(uint64_t));
+  uint64_t* lat = calloc_assert(n2, sizeof(uint64_t));
+  uint8_t* done_full = calloc_assert(n2, sizeof(uint8_t));
+  uint8_t* done = calloc_assert(n2, sizeof(uint8_t));
+  int correct = 1;
+
+  /* uninterrupted */
+  crawl_sched_t* cs = crawl_sched_create(n_hwcs, hwc_node, max_pairs);
+  crawl_ckpt_measure(lat_true, n_hwcs, cs, cs->n_batches, lat_full, done_full);
+  const uint n_batches_stop = cs->n_batches / 2;
+  crawl_sched_free(cs);
+
+  /* stopped after the checkpoint */
+  cs = crawl_sched_create(n_hwcs, hwc_node, max_pairs);
+  crawl_ckpt_measure(lat_true, n_hwcs, cs, n_batches_stop, lat, done);
+  crawl_sched_free(cs);
+  crawl_ckpt_t ck = { .n_hwcs = n_hwcs, .n_sockets = n_sockets, .rows_done = 0,
+		      .lat_table = lat, .done = done, .mem_lat_table = NULL };
+  correct &= crawl_ckpt_write(ckpt_file, &ck);
+
+  /* resumed */
+  memset(lat, 0, n2 * sizeof(uint64_t));
+  memset(done, 0, n2 * sizeof(uint8_t));
+  correct &= (crawl_ckpt_read(ckpt_file, &ck) == CRAWL_CKPT_OK);
+  uint n_restored = 0;
+  for (uint x = 0; x < n_hwcs; x++)
+    {
+      for (uint y = x + 1; y < n_hwcs; y++)
+	{
+	  n_restored += done[x * n_hwcs + y];
+	}
+    }
+  cs = crawl_sched_create_masked(n_hwcs, hwc_node, max_pairs, done);
+  correct &= (n_restored + cs->n_pairs == (n_hwcs * (n_hwcs - 1)) / 2);
+  crawl_ckpt_measure(lat_true, n_hwcs, cs, cs->n_batches, lat, done);
+  crawl_sched_free(cs);
+  if (memcmp(lat, lat_full, n2 * sizeof(uint64_t)) || memcmp(done, done_full, n2 * sizeof(uint8_t)))
+    {
+      fprintf(stderr, "MCTOP Error: Latencies of resumed crawl differ!\n");
+      correct = 0;
+    }
+
+  cdf_cluster_t* cc_full = NULL, * cc_resumed = NULL;
+  uint64_t** lat_norm_full = crawl_normalize(lat_full, n_hwcs, &cc_full);
+  uint64_t** lat_norm_resumed = crawl_normalize(lat, n_hwcs, &cc_resumed);
+  if (lat_norm_full == NULL || lat_norm_resumed == NULL || !cc_equal(cc_full, cc_resumed))
+    {
+      fprintf(stderr, "MCTOP Error: Clustering of resumed crawl differs!\n");
+      correct = 0;
+    }
+  else
+    {
+      mctop_t* topo_full = mctop_construct(lat_norm_full, n_hwcs, NULL, n_sockets, cc_full, 0);
+      mctop_t* topo_resumed = mctop_construct(lat_norm_resumed, n_hwcs, NULL, n_sockets, cc_resumed, 0);
+      if (!topo_equal(topo_full, topo_resumed))
+	{
+	  fprintf(stderr, "MCTOP Error: Topology of resumed crawl differs!\n");
+	  correct = 0;
+	}
+      mctop_free(topo_full);
+      mctop_free(topo_resumed);
+    }
+  if (lat_norm_full != NULL)
+    {
+      cdf_cluster_free(cc_full);
+      table_free((void**) lat_norm_full, n_hwcs);
+    }
+  if (lat_norm_resumed != NULL)
+    {
+      cdf_cluster_free(cc_resumed);
+      table_free((void**) lat_norm_resumed, n_hwcs);
+    }
+
+  /* checkpoints of a different setting, or truncated, are rejected */
+  crawl_ckpt_t ck_other = ck;
+  ck_other.n_sockets = n_sockets + 1;
+  correct &= (crawl_ckpt_read(ckpt_file, &ck_other) == CRAWL_CKPT_INVALID);
+  ck_other = ck;
+  ck_other.n_hwcs = n_hwcs - 1;
+  correct &= (crawl_ckpt_read(ckpt_file, &ck_other) == CRAWL_CKPT_INVALID);
+  struct stat st;
+  stat(ckpt_file, &st);
+  correct &= (truncate(ckpt_file, st.st_size - 1) == 0);
+  correct &= (crawl_ckpt_read(ckpt_file, &ck) == CRAWL_CKPT_TRUNCATED);
+  correct &= (truncate(ckpt_file, 4) == 0);
+  correct &= (crawl_ckpt_read(ckpt_file, &ck) == CRAWL_CKPT_INVALID);
+  unlink(ckpt_file);
+  correct &= (crawl_ckpt_read(ckpt_file, &ck) == CRAWL_CKPT_NONE);
+
+  printf("%-28s: resumed after %4u batches, %6u pairs restored from the checkpoint : %s\n",
+	 mct_file, n_batches_stop, n_restored, correct ? "OK" : "FAILED");
+
+  free(done);
+  free(done_full);
+  free(lat);
+  free(lat_full);
+  return correct;
+}
+
+typedef struct infer_arg
+{
+  uint64_t** lat_serial;
+  uint64_t* lat_infer;
+  uint n_hwcs;
+} infer_arg_t;
+
+static void
+infer_measure(const crawl_pair_t* pairs, const uint n_pairs, void* arg)
+{
+  infer_arg_t* ia = (infer_arg_t*) arg;
+  for (uint p = 0; p < n_pairs; p++)
+    {
+      const int x = pairs[p].x, y = pairs[p].y;
+      ia->lat_infer[x * ia->n_hwcs + y] = ia->lat_infer[y * ia->n_hwcs + x] = ia->lat_serial[x][y];
+    }
+}
+
+static int
+crawl_infer_check(const char* mct_file, uint64_t** lat_serial, mctop_t* topo)
+{
+  const uint n_hwcs = topo->n_hwcs;
+  infer_arg_t ia =
+    {
+      .lat_serial = lat_serial,
+      .lat_infer = calloc_assert(n_hwcs * n_hwcs, sizeof(uint64_t)),
+      .n_hwcs = n_hwcs,
+    };
+
+  const size_t n_measured = crawl_infer(n_hwcs, topo->n_sockets, INFER_CLUSTER_OFFS, ia.lat_infer,
+					infer_measure, &ia);
+
+  uint64_t** lat_infer = (uint64_t**) table_calloc(n_hwcs, n_hwcs, sizeof(uint64_t));
+  uint n_wrong = 0;
+  for (uint x = 0; x < n_hwcs; x++)
+    {
+      for (uint y = 0; y < n_hwcs; y++)
+	{
+	  lat_infer[x][y] = ia.lat_infer[x * n_hwcs + y];
+	  n_wrong += (lat_infer[x][y] != lat_serial[x][y]);
+	}
+    }
+
+  mctop_t* topo_infer = mctop_construct(lat_infer, n_hwcs, NULL, topo->n_sockets, NULL, topo->is_smt);
+  const int correct = topo_equal(topo, topo_infer);
+  if (!correct)
+    {
+      fprintf(stderr, "MCTOP Error: Topology of incremental inference differs!\n");
+    }
+
+  const uint n_pairs_serial = (n_hwcs * (n_hwcs - 1)) / 2;
+  printf("%-28s: %6zu of %6u pairs measured (%5.2f%%), %5u latencies differ : %s\n",
+	 mct_file, n_measured, n_pairs_serial, 100.0 * n_measured / n_pairs_serial, n_wrong / 2,
+	 correct ? "OK" : "FAILED");
+
+  mctop_free(topo_infer);
+  table_free((void**) lat_infer, n_hwcs);
+  free(ia.lat_infer);
+  return correct;
+}
+
+static int
+crawl_sched_check(const char* mct_file, const uint max_pairs_in)
+{
+  uint n_hwcs = 0;
+  uint64_t** lat_serial = mct_lat_table_read(mct_file, &n_hwcs);
+  mctop_t* topo = mctop_load(mct_file);
+  if (lat_serial == NULL || topo == NULL)
+    {
+      return 0;
+    }
+
+  int* hwc_node = malloc_assert(n_hwcs * sizeof(int));
+  for (uint h = 0; h < n_hwcs; h++)
+    {
+      hwc_node[h] = mctop_id_no_lvl(mctop_hwcid_get_socket(topo, h)->id);
+    }
+
+  const uint max_pairs = max_pairs_in ? max_pairs_in : topo->n_sockets;
+  crawl_sched_t* cs = crawl_sched_create(n_hwcs, hwc_node, max_pairs);
+  int correct = crawl_sched_validate(cs, hwc_node);
+
+  unsigned int seed = n_hwcs;
+  uint64_t* lat_meas_serial = malloc_assert(n_hwcs * n_hwcs * sizeof(uint64_t));
+  uint64_t* lat_meas_parallel = malloc_assert(n_hwcs * n_hwcs * sizeof(uint64_t));
+  crawl_serial_measure(lat_serial, n_hwcs, lat_meas_serial, &seed);
+  crawl_parallel_measure(lat_serial, n_hwcs, hwc_node, cs, lat_meas_parallel, &seed);
+
+  cdf_cluster_t* cc_serial = NULL, * cc_parallel = NULL;
+  uint64_t** lat_norm_serial = crawl_normalize(lat_meas_serial, n_hwcs, &cc_serial);
+  uint64_t** lat_norm_parallel = crawl_normalize(lat_meas_parallel, n_hwcs, &cc_parallel);
+  mctop_t* topo_serial = NULL, * topo_parallel = NULL;
+  if (lat_norm_serial == NULL || lat_norm_parallel == NULL || !cc_equal(cc_serial, cc_parallel))
+    {
+      fprintf(stderr, "MCTOP Error: Clustering of parallel crawl differs!\n");
+      correct = 0;
+    }
+  else
+    {
+      topo_serial = mctop_construct(lat_norm_serial, n_hwcs, NULL, topo->n_sockets, cc_serial, topo->is_smt);
+      topo_parallel = mctop_construct(lat_norm_parallel, n_hwcs, NULL, topo->n_sockets, cc_parallel, topo->is_smt);
+      if (!topo_equal(topo_serial, topo_parallel))
+	{
+	  fprintf(stderr, "MCTOP Error: Topology of parallel crawl differs!\n");
+	  correct = 0;
+	}
+    }
+
+  const uint n_pairs_serial = (n_hwcs * (n_hwcs - 1)) / 2;
+  printf("%-28s: %6u pairs in %6u batches of max %2u (%5.2fx fewer steps than serial) : %s\n",
+	 mct_file, cs->n_pairs, cs->n_batches, max_pairs,
+	 cs->n_batches ? (double) n_pairs_serial / cs->n_batches : 0.0,
+	 correct ? "OK" : "FAILED");
+
+  correct &= crawl_infer_check(mct_file, lat_serial, topo);
+  correct &= crawl_ckpt_check(mct_file, lat_serial, n_hwcs, topo->n_sockets, hwc_node, max_pairs);
+
+  if (topo_serial != NULL)
+    {
+      mctop_free(topo_serial);
+      mctop_free(topo_parallel);
+    }
+  if (lat_norm_serial != NULL)
+    {
+      cdf_cluster_free(cc_serial);
+      table_free((void**) lat_norm_serial, n_hwcs);
+    }
+  if (lat_norm_parallel != NULL)
+    {
+      cdf_cluster_free(cc_parallel);
+      table_free((void**) lat_norm_parallel, n_hwcs);
+    }
+  free(lat_meas_parallel);
+  free(lat_meas_serial);
+  crawl_sched_free(cs);
+  free(hwc_node);
+  mctop_free(topo);
+  table_free((void**) lat_serial, n_hwcs);
+  return correct;
+}
+
+int
+main(int argc, char **argv)
+{
+  char mct_file[100];
+  uint manual_file = 0;
+  uint max_pairs = 0;
+
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help",                      no_argument,             NULL, 'h'},
+      {"mct",                       required_argument,       NULL, 'm'},
+      {"parallel",                  required_argument,       NULL, 'p'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int i;
+  char c;
+  while(1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hm:p:", long_options, &i);
+
+      if(c == -1)
+	break;
+
+      if(c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch(c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'm':
+	  sprintf(mct_file, "%s", optarg);
+	  manual_file = 1;
+	  break;
+	case 'p':
+	  max_pairs = atoi(optarg);
+	  break;
+	case 'h':
+	  printf("Usage: ./crawl_sched [-m <mct file>] [-p <max concurrent pairs, default=#sockets>]\n"
+		 "Checks the parallel crawl schedule against all desc/*.mct files if no file is given.\n");
+	  exit(0);
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  int correct = 1;
+  if (manual_file)
+    {
+      correct = crawl_sched_check(mct_file, max_pairs);
+    }
+  else
+    {
+      glob_t mcts;
+      if (glob("./desc/*.mct", 0, NULL, &mcts) != 0)
+	{
+	  fprintf(stderr, "MCTOP Error: No MCT files found in ./desc!\n");
+	  return 1;
+	}
+      for (size_t f = 0; f < mcts.gl_pathc; f++)
+	{
+	  correct &= crawl_sched_check(mcts.gl_pathv[f], max_pairs);
+	}
+      globfree(&mcts);
+    }
+
+  return !correct;
+}
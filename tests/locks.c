@@ -0,0 +1,519 @@
+#include <mctop_alloc.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <atomics.h>
+
+/* Lock throughput across the allocator policies, in the format of results/locks: per lock,
+   per backoff, per # threads, the acquisitions per second with each policy. The backoff
+   quantum is 0, the latency within a socket, or the max. latency of the processor. TAS and
+   TTAS wait one quantum after a failed attempt, TICKET one quantum per ticket of distance.
+   MCS and CLH spin on their own node and ignore it. COHORT is mctop_lock_t with the quantum
+   as its ticket backoff. With backoff_topo, TAS and TTAS back off exponentially with
+   mctop_backoff_get_ids towards the current owner, while TICKET and COHORT use the quantum
+   of mctop_backoff_get. Every critical section increments a counter of the lock, thus the
+   counters must add up to the acquisitions. */
+
+typedef enum
+  {
+    TEST_TAS,
+    TEST_TTAS,
+    TEST_TICKET,
+    TEST_MCS,
+    TEST_CLH,
+    TEST_COHORT,
+    TEST_N_LOCKS,
+  } test_lock_type_t;
+
+static const char* test_lock_desc[TEST_N_LOCKS] = { "TAS", "TTAS", "TICKET", "MCS", "CLH", "COHORT" };
+
+#define TEST_N_BACKOFFS 4
+#define TEST_BACKOFF_TOPO 3
+static const char* test_backoff_desc[TEST_N_BACKOFFS] =
+  { "no_backoff", "backoff_socket", "backoff_max", "backoff_topo" };
+
+typedef struct MCTOP_ALIGNED(64) test_qnode
+{
+  struct test_qnode* volatile next;
+  volatile uint32_t locked;
+} test_qnode_t;
+
+typedef struct MCTOP_ALIGNED(64) test_lock
+{
+  volatile uint32_t word;	/* TAS, TTAS */
+  volatile uint32_t next;	/* TICKET */
+  volatile uint32_t now;
+  volatile int owner;		/* hwc of the TAS / TTAS holder, -1 if unknown */
+  test_qnode_t* volatile tail;	/* MCS, CLH */
+  mctop_lock_t* cohort;
+  size_t counter MCTOP_ALIGNED(64); /* protected by the lock */
+} test_lock_t;
+
+typedef struct test_thread
+{
+  test_qnode_t* qnode;		/* MCS, CLH */
+  int hwc;			/* -1 if not pinned to a hw context */
+  int owner;			/* owner the backoff was derived for */
+  mctop_backoff_t backoff;
+} test_thread_t;
+
+typedef struct test_run
+{
+  mctop_alloc_t* alloc;
+  test_lock_type_t type;
+  uint backoff;
+  uint topo_backoff;
+  test_lock_t* locks;
+  test_qnode_t* qnodes;		/* per thread id, then a CLH dummy per lock */
+  volatile uint stop;
+  volatile size_t n_acquires;
+} test_run_t;
+
+void* test_locks(void* params);
+
+uint test_duration = 5000;	/* ms */
+uint test_critical = 1000;	/* cycles */
+uint test_num_locks = 1;
+uint test_yield = 0;
+
+int
+main(int argc, char **argv)
+{
+  char mct_file[100];
+  uint manual_file = 0;
+  int test_max_threads = MCTOP_ALLOC_ALL;
+  int test_step = 0;
+  int test_policy = -1;
+  int test_lock = -1;
+
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help",                      no_argument,             NULL, 'h'},
+      {"mct",                       required_argument,       NULL, 'm'},
+      {"duration",                  required_argument,       NULL, 'd'},
+      {"critical",                  required_argument,       NULL, 'x'},
+      {"locks",                     required_argument,       NULL, 'l'},
+      {"step",                      required_argument,       NULL, 's'},
+      {"type",                      required_argument,       NULL, 't'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int i;
+  char c;
+  while(1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hm:n:p:d:x:l:s:t:", long_options, &i);
+
+      if(c == -1)
+	break;
+
+      if(c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch(c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'm':
+	  sprintf(mct_file, "%s", optarg);
+	  manual_file = 1;
+	  break;
+	case 'n':
+	  test_max_threads = atoi(optarg);
+	  break;
+	case 'p':
+	  test_policy = atoi(optarg);
+	  break;
+	case 'd':
+	  test_duration = atoi(optarg);
+	  break;
+	case 'x':
+	  test_critical = atoi(optarg);
+	  break;
+	case 'l':
+	  test_num_locks = atoi(optarg);
+	  break;
+	case 's':
+	  test_step = atoi(optarg);
+	  break;
+	case 't':
+	  test_lock = atoi(optarg);
+	  break;
+	case 'h':
+	  printf("Usage: ./locks [options]\n");
+	  printf("  -m <file>   load the topology from this .mct file\n");
+	  printf("  -n <int>    max. number of threads (default: all hw contexts)\n");
+	  printf("  -s <int>    thread step (default: hw contexts per socket)\n");
+	  printf("  -p <int>    only this allocator policy (default: all)\n");
+	  printf("  -t <int>    only this lock: ");
+	  for (int l = 0; l < TEST_N_LOCKS; l++)
+	    {
+	      printf("%d = %s%s", l, test_lock_desc[l], (l + 1 < TEST_N_LOCKS) ? ", " : "\n");
+	    }
+	  printf("  -l <int>    number of locks (default: %u)\n", test_num_locks);
+	  printf("  -d <int>    duration of each run in ms (default: %u)\n", test_duration);
+	  printf("  -x <int>    critical section in cycles (default: %u)\n", test_critical);
+	  exit(0);
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  mctop_t* topo;
+  if (manual_file)
+    {
+      topo = mctop_load(mct_file);
+    }
+  else
+    {
+      topo = mctop_load(NULL);
+    }
+
+  int correct = 1;
+  if (topo)
+    {
+      if (test_max_threads <= 0 || test_max_threads > topo->n_hwcs)
+	{
+	  test_max_threads = topo->n_hwcs;
+	}
+      if (test_step <= 0)
+	{
+	  test_step = topo->n_hwcs / topo->n_sockets;
+	}
+      const uint backoffs[TEST_N_BACKOFFS] =
+	{ 0, topo->latencies[topo->socket_level], topo->latencies[topo->n_levels - 1],
+	  mctop_backoff_get(topo, topo->n_levels - 1).quantum };
+
+      printf("num_locks: %u\n", test_num_locks);
+      printf("duration: %u\n", test_duration);
+      printf("critical: %u\n", test_critical);
+
+      test_run_t run;
+      for (int l = 0; l < TEST_N_LOCKS; l++)
+	{
+	  if (test_lock >= 0 && l != test_lock)
+	    {
+	      continue;
+	    }
+	  printf("====== %s ======\n", test_lock_desc[l]);
+	  for (int b = 0; b < TEST_N_BACKOFFS; b++)
+	    {
+	      for (int n = test_step; n <= test_max_threads; n += test_step)
+		{
+		  printf("%s - %d: ", test_backoff_desc[b], n);
+		  for (int p = 0; p < MCTOP_ALLOC_NUM; p++)
+		    {
+		      if (test_policy >= 0 && p != test_policy)
+			{
+			  continue;
+			}
+
+		      run.alloc = mctop_alloc_create(topo, n, MCTOP_ALLOC_ALL, p);
+		      run.type = l;
+		      run.backoff = backoffs[b];
+		      run.topo_backoff = (b == TEST_BACKOFF_TOPO);
+		      run.stop = 0;
+		      run.n_acquires = 0;
+
+		      const uint n_hwcs = mctop_alloc_get_num_hw_contexts(run.alloc);
+		      const long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		      test_yield = (n_cpus > 0 && n_cpus < n_hwcs);
+
+		      if (posix_memalign((void**) &run.locks, 64, test_num_locks * sizeof(test_lock_t)) ||
+			  posix_memalign((void**) &run.qnodes, 64, (n_hwcs + test_num_locks) * sizeof(test_qnode_t)))
+			{
+			  fprintf(stderr, "MCTOP Error: could not allocate the locks\n");
+			  exit(1);
+			}
+		      memset(run.qnodes, 0, (n_hwcs + test_num_locks) * sizeof(test_qnode_t));
+		      for (uint k = 0; k < test_num_locks; k++)
+			{
+			  test_lock_t* lock = &run.locks[k];
+			  lock->word = lock->next = lock->now = 0;
+			  lock->owner = -1;
+			  lock->tail = (l == TEST_CLH) ? &run.qnodes[n_hwcs + k] : NULL;
+			  lock->cohort = NULL;
+			  if (l == TEST_COHORT)
+			    {
+			      lock->cohort = mctop_lock_create(run.alloc);
+			      if (!run.topo_backoff)
+				{
+				  lock->cohort->backoff = run.backoff;
+				}
+			    }
+			  lock->counter = 0;
+			}
+
+		      pthread_t threads[n_hwcs];
+		      for (int t = 0; t < n_hwcs; t++)
+			{
+			  pthread_create(&threads[t], NULL, test_locks, &run);
+			}
+		      usleep(test_duration * 1000);
+		      run.stop = 1;
+		      for (int t = 0; t < n_hwcs; t++)
+			{
+			  pthread_join(threads[t], NULL);
+			}
+
+		      size_t counted = 0;
+		      for (uint k = 0; k < test_num_locks; k++)
+			{
+			  counted += run.locks[k].counter;
+			  if (run.locks[k].cohort != NULL)
+			    {
+			      mctop_lock_free(run.locks[k].cohort);
+			    }
+			}
+		      if (counted != run.n_acquires)
+			{
+			  correct = 0;
+			}
+
+		      printf(" %zu", (size_t) (run.n_acquires * 1000.0 / test_duration));
+		      fflush(stdout);
+
+		      free(run.qnodes);
+		      free(run.locks);
+		      mctop_alloc_free(run.alloc);
+		    }
+		  printf("\n");
+		}
+	    }
+	}
+
+      printf("## Mutual exclusion : %s\n", correct ? "OK" : "FAILED");
+      mctop_free(topo);
+    }
+  return !correct;
+}
+
+/* ******************************************************************************** */
+/* locks */
+/* ******************************************************************************** */
+
+static inline void
+test_relax()
+{
+  if (test_yield)
+    {
+      sched_yield();
+    }
+  else
+    {
+      PAUSE();
+    }
+}
+
+static inline void
+test_wait_cycles(const size_t cycles)
+{
+  if (cycles == 0 || test_yield)
+    {
+      test_relax();
+      return;
+    }
+  const mctop_ticks until = mctop_getticks() + cycles;
+  while (mctop_getticks() < until)
+    {
+      PAUSE();
+    }
+}
+
+/* TAS and TTAS: fixed quantum, or exponential from the distance to the owner */
+static inline void
+test_backoff(test_run_t* run, test_lock_t* lock, test_thread_t* th)
+{
+  if (!run->topo_backoff)
+    {
+      test_wait_cycles(run->backoff);
+      return;
+    }
+  if (test_yield)
+    {
+      test_relax();
+      return;
+    }
+
+  const int owner = lock->owner;
+  if (owner != th->owner)
+    {
+      mctop_t* topo = run->alloc->topo;
+      th->owner = owner;
+      if (owner < 0 || th->hwc < 0)
+	{
+	  th->backoff = mctop_backoff_get(topo, topo->n_levels - 1);
+	}
+      else
+	{
+	  th->backoff = mctop_backoff_get_ids(topo, th->hwc, owner);
+	}
+    }
+  mctop_backoff_wait(&th->backoff);
+}
+
+static inline void
+test_lock_acquire(test_run_t* run, test_lock_t* lock, test_thread_t* th)
+{
+  switch (run->type)
+    {
+    case TEST_TAS:
+      th->owner = -2;
+      while (__atomic_exchange_n(&lock->word, 1, __ATOMIC_ACQUIRE))
+	{
+	  test_backoff(run, lock, th);
+	}
+      lock->owner = th->hwc;
+      break;
+    case TEST_TTAS:
+      th->owner = -2;
+      while (1)
+	{
+	  while (lock->word)
+	    {
+	      test_relax();
+	    }
+	  if (!__atomic_exchange_n(&lock->word, 1, __ATOMIC_ACQUIRE))
+	    {
+	      break;
+	    }
+	  test_backoff(run, lock, th);
+	}
+      lock->owner = th->hwc;
+      break;
+    case TEST_TICKET:
+      {
+	const uint32_t ticket = __atomic_fetch_add(&lock->next, 1, __ATOMIC_RELAXED);
+	uint32_t distance;
+	while ((distance = ticket - __atomic_load_n(&lock->now, __ATOMIC_ACQUIRE)) != 0)
+	  {
+	    test_wait_cycles((size_t) distance * run->backoff);
+	  }
+      }
+      break;
+    case TEST_MCS:
+      {
+	test_qnode_t* q = th->qnode;
+	q->next = NULL;
+	q->locked = 1;
+	test_qnode_t* pred = __atomic_exchange_n(&lock->tail, q, __ATOMIC_ACQ_REL);
+	if (pred != NULL)
+	  {
+	    __atomic_store_n(&pred->next, q, __ATOMIC_RELEASE);
+	    while (__atomic_load_n(&q->locked, __ATOMIC_ACQUIRE))
+	      {
+		test_relax();
+	      }
+	  }
+      }
+      break;
+    case TEST_CLH:
+      {
+	test_qnode_t* q = th->qnode;
+	q->locked = 1;
+	test_qnode_t* pred = __atomic_exchange_n(&lock->tail, q, __ATOMIC_ACQ_REL);
+	while (__atomic_load_n(&pred->locked, __ATOMIC_ACQUIRE))
+	  {
+	    test_relax();
+	  }
+	q->next = pred;		/* reused on release */
+      }
+      break;
+    case TEST_COHORT:
+      mctop_lock_acquire(lock->cohort);
+      break;
+    default:
+      break;
+    }
+}
+
+static inline void
+test_lock_release(test_run_t* run, test_lock_t* lock, test_thread_t* th)
+{
+  switch (run->type)
+    {
+    case TEST_TAS:
+    case TEST_TTAS:
+      __atomic_store_n(&lock->word, 0, __ATOMIC_RELEASE);
+      break;
+    case TEST_TICKET:
+      __atomic_store_n(&lock->now, lock->now + 1, __ATOMIC_RELEASE);
+      break;
+    case TEST_MCS:
+      {
+	test_qnode_t* q = th->qnode;
+	test_qnode_t* succ = __atomic_load_n(&q->next, __ATOMIC_ACQUIRE);
+	if (succ == NULL)
+	  {
+	    test_qnode_t* expected = q;
+	    if (__atomic_compare_exchange_n(&lock->tail, &expected, NULL, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	      {
+		break;
+	      }
+	    while ((succ = __atomic_load_n(&q->next, __ATOMIC_ACQUIRE)) == NULL)
+	      {
+		test_relax();
+	      }
+	  }
+	__atomic_store_n(&succ->locked, 0, __ATOMIC_RELEASE);
+      }
+      break;
+    case TEST_CLH:
+      {
+	test_qnode_t* q = th->qnode;
+	th->qnode = q->next;	/* take over the node of the predecessor */
+	__atomic_store_n(&q->locked, 0, __ATOMIC_RELEASE);
+      }
+      break;
+    case TEST_COHORT:
+      mctop_lock_release(lock->cohort);
+      break;
+    default:
+      break;
+    }
+}
+
+void*
+test_locks(void* params)
+{
+  test_run_t* run = (test_run_t*) params;
+  mctop_alloc_t* alloc = run->alloc;
+  mctop_alloc_pin(alloc);
+  test_thread_t th =
+    {
+      .qnode = &run->qnodes[mctop_alloc_thread_id()],
+      .hwc = (alloc->policy == MCTOP_ALLOC_NONE) ? -1 : mctop_alloc_thread_hw_context_id(),
+      .owner = -2,
+    };
+  uint seed = mctop_alloc_thread_id() + 1;
+
+  mctop_alloc_barrier_wait_all(alloc);
+
+  size_t n_acquires = 0;
+  while (!run->stop)
+    {
+      const uint k = (test_num_locks > 1) ? (rand_r(&seed) % test_num_locks) : 0;
+      test_lock_t* lock = &run->locks[k];
+      test_lock_acquire(run, lock, &th);
+      lock->counter++;
+      if (test_critical > 0)
+	{
+	  const mctop_ticks until = mctop_getticks() + test_critical;
+	  while (mctop_getticks() < until)
+	    {
+	      PAUSE();
+	    }
+	}
+      test_lock_release(run, lock, &th);
+      n_acquires++;
+    }
+
+  __sync_fetch_and_add(&run->n_acquires, n_acquires);
+  mctop_alloc_unpin();
+  return NULL;
+}
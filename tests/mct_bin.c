@@ -0,0 +1,343 @@
+#include <mctop.h>
+#include <mctop_internal.h>
+#include <getopt.h>
+#include <glob.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MCT_BIN_SHM "/mctop_mct_bin"
+
+/* Stores MCT files as binary MCT files, loads them back, and checks that both topologies are
+   the same. Also compares the load times, and publishes/attaches them via shm. */
+
+static int
+topo_bin_equal(mctop_t* a, mctop_t* b)
+{
+  if (a->n_levels != b->n_levels || a->socket_level != b->socket_level || a->n_sockets != b->n_sockets ||
+      a->n_hwcs != b->n_hwcs || a->is_smt != b->is_smt || a->has_mem != b->has_mem ||
+      a->n_siblings != b->n_siblings || a->n_hwcs_per_core != b->n_hwcs_per_core)
+    {
+      return 0;
+    }
+  for (uint l = 0; l < a->n_levels; l++)
+    {
+      if (a->latencies[l] != b->latencies[l])
+	{
+	  return 0;
+	}
+    }
+
+  for (uint x = 0; x < a->n_hwcs; x++)
+    {
+      if (a->hwcs[x].socket->id != b->hwcs[x].socket->id || a->hwcs[x].parent->id != b->hwcs[x].parent->id ||
+	  mctop_hwcid_get_core(a, x)->id != mctop_hwcid_get_core(b, x)->id ||
+	  mctop_hwcid_get_local_node(a, x) != mctop_hwcid_get_local_node(b, x) ||
+	  mctop_hwcid_get_nth_hwc_in_socket(a, x) != mctop_hwcid_get_nth_hwc_in_socket(b, x) ||
+	  mctop_hwcid_get_nth_hwc_in_core(a, x) != mctop_hwcid_get_nth_hwc_in_core(b, x) ||
+	  mctop_hwcid_get_nth_core_in_socket(a, x) != mctop_hwcid_get_nth_core_in_socket(b, x))
+	{
+	  return 0;
+	}
+      for (uint y = 0; y < a->n_hwcs; y++)
+	{
+	  if (mctop_ids_get_latency(a, x, y) != mctop_ids_get_latency(b, x, y))
+	    {
+	      return 0;
+	    }
+	}
+    }
+
+  for (uint s = 0; s < a->n_sockets; s++)
+    {
+      socket_t* sa = mctop_get_socket(a, s);
+      socket_t* sb = mctop_get_socket(b, s);
+      if (sa->n_siblings != sb->n_siblings || sa->n_children != sb->n_children || sa->topo != a || sb->topo != b)
+	{
+	  return 0;
+	}
+      for (uint i = 0; i < sa->n_siblings; i++)
+	{
+	  if (sa->siblings[i]->latency != sb->siblings[i]->latency ||
+	      mctop_sibling_get_other_socket(sa->siblings[i], sa)->id !=
+	      mctop_sibling_get_other_socket(sb->siblings[i], sb)->id)
+	    {
+	      return 0;
+	    }
+	}
+      for (uint n = 0; a->has_mem >= LATENCY && n < a->n_sockets; n++)
+	{
+	  if (sa->mem_latencies[n] != sb->mem_latencies[n])
+	    {
+	      return 0;
+	    }
+	}
+      for (uint n = 0; a->has_mem == BANDWIDTH && n < a->n_sockets; n++)
+	{
+	  if (sa->mem_bandwidths_r[n] != sb->mem_bandwidths_r[n] ||
+	      sa->mem_bandwidths1_w[n] != sb->mem_bandwidths1_w[n])
+	    {
+	      return 0;
+	    }
+	}
+    }
+  return 1;
+}
+
+static int
+mct_bin_write(const char* file, const char* image, const size_t size)
+{
+  FILE* ofile = fopen(file, "w");
+  if (ofile == NULL)
+    {
+      return 0;
+    }
+  const int ret = (fwrite(image, 1, size, ofile) == size);
+  return (fclose(ofile) == 0) && ret;
+}
+
+/* truncated files and relocations (or their targets) outside of the file must be rejected */
+static int
+mct_bin_corrupt_check(const char* mctb_file)
+{
+  FILE* ifile = fopen(mctb_file, "r");
+  if (ifile == NULL)
+    {
+      return 0;
+    }
+  fseek(ifile, 0, SEEK_END);
+  const size_t size = ftell(ifile);
+  rewind(ifile);
+  char* image = malloc(size);
+  char* corrupt = malloc(size);
+  assert(image != NULL && corrupt != NULL);
+  const int read_ok = (fread(image, 1, size, ifile) == size);
+  fclose(ifile);
+
+  char corrupt_file[280];
+  snprintf(corrupt_file, sizeof(corrupt_file), "%s.corrupt", mctb_file);
+  /* the relocation table ends the file: its last entry is the offset of a pointer */
+  const uint64_t last_reloc = *(uint64_t*) (image + size - sizeof(uint64_t));
+  int rejected = read_ok && last_reloc < size;
+  for (uint c = 0; rejected && c < 4; c++)
+    {
+      size_t corrupt_size = size;
+      memcpy(corrupt, image, size);
+      switch (c)
+	{
+	case 0:			/* truncated */
+	  corrupt_size = size / 2;
+	  break;
+	case 1:			/* relocation outside of the file */
+	  *(uint64_t*) (corrupt + size - sizeof(uint64_t)) = 4 * size;
+	  break;
+	case 2:			/* relocation into the relocation table */
+	  *(uint64_t*) (corrupt + size - sizeof(uint64_t)) = size - sizeof(uint64_t);
+	  break;
+	case 3:			/* pointer outside of the file */
+	  *(uint64_t*) (corrupt + last_reloc) = 4 * size;
+	  break;
+	}
+      mctop_t* topo = NULL;
+      if (mct_bin_write(corrupt_file, corrupt, corrupt_size))
+	{
+	  topo = mctop_load_bin(corrupt_file);
+	}
+      if (topo != NULL)
+	{
+	  rejected = 0;
+	  mctop_free(topo);
+	}
+    }
+
+  unlink(corrupt_file);
+  free(corrupt);
+  free(image);
+  return rejected;
+}
+
+/* shm segments that other users may have written, or with relocations outside of the segment,
+   must be rejected, also when attached at the address of the publisher */
+static int
+mct_bin_shm_reject_check(mctop_t* topo)
+{
+  if (!mctop_publish(topo, MCT_BIN_SHM))
+    {
+      return 0;
+    }
+  int rejected = 0;
+  const int fd = shm_open(MCT_BIN_SHM, O_RDWR, 0);
+  struct stat st;
+  if (fd >= 0 && fstat(fd, &st) == 0)
+    {
+      const size_t size = st.st_size;
+      rejected = (fchmod(fd, 0666) == 0);
+      mctop_t* topo_shm = mctop_attach(MCT_BIN_SHM);
+      rejected &= (topo_shm == NULL) && (fchmod(fd, 0600) == 0);
+
+      char* seg = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (seg != MAP_FAILED)
+	{
+	  const uint64_t last_reloc = *(uint64_t*) (seg + size - sizeof(uint64_t));
+	  *(uint64_t*) (seg + last_reloc) = 4 * size; /* pointer outside of the segment */
+	  munmap(seg, size);
+	  rejected &= (topo_shm == NULL);
+	  topo_shm = mctop_attach(MCT_BIN_SHM);
+	  rejected &= (topo_shm == NULL);
+	}
+      else
+	{
+	  rejected = 0;
+	}
+      if (topo_shm != NULL)
+	{
+	  mctop_free(topo_shm);
+	}
+    }
+  if (fd >= 0)
+    {
+      close(fd);
+    }
+  mctop_unpublish(MCT_BIN_SHM);
+  return rejected;
+}
+
+static int
+mct_bin_check(const char* mct_file)
+{
+  char mctb_file[256];
+  const char* base = strrchr(mct_file, '/');
+  snprintf(mctb_file, sizeof(mctb_file), "/tmp/%sb", base ? base + 1 : mct_file);
+
+  clock_t start = clock();
+  mctop_t* topo = mctop_load(mct_file);
+  const double dur_txt = 1000.0 * (clock() - start) / CLOCKS_PER_SEC;
+  if (topo == NULL || !mctop_save_bin(topo, mctb_file))
+    {
+      return 0;
+    }
+
+  start = clock();
+  mctop_t* topo_bin = mctop_load(mctb_file);
+  const double dur_bin = 1000.0 * (clock() - start) / CLOCKS_PER_SEC;
+
+  /* the first attach maps the segment at the address of the publisher; the second one cannot
+     and falls back to relocating a private mapping */
+  mctop_t* topo_shm[2] = { NULL, NULL };
+  double dur_shm = 0;
+  int attach_local_ok = 0;
+  if (mctop_publish(topo, MCT_BIN_SHM))
+    {
+      start = clock();
+      topo_shm[0] = mctop_attach(MCT_BIN_SHM);
+      dur_shm = 1000.0 * (clock() - start) / CLOCKS_PER_SEC;
+      topo_shm[1] = mctop_attach(MCT_BIN_SHM);
+      /* published here, but only for this machine if it has as many hw contexts */
+      mctop_t* topo_local = mctop_attach_local(MCT_BIN_SHM);
+      attach_local_ok = ((topo_local != NULL) == (topo->n_hwcs == sysconf(_SC_NPROCESSORS_CONF)));
+      if (topo_local != NULL)
+	{
+	  mctop_free(topo_local);
+	}
+      mctop_unpublish(MCT_BIN_SHM);
+    }
+
+  int correct = (topo_bin != NULL) && topo_bin_equal(topo, topo_bin) && attach_local_ok;
+  for (int i = 0; i < 2; i++)
+    {
+      correct &= (topo_shm[i] != NULL) && topo_bin_equal(topo, topo_shm[i]);
+    }
+  const int rejected = mct_bin_corrupt_check(mctb_file) && mct_bin_shm_reject_check(topo);
+  correct &= rejected;
+  printf("%-28s: load %8.3f ms (text) vs. %8.3f ms (binary) vs. %8.3f ms (shm) : %s%s\n",
+	 mct_file, dur_txt, dur_bin, dur_shm, correct ? "OK" : "FAILED",
+	 rejected ? "" : " (corrupt file or segment loaded)");
+
+  if (topo_bin != NULL)
+    {
+      mctop_free(topo_bin);
+    }
+  for (int i = 0; i < 2; i++)
+    {
+      if (topo_shm[i] != NULL)
+	{
+	  mctop_free(topo_shm[i]);
+	}
+    }
+  mctop_free(topo);
+  unlink(mctb_file);
+  return correct;
+}
+
+int
+main(int argc, char **argv)
+{
+  char mct_file[100];
+  uint manual_file = 0;
+
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help",                      no_argument,             NULL, 'h'},
+      {"mct",                       required_argument,       NULL, 'm'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int i;
+  char c;
+  while(1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hm:", long_options, &i);
+
+      if(c == -1)
+	break;
+
+      if(c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch(c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'm':
+	  sprintf(mct_file, "%s", optarg);
+	  manual_file = 1;
+	  break;
+	case 'h':
+	  printf("Usage: ./mct_bin [-m <mct file>]\n"
+		 "Checks binary MCT files against all desc/*.mct files if no file is given.\n");
+	  exit(0);
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  int correct = 1;
+  if (manual_file)
+    {
+      correct = mct_bin_check(mct_file);
+    }
+  else
+    {
+      glob_t mcts;
+      if (glob("./desc/*.mct", 0, NULL, &mcts) != 0)
+	{
+	  fprintf(stderr, "MCTOP Error: No MCT files found in ./desc!\n");
+	  return 1;
+	}
+      for (size_t f = 0; f < mcts.gl_pathc; f++)
+	{
+	  correct &= mct_bin_check(mcts.gl_pathv[f]);
+	}
+      globfree(&mcts);
+    }
+
+  return !correct;
+}
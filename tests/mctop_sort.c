@@ -50,11 +50,52 @@ print_error_sorted(MCTOP_SORT_TYPE* array, const size_t n_elems, const uint prin
 	   }
 }
 
-int is_power_of_two (uint x)
+/* order-independent fingerprint of the keys: the sorted array must be a permutation of the input */
+static inline uint64_t
+key_mix(uint64_t k)
 {
-   while (((x % 2) == 0) && x > 1) /* While x is even and > 1 */
-        x /= 2;
-    return (x == 1);
+  k = (k ^ (k >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  k = (k ^ (k >> 27)) * 0x94d049bb133111ebULL;
+  return k ^ (k >> 31);
+}
+
+/* 64-bit keys for mctop_radix_sort_u64, with random bits in every digit position */
+static int
+radix_sort_u64_check(const size_t n_elems, mctop_node_tree_t* nt, unsigned long* seeds)
+{
+  uint64_t* array = (uint64_t*) malloc(n_elems * sizeof(uint64_t));
+  assert(array != NULL);
+  uint64_t fp_sum = 0, fp_xor = 0;
+  for (size_t i = 0; i < n_elems; i++)
+    {
+      array[i] = ((uint64_t) mctop_rand(seeds) << 32) ^ (uint64_t) mctop_rand(seeds);
+      fp_sum += key_mix(array[i]);
+      fp_xor ^= key_mix(array[i]);
+    }
+  printf("# Data = %zu MB of 64-bit keys \n", (n_elems * sizeof(uint64_t)) / (1024 * 1024));
+
+  struct timespec start, stop;
+  clock_gettime(CLOCK_REALTIME, &start);
+  mctop_radix_sort_u64(array, n_elems, nt);
+  clock_gettime(CLOCK_REALTIME, &stop);
+  struct timespec dur = timespec_diff(start, stop);
+  printf("## Sorted %zu 64-bit keys in %f seconds (radix)\n", n_elems, dur.tv_sec + (dur.tv_nsec / 1e9));
+
+  uint sorted = 1;
+  for (size_t i = 0; i < n_elems; i++)
+    {
+      if (i > 0 && array[i - 1] > array[i])
+	{
+	  sorted = 0;
+	}
+      fp_sum -= key_mix(array[i]);
+      fp_xor ^= key_mix(array[i]);
+    }
+  const uint permutation = (fp_sum == 0 && fp_xor == 0);
+  printf("## Array %p {size %-10zu} is sorted: %u, is a permutation of the input: %u\n",
+	 array, n_elems, sorted, permutation);
+  free(array);
+  return sorted && permutation;
 }
 
 int
@@ -71,6 +112,9 @@ main(int argc, char **argv)
   mctop_alloc_policy test_policy = MCTOP_ALLOC_SEQUENTIAL;
   uint test_random_type = 0;
   uint test_verbose = 0;
+  uint test_engine = 0;
+  const char* engines[] = { "merge", "radix", "sample", "radix64" };
+  int correct = 1;
 
   struct option long_options[] = 
     {
@@ -85,7 +129,7 @@ main(int argc, char **argv)
   while(1) 
     {
       i = 0;
-      c = getopt_long(argc, argv, "hm:n:p:c:r:s:g:i:v", long_options, &i);
+      c = getopt_long(argc, argv, "hm:n:p:c:r:s:g:i:ve:", long_options, &i);
 
       if(c == -1)
 	break;
@@ -123,8 +167,17 @@ main(int argc, char **argv)
 	case 'v':
 	  test_verbose = 1;
 	  break;
+	case 'e':
+	  test_engine = atoi(optarg);
+	  if (test_engine > 3)
+	    {
+	      test_engine = 0;
+	    }
+	  break;
 	case 'h':
 	  mctop_alloc_help();
+	  printf("  -e <int>    sort engine: 0 merge sort, 1 radix sort, 2 sample sort,\n"
+		 "              3 radix sort of 64-bit keys (default: %u)\n", test_engine);
 	  exit(0);
 	case '?':
 	  printf("Use -h or --help for help\n");
@@ -170,16 +223,21 @@ main(int argc, char **argv)
       mctop_alloc_pin_nth_socket(alloc, fnode);
 
       unsigned long* seeds = seed_rand_fixed();
+      if (test_engine == 3)
+	{
+	  const size_t n_elems = (array_len * sizeof(MCTOP_SORT_TYPE)) / sizeof(uint64_t);
+	  correct = radix_sort_u64_check(n_elems, nt, seeds);
+	  free(seeds);
+	  mctop_alloc_free(alloc);
+	  mctop_node_tree_free(nt);
+	  mctop_free(topo);
+	  return !correct;
+	}
 
       const size_t array_siz = array_len * sizeof(MCTOP_SORT_TYPE);
       array = (MCTOP_SORT_TYPE*) malloc(array_siz);
       assert(array != NULL);
 
-      if (!is_power_of_two(mctop_alloc_get_num_sockets(alloc))) {
-        printf("%s: ## Sorted %llu MB of ints in %f seconds\n", argv[0], array_siz / (1024 * 1024LL), 0.0);
-        return 0;
-      }
-
       switch (test_random_type)
 	{
 	case 0:
@@ -237,11 +295,23 @@ main(int argc, char **argv)
 
       struct timespec start, stop;
       clock_gettime(CLOCK_REALTIME, &start);
-      mctop_sort(array, array_siz / sizeof(uint), nt);
+      switch (test_engine)
+	{
+	case 1:
+	  mctop_radix_sort(array, array_siz / sizeof(uint), nt);
+	  break;
+	case 2:
+	  mctop_sample_sort(array, array_siz / sizeof(uint), nt);
+	  break;
+	default:
+	  mctop_sort(array, array_siz / sizeof(uint), nt);
+	  break;
+	}
       clock_gettime(CLOCK_REALTIME, &stop);
       struct timespec dur = timespec_diff(start, stop);
       double dur_s = dur.tv_sec + (dur.tv_nsec / 1e9);
-      printf("%s: ## Sorted %llu MB of ints in %f seconds\n", argv[0], array_siz / (1024 * 1024LL), dur_s);
+      printf("%s: ## Sorted %llu MB of ints in %f seconds (%s)\n", argv[0], array_siz / (1024 * 1024LL), dur_s,
+	     engines[test_engine]);
 
       print_error_sorted(array, array_len, 0);
       mctop_alloc_free(alloc);
@@ -250,7 +320,7 @@ main(int argc, char **argv)
       mctop_free(topo);
       free((void*) array);
     }
-  return 0;
+  return !correct;
 }
 
 
@@ -0,0 +1,242 @@
+#include <mctop_alloc.h>
+#include <getopt.h>
+#include <mctop_rand.h>
+#include <mctop_sort.hpp>
+
+/* mct::sort on keys of 32 and 64 bits, on key / payload pairs, and with a custom comparator.
+   Checks that the outputs are sorted permutations of the inputs. */
+
+static double
+time_diff_s(struct timespec start, struct timespec stop)
+{
+  return (stop.tv_sec - start.tv_sec) + ((stop.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+template <typename T>
+static T
+elem_key(const T& e)
+{
+  return e;
+}
+
+template <typename K, typename V>
+static K
+elem_key(const mct::kv<K, V>& e)
+{
+  return e.key;
+}
+
+/* order-independent: sum of the bit patterns of the keys */
+template <typename T>
+static uint64_t
+checksum(const T* array, const size_t n)
+{
+  uint64_t sum = 0;
+  for (size_t i = 0; i < n; i++)
+    {
+      const auto key = elem_key(array[i]);
+      uint64_t bits = 0;
+      memcpy(&bits, &key, sizeof(key));
+      sum += bits;
+    }
+  return sum;
+}
+
+template <typename T, typename Compare>
+static uint
+test_sort(const char* desc, T* array, const size_t n, mctop_node_tree_t* nt, Compare cmp)
+{
+  const uint64_t sum_in = checksum(array, n);
+  struct timespec start, stop;
+  clock_gettime(CLOCK_REALTIME, &start);
+  mct::sort(array, n, nt, cmp);
+  clock_gettime(CLOCK_REALTIME, &stop);
+
+  uint sorted = 1;
+  for (size_t i = 1; i < n; i++)
+    {
+      if (cmp(elem_key(array[i]), elem_key(array[i - 1])))
+	{
+	  sorted = 0;
+	  break;
+	}
+    }
+  const uint ok = sorted && (checksum(array, n) == sum_in);
+  printf("## %-24s : %-10zu elems in %f seconds : %s\n", desc, n, time_diff_s(start, stop),
+	 ok ? "OK" : "FAILED");
+  return !ok;
+}
+
+int
+main(int argc, char **argv)
+{
+  char mct_file[100];
+  uint manual_file = 0;
+  int test_num_threads = 2;
+  int test_num_hwcs_per_socket = MCTOP_ALLOC_ALL;
+  mctop_alloc_policy test_policy = MCTOP_ALLOC_SEQUENTIAL;
+  size_t test_array_mb = 64;
+  uint test_verbose = 0;
+
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help",                      no_argument,             NULL, 'h'},
+      {"mct",                       required_argument,       NULL, 'm'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int i;
+  char c;
+  while(1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hm:n:p:c:s:v", long_options, &i);
+
+      if(c == -1)
+	break;
+
+      if(c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch(c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'm':
+	  sprintf(mct_file, "%s", optarg);
+	  manual_file = 1;
+	  break;
+	case 'n':
+	  test_num_threads = atoi(optarg);
+	  break;
+	case 'c':
+	  test_num_hwcs_per_socket = atoi(optarg);
+	  break;
+	case 'p':
+	  test_policy = (mctop_alloc_policy) atoi(optarg);
+	  break;
+	case 's':
+	  test_array_mb = atol(optarg);
+	  break;
+	case 'v':
+	  test_verbose = 1;
+	  break;
+	case 'h':
+	  mctop_alloc_help();
+	  printf("  -s <int>    size of each array in MB (default: %zu)\n", test_array_mb);
+	  exit(0);
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  mctop_t* topo;
+  if (manual_file)
+    {
+      topo = mctop_load(mct_file);
+    }
+  else
+    {
+      topo = mctop_load(NULL);
+    }
+
+  if (topo)
+    {
+      mctop_alloc_t* alloc = mctop_alloc_create(topo, test_num_threads, test_num_hwcs_per_socket, test_policy);
+      mctop_alloc_print_short(alloc);
+      mctop_node_tree_t* nt = mctop_alloc_node_tree_create(alloc, CORE);
+      if (test_verbose)
+	{
+	  mctop_node_tree_print(nt);
+	}
+      mctop_alloc_pin_nth_socket(alloc, mctop_node_tree_get_final_dest_node(nt));
+
+      const size_t size = test_array_mb * 1024 * 1024LL;
+      unsigned long* seeds = seed_rand_fixed();
+      uint n_errors = 0;
+
+      {
+	const size_t n = size / sizeof(uint32_t);
+	uint32_t* array = (uint32_t*) malloc(size);
+	assert(array != NULL);
+	for (size_t i = 0; i < n; i++)
+	  {
+	    array[i] = mctop_rand(seeds);
+	  }
+	n_errors += test_sort("uint32_t", array, n, nt, std::less<uint32_t>());
+	free(array);
+      }
+      {
+	const size_t n = size / sizeof(int64_t);
+	int64_t* array = (int64_t*) malloc(size);
+	assert(array != NULL);
+	for (size_t i = 0; i < n; i++)
+	  {
+	    array[i] = (int64_t) mctop_rand(seeds) - (int64_t) mctop_rand(seeds);
+	  }
+	n_errors += test_sort("int64_t", array, n, nt, std::less<int64_t>());
+	free(array);
+      }
+      {
+	const size_t n = size / sizeof(double);
+	double* array = (double*) malloc(size);
+	assert(array != NULL);
+	for (size_t i = 0; i < n; i++)
+	  {
+	    array[i] = (double) mctop_rand(seeds) / 3;
+	  }
+	n_errors += test_sort("double", array, n, nt, std::less<double>());
+	free(array);
+      }
+      {
+	const size_t n = size / sizeof(uint64_t);
+	uint64_t* array = (uint64_t*) malloc(size);
+	assert(array != NULL);
+	for (size_t i = 0; i < n; i++)
+	  {
+	    array[i] = mctop_rand(seeds);
+	  }
+	n_errors += test_sort("uint64_t (greater)", array, n, nt, std::greater<uint64_t>());
+	free(array);
+      }
+      {
+	/* the payload points to a copy of the key */
+	typedef mct::kv<uint64_t, uint64_t*> kv_t;
+	const size_t n = size / sizeof(kv_t);
+	kv_t* array = (kv_t*) malloc(size);
+	uint64_t* keys = (uint64_t*) malloc(n * sizeof(uint64_t));
+	assert(array != NULL && keys != NULL);
+	for (size_t i = 0; i < n; i++)
+	  {
+	    keys[i] = mctop_rand(seeds) % (n / 2);
+	    array[i].key = keys[i];
+	    array[i].value = &keys[i];
+	  }
+	n_errors += test_sort("kv<uint64_t, uint64_t*>", array, n, nt, std::less<uint64_t>());
+	size_t n_payload_errors = 0;
+	for (size_t i = 0; i < n; i++)
+	  {
+	    n_payload_errors += (*array[i].value != array[i].key);
+	  }
+	if (n_payload_errors)
+	  {
+	    printf("## kv payloads do not match their keys: %zu\n", n_payload_errors);
+	    n_errors++;
+	  }
+	free(keys);
+	free(array);
+      }
+
+      free(seeds);
+      mctop_node_tree_free(nt);
+      mctop_alloc_free(alloc);
+      mctop_free(topo);
+      return n_errors != 0;
+    }
+  return 0;
+}
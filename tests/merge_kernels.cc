@@ -0,0 +1,262 @@
+#include <mctop.h>
+#include <getopt.h>
+#include <mctop_rand.h>
+#include <merge_simd_utils.hpp>
+
+/* Single-thread bandwidth of the merge kernels and throughput of the chunk-sort kernels of
+   merge_simd_utils.hpp, for every ISA this processor supports, on the same inputs. The outputs
+   of every kernel are compared against the scalar merge and std::sort. */
+
+static double
+time_diff_s(struct timespec start, struct timespec stop)
+{
+  return (stop.tv_sec - start.tv_sec) + ((stop.tv_nsec - start.tv_nsec) / 1e9);
+}
+
+template <typename T>
+static T
+rand_elem(unsigned long* seeds)
+{
+  return (T) mctop_rand(seeds);
+}
+
+template <>
+double
+rand_elem<double>(unsigned long* seeds)
+{
+  return (double) mctop_rand(seeds) / 7;
+}
+
+template <typename T>
+static uint
+bench(const char* desc, const size_t size, const uint reps, unsigned long* seeds)
+{
+  const size_t n = size / sizeof(T);
+  T* in = (T*) malloc(2 * n * sizeof(T));
+  T* ref = (T*) malloc(2 * n * sizeof(T));
+  T* out = (T*) malloc(2 * n * sizeof(T));
+  assert(in != NULL && ref != NULL && out != NULL);
+  for (size_t i = 0; i < 2 * n; i++)
+    {
+      in[i] = rand_elem<T>(seeds);
+    }
+
+  uint n_errors = 0;
+  struct timespec start, stop;
+
+  /* sort: std::sort is the reference */
+  memcpy(ref, in, n * sizeof(T));
+  clock_gettime(CLOCK_REALTIME, &start);
+  std::sort(ref, ref + n);
+  clock_gettime(CLOCK_REALTIME, &stop);
+  const double sort_base = time_diff_s(start, stop);
+  printf("## %-8s sort  %-6s : %8.2f Melems/s\n", desc, "std", n / sort_base / 1e6);
+  for (int isa = mct::SIMD_AVX2; isa <= mct::simd_isa(); isa++)
+    {
+      memcpy(out, in, n * sizeof(T));
+      clock_gettime(CLOCK_REALTIME, &start);
+      mct::sort_isa((mct::simd_isa_t) isa, out, out + n, n);
+      clock_gettime(CLOCK_REALTIME, &stop);
+      const double t = time_diff_s(start, stop);
+      const uint ok = !memcmp(out, ref, n * sizeof(T));
+      n_errors += !ok;
+      printf("## %-8s sort  %-6s : %8.2f Melems/s (x%.2f) : %s\n", desc,
+	     mct::simd_isa_name((mct::simd_isa_t) isa), n / t / 1e6, sort_base / t, ok ? "OK" : "FAILED");
+    }
+
+  /* merge of two sorted arrays of n elements: the scalar merge is the reference */
+  std::sort(in, in + n);
+  std::sort(in + n, in + 2 * n);
+  mct::merge_isa(mct::SIMD_SCALAR, in, in + n, ref, n, n);
+  double merge_base = 0;
+  for (int isa = mct::SIMD_SCALAR; isa <= mct::simd_isa(); isa++)
+    {
+      double best = 1e9;
+      for (uint r = 0; r < reps; r++)
+	{
+	  clock_gettime(CLOCK_REALTIME, &start);
+	  mct::merge_isa((mct::simd_isa_t) isa, in, in + n, out, n, n);
+	  clock_gettime(CLOCK_REALTIME, &stop);
+	  const double t = time_diff_s(start, stop);
+	  if (t < best)
+	    {
+	      best = t;
+	    }
+	}
+      if (isa == mct::SIMD_SCALAR)
+	{
+	  merge_base = best;
+	}
+      const uint ok = !memcmp(out, ref, 2 * n * sizeof(T));
+      n_errors += !ok;
+      printf("## %-8s merge %-6s : %8.2f GB/s (x%.2f) : %s\n", desc,
+	     mct::simd_isa_name((mct::simd_isa_t) isa), 2 * size / best / 1e9, merge_base / best,
+	     ok ? "OK" : "FAILED");
+    }
+
+  free(out);
+  free(ref);
+  free(in);
+  return n_errors;
+}
+
+/* pairs: the payload of a key is derived from the key, so that the pairs can be checked after
+   unstable sorts */
+template <typename K, typename Val>
+static inline Val
+kv_payload(const K key)
+{
+  return (Val) (uintptr_t) ~key;
+}
+
+template <typename K, typename Val>
+static uint
+kv_check(const mct::kv<K, Val>* out, const mct::kv<K, Val>* ref, const size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      if (out[i].key != ref[i].key || out[i].value != kv_payload<K, Val>(out[i].key))
+	{
+	  return 0;
+	}
+    }
+  return 1;
+}
+
+template <typename K, typename Val>
+static uint
+bench_kv(const char* desc, const size_t size, const uint reps, unsigned long* seeds)
+{
+  typedef mct::kv<K, Val> kv_t;
+  const mct::kv_less<K, Val, std::less<K> > less((std::less<K>()));
+  const size_t n = size / sizeof(kv_t);
+  kv_t* in = (kv_t*) malloc(2 * n * sizeof(kv_t));
+  kv_t* ref = (kv_t*) malloc(2 * n * sizeof(kv_t));
+  kv_t* out = (kv_t*) malloc(2 * n * sizeof(kv_t));
+  assert(in != NULL && ref != NULL && out != NULL);
+  for (size_t i = 0; i < 2 * n; i++)
+    {
+      in[i].key = rand_elem<K>(seeds);
+      in[i].value = kv_payload<K, Val>(in[i].key);
+    }
+
+  uint n_errors = 0;
+  struct timespec start, stop;
+
+  memcpy(ref, in, n * sizeof(kv_t));
+  clock_gettime(CLOCK_REALTIME, &start);
+  std::sort(ref, ref + n, less);
+  clock_gettime(CLOCK_REALTIME, &stop);
+  const double sort_base = time_diff_s(start, stop);
+  printf("## %-8s sort  %-6s : %8.2f Melems/s\n", desc, "std", n / sort_base / 1e6);
+  for (int isa = mct::SIMD_AVX2; isa <= mct::simd_isa(); isa++)
+    {
+      memcpy(out, in, n * sizeof(kv_t));
+      clock_gettime(CLOCK_REALTIME, &start);
+      mct::sort_kv_isa((mct::simd_isa_t) isa, out, out + n, n);
+      clock_gettime(CLOCK_REALTIME, &stop);
+      const double t = time_diff_s(start, stop);
+      const uint ok = kv_check(out, ref, n);
+      n_errors += !ok;
+      printf("## %-8s sort  %-6s : %8.2f Melems/s (x%.2f) : %s\n", desc,
+	     mct::simd_isa_name((mct::simd_isa_t) isa), n / t / 1e6, sort_base / t, ok ? "OK" : "FAILED");
+    }
+
+  std::sort(in, in + n, less);
+  std::sort(in + n, in + 2 * n, less);
+  mct::merge_kv_isa(mct::SIMD_SCALAR, in, in + n, ref, n, n);
+  double merge_base = 0;
+  for (int isa = mct::SIMD_SCALAR; isa <= mct::simd_isa(); isa++)
+    {
+      double best = 1e9;
+      for (uint r = 0; r < reps; r++)
+	{
+	  clock_gettime(CLOCK_REALTIME, &start);
+	  mct::merge_kv_isa((mct::simd_isa_t) isa, in, in + n, out, n, n);
+	  clock_gettime(CLOCK_REALTIME, &stop);
+	  const double t = time_diff_s(start, stop);
+	  if (t < best)
+	    {
+	      best = t;
+	    }
+	}
+      if (isa == mct::SIMD_SCALAR)
+	{
+	  merge_base = best;
+	}
+      const uint ok = kv_check(out, ref, 2 * n);
+      n_errors += !ok;
+      printf("## %-8s merge %-6s : %8.2f GB/s (x%.2f) : %s\n", desc,
+	     mct::simd_isa_name((mct::simd_isa_t) isa), 2 * size / best / 1e9, merge_base / best,
+	     ok ? "OK" : "FAILED");
+    }
+
+  free(out);
+  free(ref);
+  free(in);
+  return n_errors;
+}
+
+int
+main(int argc, char **argv)
+{
+  size_t test_array_mb = 64;
+  uint test_reps = 5;
+
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help",                      no_argument,             NULL, 'h'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int i;
+  char c;
+  while(1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hs:r:", long_options, &i);
+
+      if(c == -1)
+	break;
+
+      if(c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch(c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 's':
+	  test_array_mb = atol(optarg);
+	  break;
+	case 'r':
+	  test_reps = atoi(optarg);
+	  break;
+	case 'h':
+	  printf("merge_kernels -- single-thread merge / sort kernels of mct::sort\n");
+	  printf("  -s <int>    size of each input array in MB (default: %zu)\n", test_array_mb);
+	  printf("  -r <int>    repetitions of each merge, the best is reported (default: %u)\n", test_reps);
+	  printf("  MCTOP_SIMD=scalar|sse|avx2|avx512 caps the ISA that is used\n");
+	  exit(0);
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  printf("## Best ISA: %s\n", mct::simd_isa_name(mct::simd_isa()));
+  const size_t size = test_array_mb * 1024 * 1024LL;
+  unsigned long* seeds = seed_rand_fixed();
+  uint n_errors = 0;
+  n_errors += bench<uint32_t>("uint32_t", size, test_reps, seeds);
+  n_errors += bench<uint64_t>("uint64_t", size, test_reps, seeds);
+  n_errors += bench<double>("double", size, test_reps, seeds);
+  n_errors += bench_kv<uint32_t, uint32_t>("kv32", size, test_reps, seeds);
+  n_errors += bench_kv<uint64_t, uint64_t*>("kv64", size, test_reps, seeds);
+  free(seeds);
+  return n_errors != 0;
+}
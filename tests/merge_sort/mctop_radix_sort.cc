@@ -0,0 +1,361 @@
+#include <mctop_sort.h>
+#include <algorithm>    // std::sort
+#include <string.h>
+
+/* NUMA-aware parallel LSD radix sort of unsigned integer keys.
+   The sorted data of every pass live in one buffer per socket (a segment), allocated on the
+   socket, so that a global position p lives in segment p / seg_len. Per pass:
+   1. every thread computes the histogram of its part of its socket's segment,
+   2. the histograms of the sockets are summed with an allreduce on the node tree, so that every
+      thread can compute the (stable) global position of its first key of every bucket,
+   3. the threads scatter their keys through write-combining buffers, sized after the L1 / L2.
+   Passes on digits that are equal in all keys are skipped. The first pass reads and the last pass
+   writes the input array directly. */
+
+#define MCTOP_RADIX_MAX_SOCKETS 64
+
+template <typename K>
+struct radix_view
+{
+  K* seg[MCTOP_RADIX_MAX_SOCKETS];
+};
+
+/* allreduce data: the histograms of the sockets, n_sockets x n_buckets */
+typedef struct radix_hist
+{
+  size_t n;
+  size_t counts[0];
+} radix_hist_t;
+
+template <typename K>
+struct radix_bits
+{
+  K or_all;
+  K and_all;
+};
+
+/* node data descriptor */
+typedef struct MCTOP_ALIGNED(64) radix_nd
+{
+  size_t* hist;			/* one histogram per hw context of the node */
+} radix_nd_t;
+
+/* total data descriptor */
+template <typename K>
+struct radix_td
+{
+  mctop_node_tree_t* nt;
+  K* array;
+  size_t n_elems;
+  uint n_sockets;
+  size_t seg_len;		/* the last segment also holds the remainder */
+  uint n_bits;
+  size_t wc_elems;		/* # of keys in the write-combining buffer of a bucket */
+  radix_view<K> input;
+  radix_view<K> tmp[2];
+  radix_nd_t node_data[MCTOP_RADIX_MAX_SOCKETS];
+};
+
+static void
+radix_hist_add(void* into, const void* from)
+{
+  radix_hist_t* a = (radix_hist_t*) into;
+  const radix_hist_t* b = (const radix_hist_t*) from;
+  for (size_t i = 0; i < a->n; i++)
+    {
+      a->counts[i] += b->counts[i];
+    }
+}
+
+template <typename K>
+static void
+radix_bits_combine(void* into, const void* from)
+{
+  radix_bits<K>* a = (radix_bits<K>*) into;
+  const radix_bits<K>* b = (const radix_bits<K>*) from;
+  a->or_all |= b->or_all;
+  a->and_all &= b->and_all;
+}
+
+template <typename K>
+static inline size_t
+radix_seg_size(radix_td<K>* td, const uint s)
+{
+  return (s == td->n_sockets - 1) ? (td->n_elems - s * td->seg_len) : td->seg_len;
+}
+
+/* writes n keys at global position pos of view v */
+template <typename K>
+static inline void
+radix_flush(radix_td<K>* td, radix_view<K>* v, size_t pos, const K* keys, size_t n)
+{
+  while (n > 0)
+    {
+      uint s = pos / td->seg_len;
+      if (s >= td->n_sockets)
+	{
+	  s = td->n_sockets - 1;
+	}
+      const size_t off = pos - s * td->seg_len;
+      const size_t room = radix_seg_size(td, s) - off;
+      const size_t n_cpy = (n < room) ? n : room;
+      memcpy(v->seg[s] + off, keys, n_cpy * sizeof(K));
+      pos += n_cpy;
+      keys += n_cpy;
+      n -= n_cpy;
+    }
+}
+
+static void*
+radix_buffer_alloc(mctop_alloc_t* alloc, const uint node, const size_t size)
+{
+#if __sparc__ || MCTOP_RADIX_SORT_USE_NUMA_ALLOC == 0
+  void* mem = malloc(size);
+#else
+  void* mem = mctop_alloc_malloc_on_nth_socket(alloc, node, size);
+#endif
+  assert(mem != NULL);
+  return mem;
+}
+
+static void
+radix_buffer_free(void* mem, const size_t size)
+{
+#if __sparc__ || MCTOP_RADIX_SORT_USE_NUMA_ALLOC == 0
+  free(mem);
+#else
+  mctop_alloc_malloc_free(mem, size);
+#endif
+}
+
+/* digits of n_bits: 11 if the histogram and one cache line per bucket fit in half the L2, else 8.
+   The write-combining buffers take half the L1 (8 bits) or half the L2 (11 bits). */
+template <typename K>
+static void
+radix_config(radix_td<K>* td, mctop_t* topo)
+{
+  size_t l1_kb = mctop_get_cache_size_kb(topo, L1);
+  size_t l2_kb = mctop_get_cache_size_kb(topo, L2);
+  if (l1_kb == 0)
+    {
+      l1_kb = 32;
+    }
+  if (l2_kb == 0)
+    {
+      l2_kb = 256;
+    }
+
+  const size_t per_bucket = MCTOP_RADIX_SORT_WC_MIN_BYTES + sizeof(size_t);
+  td->n_bits = ((1 << 11) * per_bucket <= l2_kb * 512) ? 11 : 8;
+  const size_t budget = (td->n_bits == 8) ? (l1_kb * 512) : (l2_kb * 512);
+  size_t wc_bytes = budget / (1 << td->n_bits) - sizeof(size_t);
+  wc_bytes -= wc_bytes % MCTOP_RADIX_SORT_WC_MIN_BYTES;
+  if (wc_bytes < MCTOP_RADIX_SORT_WC_MIN_BYTES)
+    {
+      wc_bytes = MCTOP_RADIX_SORT_WC_MIN_BYTES;
+    }
+  td->wc_elems = wc_bytes / sizeof(K);
+}
+
+template <typename K>
+static void*
+mctop_radix_sort_thr(void* params)
+{
+  radix_td<K>* td = (radix_td<K>*) params;
+  mctop_node_tree_t* nt = td->nt;
+  mctop_alloc_t* alloc = nt->alloc;
+  mctop_alloc_pin(alloc);
+
+  const uint my_node = mctop_alloc_thread_node_id();
+  const uint my_id = mctop_alloc_thread_insocket_id();
+  const uint n_hwcs_node = mctop_alloc_get_num_hw_contexts_node(alloc, my_node);
+  radix_nd_t* nd = &td->node_data[my_node];
+
+  const size_t n_buckets = 1 << td->n_bits;
+  const size_t n_seg = radix_seg_size(td, my_node);
+  const size_t my_n_elems_even = n_seg / n_hwcs_node;
+  const size_t my_offset = my_id * my_n_elems_even;
+  const size_t my_n_elems = mctop_alloc_thread_is_node_last() ? (n_seg - my_offset) : my_n_elems_even;
+
+  if (mctop_alloc_thread_is_node_leader())
+    {
+      const size_t seg_size = n_seg * sizeof(K);
+      td->tmp[0].seg[my_node] = (K*) radix_buffer_alloc(alloc, my_node, seg_size);
+      td->tmp[1].seg[my_node] = (K*) radix_buffer_alloc(alloc, my_node, seg_size);
+      nd->hist = (size_t*) radix_buffer_alloc(alloc, my_node, n_hwcs_node * n_buckets * sizeof(size_t));
+    }
+
+  /* the digits that differ among the keys */
+  radix_bits<K> bits = { 0, (K) -1 };
+  const K* in = td->input.seg[my_node] + my_offset;
+  for (size_t i = 0; i < my_n_elems; i++)
+    {
+      bits.or_all |= in[i];
+      bits.and_all &= in[i];
+    }
+  mctop_nt_allreduce(nt, &bits, sizeof(bits), radix_bits_combine<K>);
+  const K diff = bits.or_all ^ bits.and_all;
+  const uint digit_mask = n_buckets - 1;
+  uint shifts[sizeof(K) * 8];
+  uint n_passes = 0;
+  for (uint shift = 0; shift < sizeof(K) * 8; shift += td->n_bits)
+    {
+      if ((diff >> shift) & digit_mask)
+	{
+	  shifts[n_passes++] = shift;
+	}
+    }
+
+  const size_t hist_size = sizeof(radix_hist_t) + td->n_sockets * n_buckets * sizeof(size_t);
+  radix_hist_t* sockets_hist = (radix_hist_t*) malloc(hist_size);
+  size_t* offsets = (size_t*) malloc(n_buckets * sizeof(size_t));
+  size_t* wc_fill = (size_t*) malloc(n_buckets * sizeof(size_t));
+  K* wc = (K*) malloc(n_buckets * td->wc_elems * sizeof(K));
+  assert(sockets_hist != NULL && offsets != NULL && wc_fill != NULL && wc != NULL);
+
+  mctop_alloc_barrier_wait_all(alloc);
+
+  radix_view<K>* src = &td->input;
+  for (uint p = 0; p < n_passes; p++)
+    {
+      /* with a single pass, the data go back to the input with a copy */
+      radix_view<K>* dst = (p == n_passes - 1 && n_passes > 1) ? &td->input : &td->tmp[p & 1];
+      const uint shift = shifts[p];
+      const K* my_keys = src->seg[my_node] + my_offset;
+
+      size_t* my_hist = nd->hist + my_id * n_buckets;
+      memset(my_hist, 0, n_buckets * sizeof(size_t));
+      for (size_t i = 0; i < my_n_elems; i++)
+	{
+	  my_hist[(my_keys[i] >> shift) & digit_mask]++;
+	}
+
+      memset(sockets_hist, 0, hist_size);
+      sockets_hist->n = td->n_sockets * n_buckets;
+      memcpy(sockets_hist->counts + my_node * n_buckets, my_hist, n_buckets * sizeof(size_t));
+      mctop_nt_allreduce(nt, sockets_hist, hist_size, radix_hist_add);
+
+      /* my keys of bucket b go after all keys of the smaller buckets, the keys of b of the
+	 previous sockets, and the keys of b of the previous threads of my socket */
+      size_t base = 0;
+      for (size_t b = 0; b < n_buckets; b++)
+	{
+	  size_t off = base;
+	  for (uint s = 0; s < td->n_sockets; s++)
+	    {
+	      const size_t c = sockets_hist->counts[s * n_buckets + b];
+	      base += c;
+	      if (s < my_node)
+		{
+		  off += c;
+		}
+	    }
+	  for (uint t = 0; t < my_id; t++)
+	    {
+	      off += nd->hist[t * n_buckets + b];
+	    }
+	  offsets[b] = off;
+	  wc_fill[b] = 0;
+	}
+
+      const size_t wc_elems = td->wc_elems;
+      for (size_t i = 0; i < my_n_elems; i++)
+	{
+	  const K key = my_keys[i];
+	  const size_t b = (key >> shift) & digit_mask;
+	  K* buf = wc + b * wc_elems;
+	  buf[wc_fill[b]++] = key;
+	  if (unlikely(wc_fill[b] == wc_elems))
+	    {
+	      radix_flush(td, dst, offsets[b], buf, wc_elems);
+	      offsets[b] += wc_elems;
+	      wc_fill[b] = 0;
+	    }
+	}
+      for (size_t b = 0; b < n_buckets; b++)
+	{
+	  radix_flush(td, dst, offsets[b], wc + b * wc_elems, wc_fill[b]);
+	}
+
+      mctop_alloc_barrier_wait_all(alloc);
+      src = dst;
+    }
+
+  if (src != &td->input)
+    {
+      memcpy(td->input.seg[my_node] + my_offset, src->seg[my_node] + my_offset, my_n_elems * sizeof(K));
+    }
+
+  free(wc);
+  free(wc_fill);
+  free(offsets);
+  free(sockets_hist);
+
+  mctop_alloc_barrier_wait_all(alloc);
+  if (mctop_alloc_thread_is_node_leader())
+    {
+      const size_t seg_size = n_seg * sizeof(K);
+      radix_buffer_free(nd->hist, n_hwcs_node * n_buckets * sizeof(size_t));
+      radix_buffer_free(td->tmp[1].seg[my_node], seg_size);
+      radix_buffer_free(td->tmp[0].seg[my_node], seg_size);
+    }
+  mctop_alloc_unpin();
+  return NULL;
+}
+
+template <typename K>
+static void
+mctop_radix_sort_run(K* array, const size_t n_elems, mctop_node_tree_t* nt)
+{
+  mctop_alloc_t* alloc = nt->alloc;
+  const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+  const uint n_sockets = mctop_alloc_get_num_sockets(alloc);
+  if (unlikely(n_elems <= (MCTOP_SORT_MIN_LEN_PARALLEL * sizeof(MCTOP_SORT_TYPE) / sizeof(K))) ||
+      n_hwcs == 1 || n_sockets > MCTOP_RADIX_MAX_SOCKETS)
+    {
+      std::sort(array, array + n_elems);
+      return;
+    }
+
+  radix_td<K> td;
+  td.nt = nt;
+  td.array = array;
+  td.n_elems = n_elems;
+  td.n_sockets = n_sockets;
+  td.seg_len = n_elems / n_sockets;
+  for (uint s = 0; s < n_sockets; s++)
+    {
+      td.input.seg[s] = array + s * td.seg_len;
+    }
+  radix_config(&td, alloc->topo);
+
+  pthread_t threads[n_hwcs];
+  for (uint t = 0; t < n_hwcs; t++)
+    {
+      if (pthread_create(&threads[t], NULL, mctop_radix_sort_thr<K>, &td))
+	{
+	  printf("mctop_radix_sort ERROR: pthread_create()\n");
+	  exit(-1);
+	}
+    }
+  for (uint t = 0; t < n_hwcs; t++)
+    {
+      if (pthread_join(threads[t], NULL))
+	{
+	  printf("mctop_radix_sort ERROR: pthread_join()\n");
+	  exit(-1);
+	}
+    }
+}
+
+void
+mctop_radix_sort(MCTOP_SORT_TYPE* array, const size_t n_elems, mctop_node_tree_t* nt)
+{
+  mctop_radix_sort_run(array, n_elems, nt);
+}
+
+void
+mctop_radix_sort_u64(uint64_t* array, const size_t n_elems, mctop_node_tree_t* nt)
+{
+  mctop_radix_sort_run(array, n_elems, nt);
+}
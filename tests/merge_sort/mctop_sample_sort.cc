@@ -0,0 +1,309 @@
+#include <mctop_sort.h>
+#include <mctop_rand.h>
+#include <merge_simd_utils.hpp>
+#include <algorithm>    // std::sort
+#include <string.h>
+
+/* Sample sort across sockets: instead of merging pairs of sockets along the node tree (every
+   element crosses the interconnect once per level), the threads
+   1. sample their part of the array, and the samples give n_sockets - 1 splitters. The share of
+      every socket is weighted by its # of hw contexts and the bandwidth to its memory
+      (mctop_socket_get_bw_to),
+   2. count and copy their keys to the buffer of the destination socket (allocated on it): every
+      element crosses the interconnect at most once,
+   3. sort the buffer of their socket (chunk sorts and in-socket merges) and write it to its final
+      position in the array. */
+
+/* node data descriptor */
+typedef struct MCTOP_ALIGNED(64) sample_nd
+{
+  MCTOP_SORT_TYPE* recv;	/* the keys that are sorted on this node */
+  MCTOP_SORT_TYPE* tmp;
+  size_t n_elems;
+  size_t base;			/* position of the node's keys in the sorted array */
+  mctop_sort_pd_t* partitions;
+} sample_nd_t;
+
+/* total data descriptor */
+typedef struct sample_td
+{
+  mctop_node_tree_t* nt;
+  MCTOP_SORT_TYPE* array;
+  size_t n_elems;
+  uint n_sockets;
+  size_t seg_len;		/* input: the last socket also gets the remainder */
+  size_t n_samples;		/* per thread */
+  MCTOP_SORT_TYPE* samples;
+  MCTOP_SORT_TYPE* splitters;
+  size_t* counts;		/* n_hwcs x n_sockets */
+  sample_nd_t* node_data;
+} sample_td_t;
+
+static void*
+mctop_sample_sort_thr(void* params);
+
+void
+mctop_sample_sort(MCTOP_SORT_TYPE* array, const size_t n_elems, mctop_node_tree_t* nt)
+{
+  mctop_alloc_t* alloc = nt->alloc;
+  const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+  const uint n_sockets = mctop_alloc_get_num_sockets(alloc);
+  if (unlikely(n_elems <= MCTOP_SORT_MIN_LEN_PARALLEL) || n_hwcs == 1)
+    {
+      std::sort(array, array + n_elems);
+      return;
+    }
+
+  sample_td_t td;
+  td.nt = nt;
+  td.array = array;
+  td.n_elems = n_elems;
+  td.n_sockets = n_sockets;
+  td.seg_len = n_elems / n_sockets;
+  td.n_samples = MCTOP_SAMPLE_SORT_OVERSAMPLING * n_sockets;
+  td.samples = (MCTOP_SORT_TYPE*) malloc(n_hwcs * td.n_samples * sizeof(MCTOP_SORT_TYPE));
+  td.splitters = (MCTOP_SORT_TYPE*) malloc(n_sockets * sizeof(MCTOP_SORT_TYPE));
+  td.counts = (size_t*) malloc(n_hwcs * n_sockets * sizeof(size_t));
+  td.node_data = (sample_nd_t*) malloc(n_sockets * sizeof(sample_nd_t));
+  assert(td.samples != NULL && td.splitters != NULL && td.counts != NULL && td.node_data != NULL);
+
+  pthread_t threads[n_hwcs];
+  for (uint t = 0; t < n_hwcs; t++)
+    {
+      if (pthread_create(&threads[t], NULL, mctop_sample_sort_thr, &td))
+	{
+	  printf("mctop_sample_sort ERROR: pthread_create()\n");
+	  exit(-1);
+	}
+    }
+  for (uint t = 0; t < n_hwcs; t++)
+    {
+      if (pthread_join(threads[t], NULL))
+	{
+	  printf("mctop_sample_sort ERROR: pthread_join()\n");
+	  exit(-1);
+	}
+    }
+
+  free(td.node_data);
+  free(td.counts);
+  free(td.splitters);
+  free(td.samples);
+}
+
+/* share of the keys of every socket: # hw contexts x bandwidth of the other sockets to its memory */
+static void
+mctop_sample_sort_weights(mctop_alloc_t* alloc, double* weights)
+{
+  const uint n_sockets = mctop_alloc_get_num_sockets(alloc);
+  double sum = 0;
+  for (uint d = 0; d < n_sockets; d++)
+    {
+      double bw_in = 0;
+      if (alloc->topo->has_mem)
+	{
+	  for (uint s = 0; s < n_sockets; s++)
+	    {
+	      if (s != d || n_sockets == 1)
+		{
+		  bw_in += mctop_socket_get_bw_to(alloc->sockets[s], alloc->sockets[d]);
+		}
+	    }
+	}
+      if (bw_in <= 0)
+	{
+	  bw_in = 1;
+	}
+      weights[d] = mctop_alloc_get_num_hw_contexts_node(alloc, d) * bw_in;
+      sum += weights[d];
+    }
+  for (uint d = 0; d < n_sockets; d++)
+    {
+      weights[d] /= sum;
+    }
+}
+
+static void
+mctop_sample_sort_splitters(sample_td_t* td, mctop_alloc_t* alloc)
+{
+  const size_t n = mctop_alloc_get_num_hw_contexts(alloc) * td->n_samples;
+  std::sort(td->samples, td->samples + n);
+  double weights[td->n_sockets];
+  mctop_sample_sort_weights(alloc, weights);
+  double share = 0;
+  for (uint d = 0; d + 1 < td->n_sockets; d++)
+    {
+      share += weights[d];
+      size_t i = share * n;
+      if (i >= n)
+	{
+	  i = n - 1;
+	}
+      td->splitters[d] = td->samples[i];
+    }
+}
+
+/* the threads of the node sort its keys; the last merge writes to the array */
+static void
+mctop_sample_sort_in_socket(sample_td_t* td, sample_nd_t* nd, const uint my_id, const uint n_threads)
+{
+  mctop_alloc_t* alloc = td->nt->alloc;
+  MCTOP_SORT_TYPE* sorted = td->array + nd->base;
+  const size_t my_n_elems_even = nd->n_elems / n_threads;
+  const size_t my_offset = my_id * my_n_elems_even;
+  const size_t my_n_elems = mctop_alloc_thread_is_node_last() ? (nd->n_elems - my_offset) : my_n_elems_even;
+
+  nd->partitions[my_id].start_index = my_offset;
+  nd->partitions[my_id].n_elems = my_n_elems;
+  mct::sort_isa(mct::simd_isa(), nd->recv + my_offset, nd->tmp + my_offset, my_n_elems);
+  if (n_threads == 1)
+    {
+      memcpy(sorted, nd->recv, nd->n_elems * sizeof(MCTOP_SORT_TYPE));
+      return;
+    }
+
+  MCTOP_SORT_TYPE* src = nd->recv;
+  MCTOP_SORT_TYPE* dest = nd->tmp;
+  mctop_sort_pd_t* parts = nd->partitions;
+  uint n_partitions = n_threads;
+  while (n_partitions > 1)
+    {
+      mctop_alloc_barrier_wait_node(alloc);
+      MCTOP_SORT_TYPE* out = (n_partitions == 2) ? sorted : dest;
+      for (uint p = 0; p + 1 < n_partitions; p += 2)
+	{
+	  mct::merge_parallel(src + parts[p].start_index, src + parts[p + 1].start_index,
+			      out + parts[p].start_index, parts[p].n_elems, parts[p + 1].n_elems,
+			      my_id, n_threads, std::less<MCTOP_SORT_TYPE>());
+	}
+      if ((n_partitions & 1) && mctop_alloc_thread_is_node_leader())
+	{
+	  mctop_sort_pd_t* last = &parts[n_partitions - 1];
+	  memcpy(out + last->start_index, src + last->start_index, last->n_elems * sizeof(MCTOP_SORT_TYPE));
+	}
+      mctop_alloc_barrier_wait_node(alloc);
+
+      if (mctop_alloc_thread_is_node_leader())
+	{
+	  for (uint p = 0; p < n_partitions; p += 2)
+	    {
+	      parts[p >> 1].start_index = parts[p].start_index;
+	      parts[p >> 1].n_elems = parts[p].n_elems;
+	      if (p + 1 < n_partitions)
+		{
+		  parts[p >> 1].n_elems += parts[p + 1].n_elems;
+		}
+	    }
+	}
+      n_partitions = (n_partitions + 1) >> 1;
+
+      MCTOP_SORT_TYPE* tmp = src;
+      src = dest;
+      dest = tmp;
+    }
+}
+
+static void*
+mctop_sample_sort_thr(void* params)
+{
+  sample_td_t* td = (sample_td_t*) params;
+  mctop_alloc_t* alloc = td->nt->alloc;
+  mctop_alloc_pin(alloc);
+
+  const uint my_node = mctop_alloc_thread_node_id();
+  const uint my_id = mctop_alloc_thread_insocket_id();
+  const uint my_tid = mctop_alloc_thread_id();
+  const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+  const uint n_hwcs_node = mctop_alloc_get_num_hw_contexts_node(alloc, my_node);
+  const uint n_sockets = td->n_sockets;
+  sample_nd_t* nd = &td->node_data[my_node];
+
+  const size_t n_seg = (my_node == n_sockets - 1) ? (td->n_elems - my_node * td->seg_len) : td->seg_len;
+  const size_t my_n_elems_even = n_seg / n_hwcs_node;
+  const size_t my_offset = my_id * my_n_elems_even;
+  const size_t my_n_elems = mctop_alloc_thread_is_node_last() ? (n_seg - my_offset) : my_n_elems_even;
+  const MCTOP_SORT_TYPE* my_keys = td->array + my_node * td->seg_len + my_offset;
+
+  /* 1. samples and splitters */
+  unsigned long* seeds = seed_rand_fixed();
+  seeds[0] += my_tid;
+  MCTOP_SORT_TYPE* my_samples = td->samples + my_tid * td->n_samples;
+  for (size_t i = 0; i < td->n_samples; i++)
+    {
+      my_samples[i] = my_n_elems ? my_keys[mctop_rand(seeds) % my_n_elems] : 0;
+    }
+  free(seeds);
+  mctop_alloc_barrier_wait_all(alloc);
+  if (my_tid == 0)
+    {
+      mctop_sample_sort_splitters(td, alloc);
+    }
+  mctop_alloc_barrier_wait_all(alloc);
+
+  /* 2. # of keys per destination socket */
+  const MCTOP_SORT_TYPE* splitters = td->splitters;
+  const MCTOP_SORT_TYPE* splitters_end = splitters + n_sockets - 1;
+  size_t* my_counts = td->counts + my_tid * n_sockets;
+  memset(my_counts, 0, n_sockets * sizeof(size_t));
+  for (size_t i = 0; i < my_n_elems; i++)
+    {
+      my_counts[std::upper_bound(splitters, splitters_end, my_keys[i]) - splitters]++;
+    }
+  mctop_alloc_barrier_wait_all(alloc);
+
+  size_t offsets[n_sockets];
+  for (uint d = 0; d < n_sockets; d++)
+    {
+      offsets[d] = 0;
+      for (uint t = 0; t < my_tid; t++)
+	{
+	  offsets[d] += td->counts[t * n_sockets + d];
+	}
+    }
+  if (mctop_alloc_thread_is_node_leader())
+    {
+      nd->n_elems = 0;
+      nd->base = 0;
+      for (uint t = 0; t < n_hwcs; t++)
+	{
+	  nd->n_elems += td->counts[t * n_sockets + my_node];
+	  for (uint d = 0; d < my_node; d++)
+	    {
+	      nd->base += td->counts[t * n_sockets + d];
+	    }
+	}
+      const size_t size = (nd->n_elems + 1) * sizeof(MCTOP_SORT_TYPE);
+      nd->recv = (MCTOP_SORT_TYPE*) mctop_alloc_malloc_on_nth_socket(alloc, my_node, size);
+      nd->tmp = (MCTOP_SORT_TYPE*) mctop_alloc_malloc_on_nth_socket(alloc, my_node, size);
+      nd->partitions = (mctop_sort_pd_t*) malloc(n_hwcs_node * sizeof(mctop_sort_pd_t));
+      assert(nd->recv != NULL && nd->tmp != NULL && nd->partitions != NULL);
+    }
+  mctop_alloc_barrier_wait_all(alloc);
+
+  /* 3. exchange: every key crosses the interconnect at most once */
+  MCTOP_SORT_TYPE* dests[n_sockets];
+  for (uint d = 0; d < n_sockets; d++)
+    {
+      dests[d] = td->node_data[d].recv + offsets[d];
+    }
+  for (size_t i = 0; i < my_n_elems; i++)
+    {
+      const MCTOP_SORT_TYPE key = my_keys[i];
+      *dests[std::upper_bound(splitters, splitters_end, key) - splitters]++ = key;
+    }
+  mctop_alloc_barrier_wait_all(alloc);
+
+  /* 4. local sorting */
+  mctop_sample_sort_in_socket(td, nd, my_id, n_hwcs_node);
+
+  mctop_alloc_barrier_wait_all(alloc);
+  if (mctop_alloc_thread_is_node_leader())
+    {
+      const size_t size = (nd->n_elems + 1) * sizeof(MCTOP_SORT_TYPE);
+      free(nd->partitions);
+      mctop_alloc_malloc_free(nd->tmp, size);
+      mctop_alloc_malloc_free(nd->recv, size);
+    }
+  mctop_alloc_unpin();
+  return NULL;
+}
@@ -1,5 +1,6 @@
 #include <mctop_sort.h>
 #include <merge_utils.h>
+#include <merge_simd_utils.hpp>
 #include <algorithm>    // std::sort
 #include <string.h>
 
@@ -180,7 +181,6 @@ mctop_sort_thr(void* params)
   const size_t tot_size = td->n_elems * sizeof(MCTOP_SORT_TYPE);
   mctop_node_tree_t* nt = td->nt;
   mctop_alloc_t* alloc = nt->alloc;
-  const size_t node_size = tot_size / alloc->n_sockets;
 
   mctop_alloc_pin(alloc);
   //  MSD_DO(mctop_alloc_thread_print();)
@@ -191,7 +191,7 @@ mctop_sort_thr(void* params)
 
   if (mctop_alloc_thread_is_node_leader())
     {
-      MSD_DO(printf("Node %u :: Handle %zu KB\n", my_node, node_size / 1024););
+      MSD_DO(printf("Node %u :: Handle %zu KB\n", my_node, nd->n_elems * sizeof(MCTOP_SORT_TYPE) / 1024););
 #if __sparc__
       nd->source = (MCTOP_SORT_TYPE*) malloc(2 * tot_size);
 #elif MCTOP_SORT_USE_NUMA_ALLOC == 1
@@ -240,9 +240,8 @@ mctop_sort_thr(void* params)
       // copy and sort in array_a = nd->source;
       MCTOP_SORT_TYPE* low = dest + offs;
       memcpy(low, copy + offs, my_n_elems_c * sizeof(MCTOP_SORT_TYPE));
-      MCTOP_SORT_TYPE* high = low + my_n_elems_c;
       MCTOP_P_STEP("memcpy", __steps, __a, __b, !mctop_alloc_thread_id());
-      std::sort(low, high);
+      mct::sort_isa(mct::simd_isa(), low, nd->destination + my_offset_socket + offs, my_n_elems_c);
       MCTOP_P_STEP("seq sort", __steps, __a, __b, !mctop_alloc_thread_id());
     }
 
@@ -274,7 +273,6 @@ mctop_sort_thr(void* params)
 	    {
 	      free(nd->partitions);
 	      print_error_sorted(nd->source, nd->n_elems, 1);
-	      nd->n_elems = node_size / sizeof(MCTOP_SORT_TYPE);
 	    }
 	  // ///////////////////////////////////////////////////////////////////////
 	  // cross-socket merging
@@ -500,7 +498,8 @@ mctop_sort_merge(MCTOP_SORT_TYPE* src, MCTOP_SORT_TYPE* dest,
       MCTOP_SORT_TYPE* my_dest = &dest[partition_a_start];
 
 #if MCTOP_SORT_USE_SSE == 1
-      merge_arrays(my_a, my_b, my_dest, partition_a_size, partition_b_size, pos_in_merge, threads_per_partition);
+      mct::merge_parallel(my_a, my_b, my_dest, partition_a_size, partition_b_size, pos_in_merge,
+			  threads_per_partition, std::less<MCTOP_SORT_TYPE>());
 #else
       merge_arrays_no_sse(my_a, my_b, my_dest, partition_a_size, partition_b_size, pos_in_merge, threads_per_partition);
 #endif
@@ -552,14 +551,15 @@ mctop_sort_merge_cross_socket(mctop_sort_td_t* td, const uint my_node)
 
 	  
 #if MCTOP_SORT_USE_SSE == 1 || MCTOP_SORT_USE_SSE == 2
-          merge_arrays(my_a, my_b, my_dest, n_elems_a, n_elems_b, my_merge_id, threads_in_merge);
+          mct::merge_parallel(my_a, my_b, my_dest, n_elems_a, n_elems_b, my_merge_id, threads_in_merge,
+			      std::less<MCTOP_SORT_TYPE>());
 #else
           merge_arrays_no_sse(my_a, my_b, my_dest, n_elems_a, n_elems_b, my_merge_id, threads_in_merge);
 #endif
 
 	  mctop_node_tree_barrier_wait(nt, l);
             
-          if (mctop_alloc_thread_is_node_leader())
+          if (ntw.node_role == DESTINATION && mctop_alloc_thread_is_node_leader())
 	    {
 	      MSD_DO(
 		     if (my_merge_id == 0)
@@ -581,7 +581,6 @@ mctop_sort_merge_cross_socket(mctop_sort_td_t* td, const uint my_node)
 	    {
 	      MSD_DO( printf("Node %d. No work for node @ lvl %d!\n", my_node, l););
 	    }
-	  return;
 	}
 
       // mctop_node_tree_barrier_wait(nt, l);
@@ -3,11 +3,14 @@
 #include <getopt.h>
 
 void* test_pin(void* params);
+void test_nt_sum(void* into, const void* from);
+uint test_nt_shape(mctop_node_tree_t* nt);
 
 int* memory;
 int* memory_nodes[16];
 size_t memory_size = 1024 * 1024 * 1024LL;
 size_t memory_len;
+volatile uint32_t __errors = 0;
 
 int
 main(int argc, char **argv) 
@@ -103,6 +106,8 @@ main(int argc, char **argv)
 
       mctop_node_tree_t* nt = mctop_alloc_node_tree_create(alloc, EVERYONE_CORE);
       mctop_node_tree_print(nt);
+      const uint n_shape_errors = test_nt_shape(nt);
+      printf("## Tree shape errors: %u : %s\n", n_shape_errors, n_shape_errors ? "FAILED" : "OK");
 
       if (test_run_pin)
 	{
@@ -136,6 +141,7 @@ main(int argc, char **argv)
 		  exit(-1);
 		}
 	    }
+	  printf("## Collectives errors: %u : %s\n", __errors, __errors ? "FAILED" : "OK");
 	}
       mctop_alloc_free(alloc);
       mctop_node_tree_free(nt);
@@ -187,13 +193,63 @@ test_pin(void* params)
 		     ntw.id_offset);
 	    }
 	}
-      else
-	{
-	  break;
-	}
     }
 
   mctop_node_tree_barrier_wait_all(nt);
 
+  /* collectives: the sum of ids + 1 */
+  const size_t n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+  const size_t sum_expected = n_hwcs * (n_hwcs + 1) / 2;
+  uint n_errors = 0;
+  for (uint r = 0; r < 16; r++)
+    {
+      size_t sum = mctop_alloc_thread_id() + 1;
+      if (mctop_nt_reduce(nt, &sum, test_nt_sum))
+	{
+	  n_errors += (sum != sum_expected) || !mctop_node_tree_is_root(nt);
+	}
+
+      sum = mctop_alloc_thread_id() + 1;
+      mctop_nt_allreduce(nt, &sum, sizeof(sum), test_nt_sum);
+      n_errors += (sum != sum_expected);
+
+      size_t val = mctop_node_tree_is_root(nt) ? r : n_hwcs;
+      mctop_nt_broadcast(nt, &val, sizeof(val));
+      n_errors += (val != r);
+    }
+  __sync_fetch_and_add(&__errors, n_errors);
+
   return NULL;
 }
+
+void
+test_nt_sum(void* into, const void* from)
+{
+  *(size_t*) into += *(const size_t*) from;
+}
+
+/* every node but the root is merged exactly once, into a node that is still active at that level */
+uint
+test_nt_shape(mctop_node_tree_t* nt)
+{
+  uint n_errors = 0;
+  uint merged[nt->n_nodes];
+  memset(merged, 0, nt->n_nodes * sizeof(uint));
+  for (int l = mctop_node_tree_get_num_levels(nt) - 1; l >= 0; l--)
+    {
+      mctop_nt_lvl_t* level = &nt->levels[l];
+      for (uint p = 0; p < level->n_pairs; p++)
+	{
+	  mctop_nt_pair_t* pair = &level->pairs[p];
+	  n_errors += merged[pair->nodes[0]] || merged[pair->nodes[1]];
+	  merged[pair->nodes[1]]++;
+	}
+    }
+
+  const uint root = mctop_node_tree_get_final_dest_node(nt);
+  for (uint n = 0; n < nt->n_nodes; n++)
+    {
+      n_errors += (n == root) ? (merged[n] != 0) : (merged[n] != 1);
+    }
+  return n_errors;
+}
@@ -0,0 +1,217 @@
+#include <mctop_alloc.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <atomics.h>
+
+/* Read-mostly throughput of pthread_rwlock_t against mctop_rwlock_t. Writers increment both
+   words of the protected data, thus a reader that sees them differ ran concurrently with a
+   writer. */
+
+void* test_rwlock(void* params);
+
+uint test_duration = 1000;	/* ms */
+uint test_write_pct = 10;
+volatile uint __stop = 0;
+volatile size_t __data[2] MCTOP_ALIGNED(64) = { 0, 0 };
+volatile size_t __n_ops[2] = { 0, 0 };
+volatile size_t __n_writes[2] = { 0, 0 };
+volatile uint32_t __errors = 0;
+pthread_rwlock_t __prwl;
+mctop_rwlock_t* __mrwl;
+
+int
+main(int argc, char **argv)
+{
+  char mct_file[100];
+  uint manual_file = 0;
+  int test_num_threads = 2;
+  int test_num_hwcs_per_socket = MCTOP_ALLOC_ALL;
+  mctop_alloc_policy test_policy = MCTOP_ALLOC_MIN_LAT_HWCS;
+
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help",                      no_argument,             NULL, 'h'},
+      {"mct",                       required_argument,       NULL, 'm'},
+      {"duration",                  required_argument,       NULL, 'd'},
+      {"writes",                    required_argument,       NULL, 'w'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int i;
+  char c;
+  while(1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hm:n:p:c:d:w:", long_options, &i);
+
+      if(c == -1)
+	break;
+
+      if(c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch(c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'm':
+	  sprintf(mct_file, "%s", optarg);
+	  manual_file = 1;
+	  break;
+	case 'n':
+	  test_num_threads = atoi(optarg);
+	  break;
+	case 'c':
+	  test_num_hwcs_per_socket = atoi(optarg);
+	  break;
+	case 'p':
+	  test_policy = atoi(optarg);
+	  break;
+	case 'd':
+	  test_duration = atoi(optarg);
+	  break;
+	case 'w':
+	  test_write_pct = atoi(optarg);
+	  break;
+	case 'h':
+	  mctop_alloc_help();
+	  printf("  -d <int>    duration of each run in ms (default: %u)\n", test_duration);
+	  printf("  -w <int>    percentage of writes (default: %u)\n", test_write_pct);
+	  exit(0);
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  mctop_t* topo;
+  if (manual_file)
+    {
+      topo = mctop_load(mct_file);
+    }
+  else
+    {
+      topo = mctop_load(NULL);
+    }
+
+  if (topo)
+    {
+      mctop_alloc_t* alloc = mctop_alloc_create(topo, test_num_threads, test_num_hwcs_per_socket, test_policy);
+      mctop_alloc_print_short(alloc);
+
+      pthread_rwlock_init(&__prwl, NULL);
+      __mrwl = mctop_rwlock_create(alloc);
+      printf("## MCTOP RW Lock -- %u reader indicators\n", __mrwl->n_indicators);
+
+      const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+      pthread_t threads[n_hwcs];
+      for (int l = 0; l < 2; l++)
+	{
+	  __stop = 0;
+	  for (int t = 0; t < n_hwcs; t++)
+	    {
+	      pthread_create(&threads[t], NULL, test_rwlock, (void*) (uintptr_t) l);
+	    }
+	  usleep(test_duration * 1000);
+	  __stop = 1;
+	  for (int t = 0; t < n_hwcs; t++)
+	    {
+	      pthread_join(threads[t], NULL);
+	    }
+	}
+
+      const size_t n_writes = __n_writes[0] + __n_writes[1];
+      if (__data[0] != n_writes || __data[1] != n_writes)
+	{
+	  __errors++;
+	}
+
+      const char* desc[2] = { "pthread", "mctop" };
+      for (int l = 0; l < 2; l++)
+	{
+	  printf("## %-8s rwlock : %10.0f ops/s (%zu writes)\n",
+		 desc[l], __n_ops[l] * 1000.0 / test_duration, (size_t) __n_writes[l]);
+	}
+      printf("## Inconsistent reads / lost writes: %u : %s\n", __errors, __errors ? "FAILED" : "OK");
+
+      mctop_rwlock_free(__mrwl);
+      pthread_rwlock_destroy(&__prwl);
+      mctop_alloc_free(alloc);
+      mctop_free(topo);
+      return __errors != 0;
+    }
+  return 0;
+}
+
+void*
+test_rwlock(void* params)
+{
+  const int l = (int) (uintptr_t) params;
+  mctop_alloc_t* alloc = __mrwl->wlock->alloc;
+  mctop_alloc_pin(alloc);
+  uint seed = mctop_alloc_thread_id() + 1;
+
+  mctop_alloc_barrier_wait_all(alloc);
+
+  size_t n_ops = 0, n_writes = 0;
+  uint n_errors = 0;
+  while (!__stop)
+    {
+      const uint write = (rand_r(&seed) % 100) < test_write_pct;
+      if (write)
+	{
+	  if (l == 0)
+	    {
+	      pthread_rwlock_wrlock(&__prwl);
+	    }
+	  else
+	    {
+	      mctop_rwlock_write_acquire(__mrwl);
+	    }
+	  __data[0]++;
+	  __data[1]++;
+	  if (l == 0)
+	    {
+	      pthread_rwlock_unlock(&__prwl);
+	    }
+	  else
+	    {
+	      mctop_rwlock_write_release(__mrwl);
+	    }
+	  n_writes++;
+	}
+      else
+	{
+	  if (l == 0)
+	    {
+	      pthread_rwlock_rdlock(&__prwl);
+	    }
+	  else
+	    {
+	      mctop_rwlock_read_acquire(__mrwl);
+	    }
+	  const size_t d0 = __data[0];
+	  const size_t d1 = __data[1];
+	  n_errors += (d0 != d1);
+	  if (l == 0)
+	    {
+	      pthread_rwlock_unlock(&__prwl);
+	    }
+	  else
+	    {
+	      mctop_rwlock_read_release(__mrwl);
+	    }
+	}
+      n_ops++;
+    }
+
+  __sync_fetch_and_add(&__n_ops[l], n_ops);
+  __sync_fetch_and_add(&__n_writes[l], n_writes);
+  __sync_fetch_and_add(&__errors, n_errors);
+  mctop_alloc_unpin();
+  return NULL;
+}
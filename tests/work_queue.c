@@ -3,6 +3,12 @@
 #include <getopt.h>
 
 void* test_pin(void* params);
+void* test_throughput(void* params);
+void* test_park(void* params);
+void* test_prio(void* params);
+static double run_threads(mctop_alloc_t* alloc, void* (*fun)(void*), void* params);
+
+const char* wq_type_desc[] = { "locked", "lock-free" };
 
 struct timespec
 timespec_diff(struct timespec start, struct timespec end)
@@ -21,6 +27,16 @@ timespec_diff(struct timespec start, struct timespec end)
   return temp;
 }
 
+const size_t _tput_reps = 1000000;
+const uint _tput_batch_max = 32;
+uint __tput_batch = 1;
+uint test_park_depth = 14;
+volatile uint64_t __park_leaves = 0;
+const uint _prio_per_thread = 10000;
+volatile uint32_t __prio_barrier = 0;
+volatile uint32_t __prio_errors = 0;
+volatile uint64_t __prio_dequeued = 0;
+
 int
 main(int argc, char **argv) 
 {
@@ -30,12 +46,22 @@ main(int argc, char **argv)
   int test_num_hwcs_per_socket = MCTOP_ALLOC_ALL;
   mctop_alloc_policy test_policy = 1;
   uint test_run_pin = 0;
+  uint test_throughput_cmp = 0;
+  uint test_park_run = 0;
+  uint test_prio_run = 0;
+  uint test_stats = 0;
+  mctop_wq_type_t test_wq_type = MCTOP_WQ_LOCKED;
 
   struct option long_options[] = 
     {
       // These options don't set a flag
       {"help",                      no_argument,             NULL, 'h'},
       {"mct",                       required_argument,       NULL, 'm'},
+      {"wq-type",                   required_argument,       NULL, 'w'},
+      {"throughput",                no_argument,             NULL, 't'},
+      {"park",                      required_argument,       NULL, 'k'},
+      {"prio",                      no_argument,             NULL, 'q'},
+      {"stats",                     no_argument,             NULL, 's'},
       {NULL, 0, NULL, 0}
     };
 
@@ -44,7 +70,7 @@ main(int argc, char **argv)
   while(1) 
     {
       i = 0;
-      c = getopt_long(argc, argv, "hm:n:p:c:r", long_options, &i);
+      c = getopt_long(argc, argv, "hm:n:p:c:rw:tk:qs", long_options, &i);
 
       if(c == -1)
 	break;
@@ -73,8 +99,30 @@ main(int argc, char **argv)
 	case 'r':
 	  test_run_pin = 1;
 	  break;
+	case 'w':
+	  test_wq_type = atoi(optarg) ? MCTOP_WQ_LOCK_FREE : MCTOP_WQ_LOCKED;
+	  break;
+	case 't':
+	  test_throughput_cmp = 1;
+	  break;
+	case 'k':
+	  test_park_run = 1;
+	  test_park_depth = atoi(optarg);
+	  break;
+	case 'q':
+	  test_prio_run = 1;
+	  break;
+	case 's':
+	  test_stats = 1;
+	  break;
 	case 'h':
 	  mctop_alloc_help();
+	  printf("  -r          run the summing test on the work queue\n"
+		 "  -w <int>    work queue type: 0 = locked (default), 1 = lock-free\n"
+		 "  -t          compare the enqueue/dequeue throughput of the work queue types\n"
+		 "  -k <int>    run a task tree of the given depth in parking mode\n"
+		 "  -q          check the dequeue order of the priority work queue\n"
+		 "  -s          enable the work queue statistics and print them per socket\n");
 	  exit(0);
 	case '?':
 	  printf("Use -h or --help for help\n");
@@ -102,53 +150,77 @@ main(int argc, char **argv)
       mctop_alloc_print(alloc);
       mctop_alloc_print_short(alloc);
 
-      mctop_wq_t* wq = mctop_wq_create(alloc);
+      mctop_wq_t* wq = mctop_wq_create_type(alloc, test_wq_type);
       mctop_wq_print(wq);
 
       if (test_run_pin)
 	{
-	  const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
-	  pthread_t threads[n_hwcs];
-	  pthread_attr_t attr;
-	  void* status;
-    
-	  /* Initialize and set thread detached attribute */
-	  pthread_attr_init(&attr);
-	  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    
-	  struct timespec start, stop;
-	  clock_gettime(CLOCK_REALTIME, &start);
-
-	  for(int t = 0; t < n_hwcs; t++)
+	  if (test_stats)
 	    {
-	      int rc = pthread_create(&threads[t], &attr, test_pin, wq);
-	      if (rc)
-		{
-		  printf("ERROR; return code from pthread_create() is %d\n", rc);
-		  exit(-1);
-		}
+	      mctop_wq_stats_enable(wq);
 	    }
+	  double dur_s = run_threads(alloc, test_pin, wq);
+	  printf("## Summed  in %f seconds\n", dur_s);
+	  if (test_stats)
+	    {
+	      mctop_wq_stats_print_sockets(wq);
+	    }
+	}
+      mctop_wq_free(wq);
 
-	  pthread_attr_destroy(&attr);
+      if (test_park_run)
+	{
+	  wq = mctop_wq_create_type(alloc, test_wq_type);
+	  mctop_wq_set_park(wq, 1);
+	  struct timespec cpu_start, cpu_stop;
+	  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_start);
+	  double dur_s = run_threads(alloc, test_park, wq);
+	  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_stop);
+	  struct timespec cpu = timespec_diff(cpu_start, cpu_stop);
+	  const uint64_t n_leaves = 1ULL << test_park_depth;
+	  printf("## Parking: %zu of %zu leaves in %f seconds (cpu time %f seconds) : %s\n",
+		 (size_t) __park_leaves, (size_t) n_leaves, dur_s, cpu.tv_sec + (cpu.tv_nsec / 1e9),
+		 (__park_leaves == n_leaves && mctop_wq_get_size_atomic(wq) == 0) ? "OK" : "FAILED");
+	  mctop_wq_free(wq);
+	}
+
+      if (test_prio_run)
+	{
+	  mctop_pwq_t* pwq = mctop_pwq_create(alloc, test_wq_type);
+	  mctop_pwq_print(pwq);
+	  double dur_s = run_threads(alloc, test_prio, pwq);
+	  const size_t n_elems = (size_t) _prio_per_thread * mctop_alloc_get_num_hw_contexts(alloc);
+	  printf("## Priorities: dequeued %zu of %zu in %f seconds, %u out of order : %s\n",
+		 (size_t) __prio_dequeued, n_elems, dur_s, __prio_errors,
+		 (__prio_dequeued == n_elems && __prio_errors == 0) ? "OK" : "FAILED");
+	  mctop_pwq_free(pwq);
+	}
 
-	  for(int t = 0; t < n_hwcs; t++)
+      if (test_throughput_cmp)
+	{
+	  const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+	  for (int t = MCTOP_WQ_LOCKED; t <= MCTOP_WQ_LOCK_FREE; t++)
 	    {
-	      int rc = pthread_join(threads[t], &status);
-	      if (rc) 
+	      for (__tput_batch = 1; __tput_batch <= _tput_batch_max; __tput_batch *= _tput_batch_max)
 		{
-		  printf("ERROR; return code from pthread_join() is %d\n", rc);
-		  exit(-1);
+		  wq = mctop_wq_create_type(alloc, (mctop_wq_type_t) t);
+		  if (test_stats)
+		    {
+		      mctop_wq_stats_enable(wq);
+		    }
+		  double dur_s = run_threads(alloc, test_throughput, wq);
+		  const double n_ops = 2.0 * n_hwcs * _tput_reps;
+		  printf("## Throughput %-9s (batch %2u) : %zu enq+deq per thread in %f seconds = %8.3f Mops/s\n",
+			 wq_type_desc[t], __tput_batch, _tput_reps, dur_s, n_ops / dur_s / 1e6);
+		  if (test_stats)
+		    {
+		      mctop_wq_stats_print_sockets(wq);
+		    }
+		  mctop_wq_free(wq);
 		}
 	    }
-
-	  clock_gettime(CLOCK_REALTIME, &stop);
-	  struct timespec dur = timespec_diff(start, stop);
-	  double dur_s = dur.tv_sec + (dur.tv_nsec / 1e9);
-	  printf("## Summed  in %f seconds\n", dur_s);
-
 	}
 
-      mctop_wq_free(wq);
       mctop_alloc_free(alloc);
 
       mctop_free(topo);
@@ -356,5 +428,182 @@ test_pin(void* params)
 
   free(n_from);
   free(seeds);
+  mctop_alloc_unpin();
   return NULL;
 }
+
+/* enqueue/dequeue pairs on a queue that always holds a few elements per thread, so that
+   threads mostly dequeue locally but steal as well once their queue runs dry */
+volatile uint32_t __tput_barrier = 0;
+const uint _tput_prefill = 8;
+
+void*
+test_throughput(void* params)
+{
+  mctop_wq_t* wq = (mctop_wq_t*) params;
+  mctop_alloc_t* alloc = wq->alloc;
+  mctop_alloc_pin(alloc);
+
+  const uintptr_t token = mctop_alloc_thread_hw_context_id() + 1;
+  for (uint i = 0; i < _tput_prefill; i++)
+    {
+      mctop_wq_enqueue(wq, (void*) token);
+    }
+
+  FAI_U32(&__tput_barrier);
+  while (__tput_barrier % alloc->n_hwcs)
+    {
+      PAUSE();
+    }
+
+  if (__tput_batch == 1)
+    {
+      for (size_t r = 0; r < _tput_reps; r++)
+	{
+	  mctop_wq_enqueue(wq, (void*) token);
+	  void* data = mctop_wq_dequeue(wq);
+	  assert(data != NULL);
+	}
+    }
+  else
+    {
+      const uint b = __tput_batch;
+      const void* tokens[b];
+      void* data[b];
+      for (uint i = 0; i < b; i++)
+	{
+	  tokens[i] = (void*) token;
+	}
+      for (size_t r = 0; r < _tput_reps; r += b)
+	{
+	  mctop_wq_enqueue_batch(wq, tokens, b);
+	  for (uint got = 0; got < b;)
+	    {
+	      got += mctop_wq_dequeue_batch(wq, data, b - got);
+	    }
+	}
+    }
+
+  mctop_alloc_unpin();
+  return NULL;
+}
+
+/* a single task tree: a task of depth d > 0 enqueues two tasks of depth d - 1, thus the load
+   starts at one thread and idle threads park until work reaches their socket */
+void*
+test_park(void* params)
+{
+  mctop_wq_t* wq = (mctop_wq_t*) params;
+  mctop_alloc_t* alloc = wq->alloc;
+  mctop_alloc_pin(alloc);
+
+  if (mctop_alloc_thread_id() == 0)
+    {
+      mctop_wq_enqueue(wq, (void*) (uintptr_t) (test_park_depth + 1));
+    }
+
+  size_t n_tasks = 0, n_leaves = 0;
+  uintptr_t task;
+  while ((task = (uintptr_t) mctop_wq_dequeue_wait(wq)) != 0)
+    {
+      n_tasks++;
+      const uint depth = task - 1;
+      if (depth > 0)
+	{
+	  mctop_wq_enqueue(wq, (void*) (uintptr_t) depth);
+	  mctop_wq_enqueue(wq, (void*) (uintptr_t) depth);
+	}
+      else
+	{
+	  n_leaves++;
+	}
+    }
+  __sync_fetch_and_add(&__park_leaves, n_leaves);
+
+  printf("[%3u@%-2u] #Tasks %zu\n", mctop_alloc_thread_hw_context_id(), mctop_alloc_thread_local_node(),
+	 n_tasks);
+  mctop_alloc_unpin();
+  return NULL;
+}
+
+/* all elements are enqueued before the first dequeue, thus the levels drain in order and
+   every thread must see non-decreasing priorities */
+void*
+test_prio(void* params)
+{
+  mctop_pwq_t* pwq = (mctop_pwq_t*) params;
+  mctop_alloc_t* alloc = pwq->alloc;
+  mctop_alloc_pin(alloc);
+
+  unsigned long* seeds = seed_rand();
+  seeds[0] += mctop_alloc_thread_id();
+  for (uint i = 0; i < _prio_per_thread; i++)
+    {
+      const uint prio = mrand(seeds) % MCTOP_PWQ_N_PRIOS;
+      mctop_pwq_enqueue(pwq, prio, (void*) (uintptr_t) (prio + 1));
+    }
+
+  FAI_U32(&__prio_barrier);
+  while (__prio_barrier != alloc->n_hwcs)
+    {
+      PAUSE();
+    }
+
+  uint prio_prev = 0, prio, n_errors = 0;
+  size_t n = 0;
+  uintptr_t data;
+  while ((data = (uintptr_t) mctop_pwq_dequeue(pwq, &prio)) != 0)
+    {
+      n++;
+      n_errors += (prio < prio_prev) || (data != (prio + 1));
+      prio_prev = prio;
+    }
+  __sync_fetch_and_add(&__prio_dequeued, n);
+  __sync_fetch_and_add(&__prio_errors, n_errors);
+
+  free(seeds);
+  mctop_alloc_unpin();
+  return NULL;
+}
+
+static double
+run_threads(mctop_alloc_t* alloc, void* (*fun)(void*), void* params)
+{
+  const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+  pthread_t threads[n_hwcs];
+  pthread_attr_t attr;
+  void* status;
+
+  /* Initialize and set thread detached attribute */
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+  struct timespec start, stop;
+  clock_gettime(CLOCK_REALTIME, &start);
+
+  for(int t = 0; t < n_hwcs; t++)
+    {
+      int rc = pthread_create(&threads[t], &attr, fun, params);
+      if (rc)
+	{
+	  printf("ERROR; return code from pthread_create() is %d\n", rc);
+	  exit(-1);
+	}
+    }
+
+  pthread_attr_destroy(&attr);
+
+  for(int t = 0; t < n_hwcs; t++)
+    {
+      int rc = pthread_join(threads[t], &status);
+      if (rc)
+	{
+	  printf("ERROR; return code from pthread_join() is %d\n", rc);
+	  exit(-1);
+	}
+    }
+
+  clock_gettime(CLOCK_REALTIME, &stop);
+  struct timespec dur = timespec_diff(start, stop);
+  return dur.tv_sec + (dur.tv_nsec / 1e9);
+}
@@ -9,6 +9,8 @@ void* test_pin(void* params);
 
 volatile int* array, * array_out;
 
+#define WQ_BATCH_SIZE 256
+
 #define mrand(x) xorshf96(&x[0], &x[1], &x[2])
 
 static inline unsigned long* 
@@ -204,8 +206,12 @@ main(int argc, char **argv)
       const uint per_page = page_size / sizeof(uint);
 
 
+      /* consecutive pages on the same node are enqueued as one batch */
+      const void* batch[WQ_BATCH_SIZE];
+      uint batch_len = 0;
       void* arrayv = (void*) array;
       int node_prev = get_numa_node(arrayv, alloc->n_sockets), n_pages = 0, chunk_size = -1;
+      int node_batch = node_prev;
       for (uint p = 0; p < array_len_pages; p++)
 	{
 	  n_pages++;
@@ -215,11 +221,20 @@ main(int argc, char **argv)
 	      chunk_size = n_pages * page_size;
 	    }
 	  //	  printf("%p on %d\n", arrayv, node); 
-	  wq_data_t* wqd = wq_data_create(1, 0, per_page, arrayv);
-	  mctop_wq_enqueue_node(wq, node, wqd);
+	  if (batch_len == WQ_BATCH_SIZE || (batch_len > 0 && node != node_batch))
+	    {
+	      mctop_wq_enqueue_batch_node(wq, node_batch, batch, batch_len);
+	      batch_len = 0;
+	    }
+	  node_batch = node;
+	  batch[batch_len++] = wq_data_create(1, 0, per_page, arrayv);
 	  arrayv += page_size;
 	  
 	}
+      if (batch_len > 0)
+	{
+	  mctop_wq_enqueue_batch_node(wq, node_batch, batch, batch_len);
+	}
 
       mctop_wq_print(wq);
       printf("# Data = %llu MB (chunk size = %d = %llu MB)\n",
@@ -0,0 +1,183 @@
+#include <mctop_alloc.h>
+#include <pthread.h>
+#include <getopt.h>
+#include <atomics.h>
+
+/* Thread 0 pushes a few task trees to its deque. Executing a task of depth d > 0 pushes two
+   tasks of depth d - 1, so the other threads only get work by stealing. */
+
+void* test_ws(void* params);
+
+const uint _n_roots = 8;
+uint test_depth = 16;
+volatile uint64_t __n_leaves = 0;
+volatile uint32_t __barrier = 0;
+
+int
+main(int argc, char **argv)
+{
+  char mct_file[100];
+  uint manual_file = 0;
+  int test_num_threads = 2;
+  int test_num_hwcs_per_socket = MCTOP_ALLOC_ALL;
+  mctop_alloc_policy test_policy = 1;
+
+  struct option long_options[] =
+    {
+      // These options don't set a flag
+      {"help",                      no_argument,             NULL, 'h'},
+      {"mct",                       required_argument,       NULL, 'm'},
+      {"depth",                     required_argument,       NULL, 'd'},
+      {NULL, 0, NULL, 0}
+    };
+
+  int i;
+  char c;
+  while(1)
+    {
+      i = 0;
+      c = getopt_long(argc, argv, "hm:n:p:c:d:", long_options, &i);
+
+      if(c == -1)
+	break;
+
+      if(c == 0 && long_options[i].flag == 0)
+	c = long_options[i].val;
+
+      switch(c)
+	{
+	case 0:
+	  /* Flag is automatically set */
+	  break;
+	case 'm':
+	  sprintf(mct_file, "%s", optarg);
+	  manual_file = 1;
+	  break;
+	case 'n':
+	  test_num_threads = atoi(optarg);
+	  break;
+	case 'c':
+	  test_num_hwcs_per_socket = atoi(optarg);
+	  break;
+	case 'p':
+	  test_policy = atoi(optarg);
+	  break;
+	case 'd':
+	  test_depth = atoi(optarg);
+	  break;
+	case 'h':
+	  mctop_alloc_help();
+	  printf("  -d <int>    depth of the task trees (default: %u)\n", test_depth);
+	  exit(0);
+	case '?':
+	  printf("Use -h or --help for help\n");
+	  exit(0);
+	default:
+	  exit(1);
+	}
+    }
+
+  mctop_t* topo;
+  if (manual_file)
+    {
+      topo = mctop_load(mct_file);
+    }
+  else
+    {
+      topo = mctop_load(NULL);
+    }
+
+  int correct = 1;
+  if (topo)
+    {
+      mctop_alloc_t* alloc = mctop_alloc_create(topo, test_num_threads, test_num_hwcs_per_socket, test_policy);
+      mctop_alloc_print_short(alloc);
+
+      mctop_ws_t* ws = mctop_ws_create(alloc);
+      mctop_ws_print(ws);
+
+      const uint n_hwcs = mctop_alloc_get_num_hw_contexts(alloc);
+      pthread_t threads[n_hwcs];
+      for (int t = 0; t < n_hwcs; t++)
+	{
+	  pthread_create(&threads[t], NULL, test_ws, ws);
+	}
+      for (int t = 0; t < n_hwcs; t++)
+	{
+	  pthread_join(threads[t], NULL);
+	}
+
+      const uint64_t n_leaves = (uint64_t) _n_roots << test_depth;
+      correct = (__n_leaves == n_leaves) && (mctop_ws_get_size(ws) == 0);
+      printf("## Executed %zu of %zu leaves : %s\n", (size_t) __n_leaves, (size_t) n_leaves,
+	     correct ? "OK" : "FAILED");
+
+      mctop_ws_free(ws);
+      mctop_alloc_free(alloc);
+      mctop_free(topo);
+    }
+  return !correct;
+}
+
+/* tasks are (depth + 1), thus never NULL */
+void*
+test_ws(void* params)
+{
+  mctop_ws_t* ws = (mctop_ws_t*) params;
+  mctop_alloc_t* alloc = ws->alloc;
+  mctop_alloc_pin(alloc);
+
+  const uint64_t n_leaves_tot = (uint64_t) _n_roots << test_depth;
+  if (mctop_alloc_thread_id() == 0)
+    {
+      for (uint r = 0; r < _n_roots; r++)
+	{
+	  mctop_ws_push(ws, (void*) (uintptr_t) (test_depth + 1));
+	}
+    }
+
+  FAI_U32(&__barrier);
+  while (__barrier != alloc->n_hwcs)
+    {
+      PAUSE();
+    }
+
+  size_t n_tasks = 0, n_stolen = 0, n_leaves = 0;
+  while (__n_leaves < n_leaves_tot)
+    {
+      uintptr_t task = (uintptr_t) mctop_ws_pop(ws);
+      if (task == 0)
+	{
+	  task = (uintptr_t) mctop_ws_steal(ws);
+	  if (task == 0)
+	    {
+	      if (n_leaves > 0)	/* out of work: publish the leaves */
+		{
+		  __sync_fetch_and_add(&__n_leaves, n_leaves);
+		  n_leaves = 0;
+		}
+	      PAUSE();
+	      continue;
+	    }
+	  n_stolen++;
+	}
+
+      n_tasks++;
+      const uint depth = task - 1;
+      if (depth > 0)
+	{
+	  mctop_ws_push(ws, (void*) (uintptr_t) depth);
+	  mctop_ws_push(ws, (void*) (uintptr_t) depth);
+	}
+      else
+	{
+	  n_leaves++;
+	}
+    }
+
+  printf("[%3u@%-2u] #Tasks %-8zu #Stolen %-6zu\n",
+	 mctop_alloc_thread_hw_context_id(), mctop_alloc_thread_local_node(), n_tasks, n_stolen);
+
+  mctop_alloc_unpin();
+  return NULL;
+}